@@ -0,0 +1,33 @@
+#!/bin/sh
+# time reading a generated source file with the flex and the fast scanner
+#   bench/scanner.sh path/to/my-lisp [forms]
+# the forms are quoted data, so the time is mostly scanning and parsing.
+# prints the best of 5 runs of each scanner in seconds.
+set -e
+LISP=${1:?usage: scanner.sh my-lisp [forms]}
+FORMS=${2:-200000}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+awk -v n="$FORMS" 'BEGIN {
+    for (i = 0; i < n; i++) {
+        printf "; form %d\n", i
+        printf "(quote (define (f%d x) (g x %d -%d %d.25 \"str %d\"\n", i, i, i, i, i
+        printf "    [nested (list #t #f) sym-%d] 12345678 1.5e3 #\\a)))\n", i
+    }
+}' > "$DIR/input.scm"
+
+best() {
+    b=
+    for run in 1 2 3 4 5; do
+        s=$(date +%s.%N)
+        "$LISP" --quiet "$@" "$DIR/input.scm" > /dev/null
+        e=$(date +%s.%N)
+        b=$(echo "$s $e $b" | awk '{ t = $2 - $1; if ($3 == "" || t < $3) print t; else print $3 }')
+    done
+    echo "$b"
+}
+
+echo "$(wc -c < "$DIR/input.scm") bytes, $FORMS forms"
+echo "flex  $(best)"
+echo "fast  $(best --fast-scanner)"
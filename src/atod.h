@@ -0,0 +1,11 @@
+#pragma once
+
+#include <my-os/types.h>
+
+/*
+ * parse [+-]digits[.digits][(e|E)[+-]digits] from s up to end into the
+ * nearest double, ties to even. at least one mantissa digit is needed; an
+ * exponent marker without digits is left unparsed. returns the end of the
+ * number, or NULL when there is none at s.
+ */
+const char *atod(const char *s, const char *end, double *v);
@@ -0,0 +1,389 @@
+#include "dtoa.h"
+
+#include "atod.h"
+#include "os.h"
+
+/*
+ * grisu2, after Florian Loitsch, "Printing Floating-Point Numbers Quickly
+ * and Accurately with Integers". the digits always read back as the same
+ * double. grisu2 narrows the rounding interval to stay safe, which now and
+ * then costs a digit; those cases are caught and checked with atod.
+ */
+typedef struct diy_fp_t {
+    u64 f;
+    int e;
+} diy_fp;
+
+/* 10^k for k = -348, -340, ..., 340, normalized and rounded */
+static const diy_fp cached_powers[] = {
+    {0xfa8fd5a0081c0288ull, -1220},
+    {0xbaaee17fa23ebf76ull, -1193},
+    {0x8b16fb203055ac76ull, -1166},
+    {0xcf42894a5dce35eaull, -1140},
+    {0x9a6bb0aa55653b2dull, -1113},
+    {0xe61acf033d1a45dfull, -1087},
+    {0xab70fe17c79ac6caull, -1060},
+    {0xff77b1fcbebcdc4full, -1034},
+    {0xbe5691ef416bd60cull, -1007},
+    {0x8dd01fad907ffc3cull, -980},
+    {0xd3515c2831559a83ull, -954},
+    {0x9d71ac8fada6c9b5ull, -927},
+    {0xea9c227723ee8bcbull, -901},
+    {0xaecc49914078536dull, -874},
+    {0x823c12795db6ce57ull, -847},
+    {0xc21094364dfb5637ull, -821},
+    {0x9096ea6f3848984full, -794},
+    {0xd77485cb25823ac7ull, -768},
+    {0xa086cfcd97bf97f4ull, -741},
+    {0xef340a98172aace5ull, -715},
+    {0xb23867fb2a35b28eull, -688},
+    {0x84c8d4dfd2c63f3bull, -661},
+    {0xc5dd44271ad3cdbaull, -635},
+    {0x936b9fcebb25c996ull, -608},
+    {0xdbac6c247d62a584ull, -582},
+    {0xa3ab66580d5fdaf6ull, -555},
+    {0xf3e2f893dec3f126ull, -529},
+    {0xb5b5ada8aaff80b8ull, -502},
+    {0x87625f056c7c4a8bull, -475},
+    {0xc9bcff6034c13053ull, -449},
+    {0x964e858c91ba2655ull, -422},
+    {0xdff9772470297ebdull, -396},
+    {0xa6dfbd9fb8e5b88full, -369},
+    {0xf8a95fcf88747d94ull, -343},
+    {0xb94470938fa89bcfull, -316},
+    {0x8a08f0f8bf0f156bull, -289},
+    {0xcdb02555653131b6ull, -263},
+    {0x993fe2c6d07b7facull, -236},
+    {0xe45c10c42a2b3b06ull, -210},
+    {0xaa242499697392d3ull, -183},
+    {0xfd87b5f28300ca0eull, -157},
+    {0xbce5086492111aebull, -130},
+    {0x8cbccc096f5088ccull, -103},
+    {0xd1b71758e219652cull, -77},
+    {0x9c40000000000000ull, -50},
+    {0xe8d4a51000000000ull, -24},
+    {0xad78ebc5ac620000ull, 3},
+    {0x813f3978f8940984ull, 30},
+    {0xc097ce7bc90715b3ull, 56},
+    {0x8f7e32ce7bea5c70ull, 83},
+    {0xd5d238a4abe98068ull, 109},
+    {0x9f4f2726179a2245ull, 136},
+    {0xed63a231d4c4fb27ull, 162},
+    {0xb0de65388cc8ada8ull, 189},
+    {0x83c7088e1aab65dbull, 216},
+    {0xc45d1df942711d9aull, 242},
+    {0x924d692ca61be758ull, 269},
+    {0xda01ee641a708deaull, 295},
+    {0xa26da3999aef774aull, 322},
+    {0xf209787bb47d6b85ull, 348},
+    {0xb454e4a179dd1877ull, 375},
+    {0x865b86925b9bc5c2ull, 402},
+    {0xc83553c5c8965d3dull, 428},
+    {0x952ab45cfa97a0b3ull, 455},
+    {0xde469fbd99a05fe3ull, 481},
+    {0xa59bc234db398c25ull, 508},
+    {0xf6c69a72a3989f5cull, 534},
+    {0xb7dcbf5354e9beceull, 561},
+    {0x88fcf317f22241e2ull, 588},
+    {0xcc20ce9bd35c78a5ull, 614},
+    {0x98165af37b2153dfull, 641},
+    {0xe2a0b5dc971f303aull, 667},
+    {0xa8d9d1535ce3b396ull, 694},
+    {0xfb9b7cd9a4a7443cull, 720},
+    {0xbb764c4ca7a44410ull, 747},
+    {0x8bab8eefb6409c1aull, 774},
+    {0xd01fef10a657842cull, 800},
+    {0x9b10a4e5e9913129ull, 827},
+    {0xe7109bfba19c0c9dull, 853},
+    {0xac2820d9623bf429ull, 880},
+    {0x80444b5e7aa7cf85ull, 907},
+    {0xbf21e44003acdd2dull, 933},
+    {0x8e679c2f5e44ff8full, 960},
+    {0xd433179d9c8cb841ull, 986},
+    {0x9e19db92b4e31ba9ull, 1013},
+    {0xeb96bf6ebadf77d9ull, 1039},
+    {0xaf87023b9bf0ee6bull, 1066},
+};
+
+#define CACHED_POWERS_MIN_EXP10 (-348)
+#define CACHED_POWERS_STEP 8
+
+static const u64 pow10_u64[] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull,
+};
+
+#define DP_SIGNIFICAND_MASK ((1ull << 52) - 1)
+#define DP_HIDDEN_BIT (1ull << 52)
+#define DP_EXPONENT_BIAS (1023 + 52)
+
+static diy_fp diy_fp_from_double(double d) {
+    u64 bits;
+    memcpy(&bits, &d, sizeof(bits));
+    int biased = (bits >> 52) & 0x7ff;
+    u64 significand = bits & DP_SIGNIFICAND_MASK;
+    if (biased) {
+        return (diy_fp){significand + DP_HIDDEN_BIT, biased - DP_EXPONENT_BIAS};
+    }
+    return (diy_fp){significand, 1 - DP_EXPONENT_BIAS};
+}
+
+static diy_fp diy_fp_normalize(diy_fp x) {
+    int shift = __builtin_clzll(x.f);
+    return (diy_fp){x.f << shift, x.e - shift};
+}
+
+/* the upper 64 bits of the product, rounded */
+static diy_fp diy_fp_mul(diy_fp x, diy_fp y) {
+    unsigned __int128 p = (unsigned __int128)x.f * y.f;
+    u64 h = p >> 64;
+    u64 l = (u64)p;
+    return (diy_fp){h + (l >> 63), x.e + y.e + 64};
+}
+
+/* the midpoints to the neighbouring doubles, sharing the exponent of plus */
+static void normalized_boundaries(diy_fp v, diy_fp *minus, diy_fp *plus) {
+    diy_fp p = diy_fp_normalize((diy_fp){(v.f << 1) + 1, v.e - 1});
+    /* the gap below a power of two is half as wide */
+    diy_fp m = v.f == DP_HIDDEN_BIT ? (diy_fp){(v.f << 2) - 1, v.e - 2}
+                                    : (diy_fp){(v.f << 1) - 1, v.e - 1};
+    m.f <<= m.e - p.e;
+    m.e = p.e;
+    *minus = m;
+    *plus = p;
+}
+
+/* a cached power c = 10^-k such that the exponent of e + c is in [-60, -32] */
+static diy_fp cached_power(int e, int *k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    if (dk - ik > 0.0) {
+        ik++;
+    }
+    int index = (ik >> 3) + 1;
+    *k = -(CACHED_POWERS_MIN_EXP10 + index * CACHED_POWERS_STEP);
+    return cached_powers[index];
+}
+
+static int count_digits_u32(u32 n) {
+    int count = 1;
+    while (count < 10 && n >= pow10_u64[count]) {
+        count++;
+    }
+    return count;
+}
+
+/* move the last digit down while that gets closer to w */
+static void grisu_round(char *digits, int len, u64 delta, u64 rest,
+                        u64 ten_kappa, u64 wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        digits[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+/*
+ * units the narrowed interval can be off from the true one. a digit less
+ * missed by no more than this may still read back, see dtoa_shorten
+ */
+#define DTOA_SLACK 4
+
+static int digit_gen(diy_fp w, diy_fp mp, u64 delta, char *digits, int *k,
+                     bool *near) {
+    diy_fp one = {1ull << -mp.e, mp.e};
+    u64 wp_w = mp.f - w.f;
+    u32 p1 = mp.f >> -one.e;
+    u64 p2 = mp.f & (one.f - 1);
+    int kappa = count_digits_u32(p1);
+    int len = 0;
+    bool missed = false;
+
+    while (kappa > 0) {
+        u32 d = p1 / pow10_u64[kappa - 1];
+        p1 %= pow10_u64[kappa - 1];
+        if (d || len) {
+            digits[len++] = '0' + d;
+        }
+        kappa--;
+        u64 rest = ((u64)p1 << -one.e) + p2;
+        u64 ten_kappa = pow10_u64[kappa] << -one.e;
+        if (rest <= delta) {
+            *k += kappa;
+            grisu_round(digits, len, delta, rest, ten_kappa, wp_w);
+            *near = missed;
+            return len;
+        }
+        missed |= rest - delta <= DTOA_SLACK || ten_kappa - rest <= DTOA_SLACK;
+    }
+
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char d = p2 >> -one.e;
+        if (d || len) {
+            digits[len++] = '0' + d;
+        }
+        p2 &= one.f - 1;
+        kappa--;
+        u64 unit = -kappa < 20 ? pow10_u64[-kappa] : 0;
+        if (p2 < delta) {
+            *k += kappa;
+            grisu_round(digits, len, delta, p2, one.f, wp_w * unit);
+            *near = missed;
+            return len;
+        }
+        /* the slack grows with p2 and delta, past 10^18 units assume near */
+        u64 slack = -kappa < 19 ? DTOA_SLACK * unit : one.f;
+        missed |= p2 - delta <= slack || one.f - p2 <= slack;
+    }
+}
+
+static bool dtoa_reads_back(double v, const char *digits, int len, int exp10) {
+    char buf[DTOA_DIGITS_MAX + 24];
+    memcpy(buf, digits, len);
+    buf[len] = 'e';
+    int n = len + 1 + format_s64(buf + len + 1, exp10);
+    double d;
+    return atod(buf, buf + n, &d) == buf + n && d == v;
+}
+
+/*
+ * digit_gen found a digit less only just outside the narrowed interval. a
+ * shorter result is one of the two numbers with a digit less around the
+ * digits, so try those, the nearer first, until neither reads back as v
+ */
+static int dtoa_shorten(double v, char *digits, int len, int *exp10) {
+    while (len > 1) {
+        char down[DTOA_DIGITS_MAX];
+        char up[DTOA_DIGITS_MAX];
+        int down_len = len - 1;
+        int up_len = len - 1;
+        int down_exp = *exp10 + 1;
+        int up_exp = *exp10 + 1;
+        memcpy(down, digits, down_len);
+        memcpy(up, digits, up_len);
+
+        int i = up_len - 1;
+        while (i >= 0 && up[i] == '9') {
+            up[i--] = '0';
+        }
+        if (i >= 0) {
+            up[i]++;
+        } else {
+            /* 99..9 + 1 is 10^len */
+            up[0] = '1';
+            up_exp += up_len;
+            up_len = 1;
+        }
+        while (down_len > 1 && down[down_len - 1] == '0') {
+            down_len--;
+            down_exp++;
+        }
+        while (up_len > 1 && up[up_len - 1] == '0') {
+            up_len--;
+            up_exp++;
+        }
+
+        bool up_first = digits[len - 1] >= '5';
+        const char *first = up_first ? up : down;
+        int first_len = up_first ? up_len : down_len;
+        int first_exp = up_first ? up_exp : down_exp;
+        const char *second = up_first ? down : up;
+        int second_len = up_first ? down_len : up_len;
+        int second_exp = up_first ? down_exp : up_exp;
+
+        if (dtoa_reads_back(v, first, first_len, first_exp)) {
+            memcpy(digits, first, first_len);
+            len = first_len;
+            *exp10 = first_exp;
+        } else if (dtoa_reads_back(v, second, second_len, second_exp)) {
+            memcpy(digits, second, second_len);
+            len = second_len;
+            *exp10 = second_exp;
+        } else {
+            break;
+        }
+    }
+    return len;
+}
+
+int dtoa_shortest(double v, char digits[DTOA_DIGITS_MAX], int *exp10) {
+    if (v == 0) {
+        digits[0] = '0';
+        *exp10 = 0;
+        return 1;
+    }
+
+    diy_fp w_m, w_p;
+    diy_fp f = diy_fp_from_double(v);
+    normalized_boundaries(f, &w_m, &w_p);
+
+    int mk;
+    diy_fp c_mk = cached_power(w_p.e, &mk);
+    diy_fp w = diy_fp_mul(diy_fp_normalize(f), c_mk);
+    diy_fp wp = diy_fp_mul(w_p, c_mk);
+    diy_fp wm = diy_fp_mul(w_m, c_mk);
+    wm.f++;
+    wp.f--;
+
+    *exp10 = mk;
+    bool near = false;
+    int len = digit_gen(w, wp, wp.f - wm.f, digits, exp10, &near);
+    return near ? dtoa_shorten(v, digits, len, exp10) : len;
+}
+
+static const char digit_pairs[200] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+int format_u64(char *buf, u64 v) {
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    while (v >= 100) {
+        p -= 2;
+        memcpy(p, digit_pairs + (v % 100) * 2, 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + v * 2, 2);
+    } else {
+        *--p = '0' + v;
+    }
+
+    int len = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, len);
+    return len;
+}
+
+int format_s64(char *buf, s64 v) {
+    buf[0] = v < 0 ? '-' : '+';
+    return 1 + format_u64(buf + 1, v < 0 ? -(u64)v : (u64)v);
+}
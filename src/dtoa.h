@@ -0,0 +1,16 @@
+#pragma once
+
+#include <my-os/types.h>
+
+#define DTOA_DIGITS_MAX 18
+
+/*
+ * the shortest decimal digits that read back as v, which is finite and not
+ * negative: v = digits * 10^exp10. returns the number of digits.
+ */
+int dtoa_shortest(double v, char digits[DTOA_DIGITS_MAX], int *exp10);
+
+/* the decimal digits of v without a terminator, returns the length */
+int format_u64(char *buf, u64 v);
+/* like format_u64 with the sign always written, as "%+lld" */
+int format_s64(char *buf, s64 v);
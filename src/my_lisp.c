@@ -1,29 +1,54 @@
+/* pthread_getattr_np */
+#define _GNU_SOURCE
 #include "my_lisp.h"
 
 #include <stdarg.h>
 
 #include <my-os/list.h>
 
+#ifndef MY_OS
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+
+#include "dtoa.h"
 #include "my_lisp.lex.h"
+#include "my_lisp_fasl.h"
+#include "my_lisp_image.h"
+#include "my_lisp_io.h"
+#include "my_lisp_load.h"
+#include "my_lisp_scan.h"
 #include "number.h"
 
 static object True = {.type = T_BOOLEAN, .bool_val = true, .ref_count = 1};
 static object False = {.type = T_BOOLEAN, .bool_val = false, .ref_count = 1};
+/* marks a loop tail call in the pair cache, and is what such a call returns */
+static object TailCall = {.type = T_NULL, .ref_count = 1};
+/* ends the handlers of a generator, raise goes on past it */
+static object HandlersLink = {.type = T_NULL, .ref_count = 1};
 object *NIL = NULL;
 
 object *new_error(const char *fmt, ...);
-char *to_string(object *o, ...);
+char *to_string(object *o, env *e);
 void free_object(object *o);
+void free_case_table(object *o);
+void free_generator(object *o);
 const char *object_type_name(object_type type);
 bool object_symbol_equal(object *sym, char *s);
+object *continuation_call(env *e, object *k, object *args, parse_data *data);
+object *primitive_begin(env *e, object *args, parse_data *data);
 
 object *assert_fun_arg_type(char *func, object *o, int i, object_type type) {
+    if (o && o->type == T_ERR && o->err->escape) {
+        /* an escape to a continuation goes on rather than being checked */
+        return o;
+    }
     if (!o || !(o->type & type)) {
-        char *value = to_string(o);
         object *err = new_error("Function %s passed incorrect type for "
-                                "argument %d. Got %s, Expected %s.",
-                                func, i, value, object_type_name(type));
-        my_free(value);
+                                "argument %d. Got %O, Expected %s.",
+                                func, i, o, object_type_name(type));
+        unref(o);
         return err;
     }
     unref(o);
@@ -54,6 +79,19 @@ static inline object *new_object(object_type type) {
 
 object *new_boolean(bool val) { return val ? ref(&True) : ref(&False); }
 
+object *read_boolean(parse_data *data, bool val) {
+    if (data->bool_refs) {
+        data->bool_refs[val]++;
+        return val ? &True : &False;
+    }
+    return new_boolean(val);
+}
+
+void claim_booleans(u32 bool_refs[2]) {
+    False.ref_count += bool_refs[false];
+    True.ref_count += bool_refs[true];
+}
+
 object *new_number(number *number) {
     object *o = new_object(T_NUMBER);
     o->number = number;
@@ -68,38 +106,61 @@ object *new_character(u16 ch) {
     return o;
 }
 
-static unsigned symhash(char *sym) {
+static unsigned symhash(const char *sym, size_t len) {
     unsigned int hash = 0;
-    unsigned c;
 
-    while ((c = *sym++))
-        hash = hash * 9 ^ c;
+    while (len--)
+        hash = hash * 9 ^ (unsigned char)*sym++;
     return hash;
 }
 
-symbol *lookup(parse_data *data, char *ident) {
-    symbol **symtab = data->symtab;
-
-    symbol **sym_p;
+/*
+ * intern the len bytes at ident, which need not be terminated. chains are
+ * only ever appended to, so when threads share the table a hit takes no
+ * lock; a miss appends under symtab_lock after checking nobody beat it.
+ */
+symbol *lookup_n(parse_data *data, const char *ident, size_t len) {
+    symbol **sym_p = data->symtab + (symhash(ident, len) % NHASH);
     symbol *sym;
-    sym_p = symtab + (symhash(ident) % NHASH);
 
     for (;;) {
-        sym = *sym_p;
-        if (!sym) {
-            sym = my_malloc(sizeof(symbol));
-            sym->name = my_strdup(ident);
-            sym->hash_next = NULL;
-            *sym_p = sym;
-            break;
+        for (; (sym = __atomic_load_n(sym_p, __ATOMIC_ACQUIRE));
+             sym_p = &sym->hash_next) {
+            if (!strncmp(sym->name, ident, len) && !sym->name[len]) {
+                return sym;
+            }
         }
-        if (!strcmp(sym->name, ident))
-            break;
-        sym_p = &(sym->hash_next);
+#ifndef MY_OS
+        if (data->symtab_lock) {
+            pthread_mutex_lock(data->symtab_lock);
+            if (*sym_p) {
+                pthread_mutex_unlock(data->symtab_lock);
+                continue;
+            }
+        }
+#endif
+        break;
     }
+
+    sym = my_malloc(sizeof(symbol));
+    sym->name = my_malloc(len + 1);
+    memcpy(sym->name, ident, len);
+    sym->name[len] = '\0';
+    sym->hash_next = NULL;
+    __atomic_store_n(sym_p, sym, __ATOMIC_RELEASE);
+
+#ifndef MY_OS
+    if (data->symtab_lock) {
+        pthread_mutex_unlock(data->symtab_lock);
+    }
+#endif
     return sym;
 }
 
+symbol *lookup(parse_data *data, char *ident) {
+    return lookup_n(data, ident, strlen(ident));
+}
+
 object *new_symbol(symbol *s) {
     object *symbol = new_object(T_SYMBOL);
     symbol->symbol = s;
@@ -182,9 +243,21 @@ ret:
 }
 
 void free_pair(object *o) {
+    object *rest = o->pair->cdr;
     unref(o->pair->car);
-    unref(o->pair->cdr);
+    unref(o->pair->cache);
     my_free(o->pair);
+
+    /* the rest of a list is freed here rather than by recursing on cdr */
+    while (rest && rest->type == T_PAIR && rest->ref_count == 1) {
+        object *next = rest->pair->cdr;
+        unref(rest->pair->car);
+        unref(rest->pair->cache);
+        my_free(rest->pair);
+        my_free(rest);
+        rest = next;
+    }
+    unref(rest);
 }
 
 string *make_string(char *str, size_t size) {
@@ -192,6 +265,16 @@ string *make_string(char *str, size_t size) {
     s->str_p = my_malloc(size + 1);
     s->len = size;
     memcpy(s->str_p, str, size);
+    s->str_p[size] = '\0';
+    return s;
+}
+
+/* like make_string, but keeps str, a my_malloc buffer of at least size + 1 */
+string *make_string_take(char *str, size_t size) {
+    string *s = my_malloc(sizeof(string));
+    s->str_p = str;
+    s->str_p[size] = '\0';
+    s->len = size;
     return s;
 }
 
@@ -206,26 +289,164 @@ void free_string(object *s) {
     my_free(s->str);
 }
 
+/* limits on a %O argument of an error */
+#define ERROR_WRITE_DEPTH 4
+#define ERROR_WRITE_LENGTH 12
+
+/* the directive after a '%': flags and width are skipped, l, L and z widen */
+static const char *error_directive(const char *p, char *conv, bool *wide) {
+    *wide = false;
+    while (*p && strchr("-+ #0123456789.", *p)) {
+        p++;
+    }
+    for (; *p && strchr("hlLz", *p); p++) {
+        *wide |= *p != 'h';
+    }
+    *conv = *p;
+    return *p ? p + 1 : p;
+}
+
 object *new_error(const char *fmt, ...) {
+    union error_arg args[ERROR_ARGS_MAX];
+    u8 objects = 0, strings = 0;
+    size_t strs_len = 0;
+    int argc = 0;
+
+    va_list ap;
+    va_start(ap, fmt);
+    for (const char *p = fmt; (p = strchr(p, '%')) && argc < ERROR_ARGS_MAX;) {
+        char conv;
+        bool wide;
+        p = error_directive(p + 1, &conv, &wide);
+        switch (conv) {
+        case '%':
+            continue;
+        case 's':
+            args[argc].s = va_arg(ap, const char *);
+            if (!args[argc].s) {
+                args[argc].s = "(null)";
+            }
+            strs_len += strlen(args[argc].s) + 1;
+            strings |= 1 << argc;
+            break;
+        case 'O':
+            args[argc].o = ref(va_arg(ap, object *));
+            objects |= 1 << argc;
+            break;
+        default:
+            args[argc].i = wide ? va_arg(ap, long long) : va_arg(ap, int);
+            break;
+        }
+        argc++;
+    }
+    va_end(ap);
+
+    error *err = my_malloc(sizeof(error) + strs_len);
+    err->fmt = fmt;
+    err->objects = objects;
+    char *strs = err->strs;
+    for (int i = 0; i < argc; i++) {
+        err->args[i] = args[i];
+        if (strings & 1 << i) {
+            size_t len = strlen(args[i].s) + 1;
+            memcpy(strs, args[i].s, len);
+            err->args[i].s = strs;
+            strs += len;
+        }
+    }
+
     object *o = new_object(T_ERR);
-    error *err = my_malloc(sizeof(error));
-    va_list args;
-    va_start(args, fmt);
-#define ERR_MSG_BUF_SIZE 512
-    char buf[ERR_MSG_BUF_SIZE] = {'\0'};
-    my_vsprintf(buf, fmt, args);
-    va_end(args);
-
-    err->msg = my_strdup(buf);
     o->err = err;
     return o;
 }
 
+error *make_error_text(const char *msg, size_t len) {
+    error *err = my_malloc(sizeof(error));
+    err->msg = my_malloc(len + 1);
+    memcpy(err->msg, msg, len);
+    return err;
+}
+
+/* integers print in decimal whatever the conversion */
+void error_write(struct lisp_out *out, error *err) {
+    if (err->msg || !err->fmt) {
+        lisp_out_puts(out, err->msg ? err->msg : "");
+        return;
+    }
+
+    const char *p = err->fmt;
+    int i = 0;
+    for (const char *q; (q = strchr(p, '%'));) {
+        char conv;
+        bool wide;
+        lisp_out_write(out, p, q - p);
+        p = error_directive(q + 1, &conv, &wide);
+        if (conv == '%') {
+            lisp_out_putc(out, '%');
+            continue;
+        }
+        if (i == ERROR_ARGS_MAX) {
+            continue;
+        }
+
+        union error_arg *arg = &err->args[i++];
+        switch (conv) {
+        case 's':
+            lisp_out_puts(out, arg->s);
+            break;
+        case 'O':
+            object_write_limited(out, ref(arg->o), NULL, ERROR_WRITE_DEPTH,
+                                 ERROR_WRITE_LENGTH);
+            break;
+        case 'c':
+            lisp_out_putc(out, arg->i);
+            break;
+        default: {
+            char buf[24];
+            int len = 0;
+            if (arg->i < 0) {
+                buf[len++] = '-';
+            }
+            len += format_u64(buf + len, arg->i < 0 ? -(u64)arg->i : (u64)arg->i);
+            lisp_out_write(out, buf, len);
+            break;
+        }
+        }
+    }
+    lisp_out_puts(out, p);
+}
+
+const char *error_message(error *err) {
+    if (!err->msg) {
+        struct lisp_out out;
+        lisp_out_init_mem(&out);
+        error_write(&out, err);
+        err->msg = lisp_out_take(&out);
+    }
+    return err->msg;
+}
+
 void free_error(object *e) {
+    for (int i = 0; i < ERROR_ARGS_MAX; i++) {
+        if (e->err->objects & 1 << i) {
+            unref(e->err->args[i].o);
+        }
+    }
+    unref(e->err->payload);
+    unref(e->err->escape);
     my_free(e->err->msg);
     my_free(e->err);
 }
 
+bool pair_is_tail_call(object *pair) { return pair->pair->cache == &TailCall; }
+
+void pair_mark_tail_call(object *pair) {
+    if (pair->pair->cache != &TailCall) {
+        unref(pair->pair->cache);
+        pair->pair->cache = ref(&TailCall);
+    }
+}
+
 object *new_primitive_proc(primitive_proc_ptr *proc) {
     object *o = new_object(T_PRIMITIVE_PROC);
     primitive_proc *primitive = my_malloc(sizeof(primitive_proc));
@@ -236,1354 +457,3775 @@ object *new_primitive_proc(primitive_proc_ptr *proc) {
 
 void free_primitive_proc(object *o) { my_free(o->primitive_proc); }
 
-object *new_compound_proc(env *env, object *params, object *body) {
-    int i = 0;
-    symbol *varg = NULL;
-
-    object *param_list = NIL;
-    if (params && params->type != T_PAIR) {
-        varg = params->symbol;
-    } else {
-        object *ptr = NIL;
-        object *arg = NIL;
-        for_each_object_list_entry(arg, params) {
-            ERROR(ASSERT(arg && arg->type == T_SYMBOL,
-                         "compound proc: must be pass symbol as params")) {
-                unref(param_list);
-                unref(ptr);
-                unref(body);
-                free_env(env);
-                unref(params);
-                unref(idx);
-                unref(arg);
-                return error;
-            }
-
-            if (!param_list) {
-                param_list = cons(ref(arg), NIL);
-                ptr = ref(param_list);
-            } else {
-                setcdr(ref(ptr), cons(ref(arg), NIL));
-                ptr = cdr(ptr);
-            }
-            i++;
-
-            object *next = cdr(ref(idx));
-            if (next && next->type != T_PAIR) {
-                varg = next->symbol;
-                unref(next);
-                unref(idx);
-                unref(arg);
-                break;
-            }
-            unref(next);
+bool symbol_set_has(symbol_set *set, symbol *sym) {
+    for (int i = 0; i < set->count; i++) {
+        if (set->symbols[i] == sym) {
+            return true;
         }
-        unref(ptr);
     }
-    unref(params);
-
-    object *o = new_object(T_COMPOUND_PROC);
-    compound_proc *proc = my_malloc(sizeof(compound_proc));
-    proc->param_count = i;
-    proc->varg = varg;
-    proc->parameters = param_list;
-    proc->body = body;
-    proc->env = env;
-    o->compound_proc = proc;
-    return o;
+    return false;
 }
 
-void free_compound_proc(object *o) {
-    compound_proc *proc = o->compound_proc;
-    unref(proc->parameters);
-    unref(proc->body);
-    free_env(proc->env);
-    my_free(proc);
+void symbol_set_push(symbol_set *set, symbol *sym) {
+#define SYMBOL_SET_INC 8
+    if (set->count == set->capacity) {
+        set->capacity += SYMBOL_SET_INC;
+        set->symbols =
+            my_realloc(set->symbols, sizeof(symbol *) * set->capacity);
+    }
+    set->symbols[set->count++] = sym;
 }
 
-object *new_macro_proc(object *literals, object *syntax_rules) {
-    object *o = new_object(T_MACRO_PROC);
-    macro_proc *proc = my_malloc(sizeof(macro_proc));
-    proc->literals = literals;
-    proc->syntax_rules = syntax_rules;
-    o->macro_proc = proc;
-    return o;
+void symbol_set_add(symbol_set *set, symbol *sym) {
+    if (!symbol_set_has(set, sym)) {
+        symbol_set_push(set, sym);
+    }
 }
 
-void free_macro_proc(object *o) {
-    macro_proc *proc = o->macro_proc;
-    unref(proc->literals);
-    unref(proc->syntax_rules);
-    my_free(proc);
+void free_symbol_set(symbol_set *set) {
+    my_free(set->symbols);
+    set->symbols = NULL;
+    set->count = set->capacity = 0;
 }
 
-env *new_env(void) { return my_malloc(sizeof(env)); }
+object *env_get(env *e, symbol *sym);
+object **env_frame_slot(env *e, symbol *sym);
+
+/*
+ * free variable analysis of a lambda body. bound holds the variables in
+ * scope, innermost last.
+ */
+typedef struct scope_walk_t {
+    lambda_template *template;
+    symbol_set bound;
+    env *env;
+    symbol *quote;
+    symbol *lambda;
+    symbol *define;
+    symbol *set;
+    symbol *let;
+    symbol *letrec;
+    symbol *letrec_star;
+    symbol *do_;
+    symbol *if_;
+    symbol *begin;
+    symbol *cond;
+    symbol *case_;
+    symbol *guard;
+    symbol *else_;
+    symbol *arrow;
+    symbol *define_syntax;
+    symbol *syntax_rules;
+} scope_walk;
+
+void walk_expr(scope_walk *w, object *expr);
+void walk_body(scope_walk *w, object *body, symbol_set *defines);
+bool loop_mark(scope_walk *w, symbol *name, object *bindings, object *body);
+
+void scope_walk_init(scope_walk *w, lambda_template *template, env *e,
+                     parse_data *data) {
+    *w = (scope_walk){
+        .template = template,
+        .env = e,
+        .quote = lookup(data, "quote"),
+        .lambda = lookup(data, "lambda"),
+        .define = lookup(data, "define"),
+        .set = lookup(data, "set!"),
+        .let = lookup(data, "let"),
+        .letrec = lookup(data, "letrec"),
+        .letrec_star = lookup(data, "letrec*"),
+        .do_ = lookup(data, "do"),
+        .if_ = lookup(data, "if"),
+        .begin = lookup(data, "begin"),
+        .cond = lookup(data, "cond"),
+        .case_ = lookup(data, "case"),
+        .guard = lookup(data, "guard"),
+        .else_ = lookup(data, "else"),
+        .arrow = lookup(data, "=>"),
+        .define_syntax = lookup(data, "define-syntax"),
+        .syntax_rules = lookup(data, "syntax-rules"),
+    };
+}
 
-void free_env(env *e) {
-    for (int i = 0; i < e->count; i++) {
-        unref(e->objects[i]);
+/* the name bound by an internal define form, or NULL */
+symbol *define_target(scope_walk *w, object *form) {
+    if (!form || form->type != T_PAIR || !form->pair->car ||
+        form->pair->car->type != T_SYMBOL ||
+        form->pair->car->symbol != w->define || !form->pair->cdr ||
+        form->pair->cdr->type != T_PAIR) {
+        return NULL;
     }
-    my_free(e->symbols);
-    my_free(e->objects);
-    my_free(e);
+    object *target = form->pair->cdr->pair->car;
+    if (target && target->type == T_PAIR) {
+        target = target->pair->car;
+    }
+    return target && target->type == T_SYMBOL ? target->symbol : NULL;
 }
 
-object *env_get(env *e, symbol *sym) {
-    for (int i = 0; i < e->count; i++) {
-        if (e->symbols[i] == sym) {
-            return ref(e->objects[i]);
-        }
+void walk_reference(scope_walk *w, symbol *sym) {
+    if (!symbol_set_has(&w->bound, sym)) {
+        symbol_set_add(&w->template->free_vars, sym);
     }
+}
 
-    if (e->parent) {
-        return env_get(e->parent, sym);
-    } else {
-        return new_error("Exception: variable %s is not bound", sym->name);
+void walk_list(scope_walk *w, object *list) {
+    for (; list && list->type == T_PAIR; list = list->pair->cdr) {
+        walk_expr(w, list->pair->car);
     }
+    walk_expr(w, list);
 }
 
-symbol *env_get_sym(env *e, object *o) {
-    for (int i = 0; i < e->count; i++) {
-        if (e->objects[i] == o) {
-            unref(o);
-            return e->symbols[i];
+void walk_params(scope_walk *w, object *params) {
+    for (; params && params->type == T_PAIR; params = params->pair->cdr) {
+        if (params->pair->car && params->pair->car->type == T_SYMBOL) {
+            symbol_set_push(&w->bound, params->pair->car->symbol);
         }
     }
-
-    if (e->parent) {
-        return env_get_sym(e->parent, o);
-    } else {
-        unref(o);
-        return NULL;
+    if (params && params->type == T_SYMBOL) {
+        symbol_set_push(&w->bound, params->symbol);
     }
 }
 
-void env_put(env *e, symbol *sym, object *obj) {
-    for (int i = 0; i < e->count; i++) {
-        if (e->symbols[i] == sym) {
-            unref(e->objects[i]);
-            e->objects[i] = obj;
-            return;
+void walk_bindings(scope_walk *w, object *bindings) {
+    for (; bindings && bindings->type == T_PAIR;
+         bindings = bindings->pair->cdr) {
+        object *b = bindings->pair->car;
+        if (b && b->type == T_PAIR && b->pair->car &&
+            b->pair->car->type == T_SYMBOL) {
+            symbol_set_push(&w->bound, b->pair->car->symbol);
         }
     }
+}
 
-#define ENV_INC 10
-    if ((e->count % ENV_INC) == 0) {
-        e->symbols =
-            my_realloc(e->symbols, sizeof(symbol *) * (ENV_INC + e->count));
-        e->objects =
-            my_realloc(e->objects, sizeof(object *) * (ENV_INC + e->count));
+void walk_inits(scope_walk *w, object *bindings) {
+    for (; bindings && bindings->type == T_PAIR;
+         bindings = bindings->pair->cdr) {
+        object *b = bindings->pair->car;
+        if (b && b->type == T_PAIR) {
+            walk_list(w, b->pair->cdr);
+        }
     }
+}
 
-    e->symbols[e->count] = sym;
-    e->objects[e->count] = obj;
-    e->count++;
+void walk_lambda(scope_walk *w, object *params, object *body) {
+    int depth = w->bound.count;
+    walk_params(w, params);
+    walk_body(w, body, NULL);
+    w->bound.count = depth;
 }
 
-object *env_set(env *e, symbol *sym, object *obj) {
-    for (int i = 0; i < e->count; i++) {
-        if (e->symbols[i] == sym) {
-            unref(e->objects[i]);
-            e->objects[i] = obj;
-            return NIL;
+void walk_let(scope_walk *w, object *args) {
+    object *bindings = args->pair->car;
+    object *body = args->pair->cdr;
+    symbol *name = NULL;
+
+    if (bindings && bindings->type == T_SYMBOL) {
+        if (!body || body->type != T_PAIR) {
+            return;
+        }
+        name = bindings->symbol;
+        bindings = body->pair->car;
+        body = body->pair->cdr;
+        /* a loop procedure that escapes is a closure over this frame */
+        if (loop_mark(w, name, bindings, body)) {
+            w->template->makes_closure = true;
         }
     }
-    if (e->parent) {
-        return env_set(e->parent, sym, obj);
-    } else {
-        unref(obj);
-        return new_error("Exception: variable %s is not bound", sym->name);
+
+    int depth = w->bound.count;
+    walk_inits(w, bindings);
+    if (name) {
+        symbol_set_push(&w->bound, name);
     }
+    walk_bindings(w, bindings);
+    walk_body(w, body, NULL);
+    w->bound.count = depth;
 }
 
-void free_object(object *o) {
-    if (!o) {
-        return;
-    }
+void walk_letrec(scope_walk *w, object *args) {
+    int depth = w->bound.count;
+    walk_bindings(w, args->pair->car);
+    walk_inits(w, args->pair->car);
+    walk_body(w, args->pair->cdr, NULL);
+    w->bound.count = depth;
+}
 
-    switch (o->type) {
-    case T_ERR:
-        free_error(o);
-        break;
-    case T_NUMBER:
-        free_number(o);
-        break;
-    case T_STRING:
-        free_string(o);
-        break;
-    case T_PAIR:
-        free_pair(o);
-        break;
-    case T_PRIMITIVE_PROC:
-        free_primitive_proc(o);
-        break;
-    case T_COMPOUND_PROC:
-        free_compound_proc(o);
-        break;
-    case T_MACRO_PROC:
-        free_macro_proc(o);
-        break;
-    case T_SYMBOL:
-        break;
-    default:
-        break;
+/* (do ((var init step)...) (test expr...) command...) */
+void walk_do(scope_walk *w, object *args) {
+    int depth = w->bound.count;
+    walk_inits(w, args->pair->car);
+    walk_bindings(w, args->pair->car);
+    for (object *spec = args->pair->car; spec && spec->type == T_PAIR;
+         spec = spec->pair->cdr) {
+        object *b = spec->pair->car;
+        if (b && b->type == T_PAIR && b->pair->cdr &&
+            b->pair->cdr->type == T_PAIR) {
+            walk_list(w, b->pair->cdr->pair->cdr);
+        }
     }
-
-    my_free(o);
+    object *rest = args->pair->cdr;
+    if (rest && rest->type == T_PAIR) {
+        walk_list(w, rest->pair->car);
+        walk_list(w, rest->pair->cdr);
+    }
+    w->bound.count = depth;
 }
 
-char *list_to_string(object *list) {
-    size_t len = 3; /* default "()" total 3 with memory */
-    char *list_str = my_malloc(len);
-
-    strcat(list_str, "(");
-    object *o = NIL;
-    for_each_object_list_entry(o, list) {
-        char *s = to_string(ref(o));
-        int inc_len = 0;
-        object *next = idx->type == T_PAIR ? cdr(ref(idx)) : NULL;
-        char *cat_s = "";
-        if (next) {
-            if (next->type == T_PAIR) {
-                inc_len = 1;
-                cat_s = " ";
-            } else {
-                inc_len = 3;
-                cat_s = " . ";
+void walk_cond(scope_walk *w, object *clauses) {
+    for (; clauses && clauses->type == T_PAIR; clauses = clauses->pair->cdr) {
+        object *clause = clauses->pair->car;
+        for (; clause && clause->type == T_PAIR; clause = clause->pair->cdr) {
+            object *o = clause->pair->car;
+            if (o && o->type == T_SYMBOL &&
+                (o->symbol == w->else_ || o->symbol == w->arrow)) {
+                continue;
             }
-            unref(next);
+            walk_expr(w, o);
         }
-
-        len += strlen(s) + inc_len;
-        list_str = my_realloc(list_str, len);
-        strcat(list_str, s);
-        strcat(list_str, cat_s);
-        my_free(s);
     }
-    strcat(list_str, ")");
-    unref(list);
-    return list_str;
 }
 
-char *number_to_string(object *o) {
-#define NUMBER_BUF_SIZE 1024
-    char buf[NUMBER_BUF_SIZE] = {'\0'};
-    char *buf_p = buf;
-    format_number(buf_p, o->number);
-    unref(o);
-    return my_strdup(buf);
+/* the datums of the clauses are quoted */
+void walk_case(scope_walk *w, object *args) {
+    walk_expr(w, args->pair->car);
+    for (object *clauses = args->pair->cdr; clauses && clauses->type == T_PAIR;
+         clauses = clauses->pair->cdr) {
+        object *clause = clauses->pair->car;
+        if (!clause || clause->type != T_PAIR) {
+            continue;
+        }
+        object *body = clause->pair->cdr;
+        if (body && body->type == T_PAIR && body->pair->car &&
+            body->pair->car->type == T_SYMBOL &&
+            body->pair->car->symbol == w->arrow) {
+            body = body->pair->cdr;
+        }
+        walk_list(w, body);
+    }
 }
 
-char *to_string(object *o, ...) {
-    va_list args;
-    va_start(args, o);
-    env *e = va_arg(args, env *);
-    va_end(args);
+/* (guard (var clause...) body...), var is bound in the clauses only */
+void walk_guard(scope_walk *w, object *args) {
+    object *spec = args->pair->car;
+    walk_list(w, args->pair->cdr);
+    if (!spec || spec->type != T_PAIR) {
+        return;
+    }
 
-    if (!o) {
-        unref(o);
-        return my_strdup("()");
+    int depth = w->bound.count;
+    if (spec->pair->car && spec->pair->car->type == T_SYMBOL) {
+        symbol_set_push(&w->bound, spec->pair->car->symbol);
     }
+    walk_cond(w, spec->pair->cdr);
+    w->bound.count = depth;
+}
 
-    size_t len = 1;
-    char *fmt = "%s";
-    char *o_str = NULL;
+void walk_form(scope_walk *w, object *expr) {
+    object *head = expr->pair->car;
+    object *args = expr->pair->cdr;
 
-    switch (o->type) {
-    case T_PAIR:
-        o_str = list_to_string(ref(o));
-        len += strlen(o_str);
-        break;
-    case T_SYMBOL: {
-        o_str = o->symbol->name;
-        len += strlen(o_str);
-        break;
-    }
-    case T_STRING: {
-        fmt = "\"%s\"";
-        len += o->str->len + 2;
-        o_str = o->str->str_p;
-        break;
+    if (!head || head->type != T_SYMBOL ||
+        symbol_set_has(&w->bound, head->symbol)) {
+        walk_list(w, expr);
+        return;
     }
-    case T_NUMBER: {
-        o_str = number_to_string(ref(o));
-        len += strlen(o_str);
-        break;
+
+    symbol *sym = head->symbol;
+    if (sym == w->define_syntax) {
+        /* a macro bound by the body, its uses may expand to anything */
+        w->template->macro_use = true;
+        return;
     }
-    case T_BOOLEAN:
-        len += 2;
-        o_str = o->bool_val ? "#t" : "#f";
-        break;
-    case T_CHARACTER:
-        break;
-    case T_ERR:
-        len += strlen(o->err->msg);
-        o_str = o->err->msg;
-        break;
-    case T_PRIMITIVE_PROC:
-    case T_COMPOUND_PROC: {
-        symbol *symbol = env_get_sym(e, ref(o));
-        if (symbol) {
-            fmt = "#<procedure %s>";
-            o_str = symbol->name;
-            len += strlen(o_str) + strlen(fmt) - 2;
-        } else {
-            fmt = "#<procedure>";
-            o_str = "";
-            len += strlen(fmt);
-        }
-        break;
+    if (sym == w->quote || sym == w->syntax_rules) {
+        return;
     }
-    default:
-        break;
+
+    if (!args || args->type != T_PAIR) {
+        walk_list(w, expr);
+        return;
     }
 
-    char *str = my_malloc(len);
-    if (o_str) {
-        my_sprintf(str, fmt, o_str);
-        if (o->type == T_PAIR || o->type == T_NUMBER) {
-            my_free(o_str);
+    object *first = args->pair->car;
+    if (sym == w->lambda) {
+        w->template->makes_closure = true;
+        walk_lambda(w, first, args->pair->cdr);
+    } else if (sym == w->define) {
+        /* the defined name is bound by the enclosing body */
+        if (first && first->type == T_PAIR) {
+            w->template->makes_closure = true;
+            walk_lambda(w, first->pair->cdr, args->pair->cdr);
+        } else {
+            walk_list(w, args->pair->cdr);
+        }
+    } else if (sym == w->set) {
+        if (first && first->type == T_SYMBOL) {
+            symbol_set_add(&w->template->assigned, first->symbol);
         }
+        walk_list(w, args);
+    } else if (sym == w->let) {
+        walk_let(w, args);
+    } else if (sym == w->letrec || sym == w->letrec_star) {
+        walk_letrec(w, args);
+    } else if (sym == w->do_) {
+        walk_do(w, args);
+    } else if (sym == w->cond) {
+        walk_cond(w, args);
+    } else if (sym == w->case_) {
+        walk_case(w, args);
+    } else if (sym == w->guard) {
+        walk_guard(w, args);
+    } else {
+        if (!w->template->macro_use) {
+            object **value = env_lookup(w->env, sym);
+            if (value && *value && (*value)->type == T_MACRO_PROC) {
+                w->template->macro_use = true;
+            }
+        }
+        walk_list(w, expr);
     }
-
-    unref(o);
-    return str;
 }
 
-void object_print(object *o, env *e) {
-    char *s = to_string(o, e);
-    my_printf("%s", s);
-    my_free(s);
+void walk_expr(scope_walk *w, object *expr) {
+    if (!expr) {
+        return;
+    }
+    if (expr->type == T_SYMBOL) {
+        walk_reference(w, expr->symbol);
+    } else if (expr->type == T_PAIR) {
+        walk_form(w, expr);
+    }
 }
 
-size_t object_list_len(object *list) {
-    if (!list)
-        return 0;
-
-    size_t i = 0;
-    object *o = NIL;
-    for_each_object_list_entry(o, list) { i++; }
-    unref(list);
-    return i;
+/* the internal defines of a body form, inside its begin and if forms too */
+void walk_defines(scope_walk *w, object *form, symbol_set *defines) {
+    symbol *target = define_target(w, form);
+    if (target) {
+        symbol_set_push(&w->bound, target);
+        if (defines) {
+            symbol_set_add(defines, target);
+        }
+        return;
+    }
+    if (!form || form->type != T_PAIR || !form->pair->car ||
+        form->pair->car->type != T_SYMBOL ||
+        symbol_set_has(&w->bound, form->pair->car->symbol) ||
+        (form->pair->car->symbol != w->begin &&
+         form->pair->car->symbol != w->if_)) {
+        return;
+    }
+    for (object *rest = form->pair->cdr; rest && rest->type == T_PAIR;
+         rest = rest->pair->cdr) {
+        walk_defines(w, rest->pair->car, defines);
+    }
 }
 
-object *compound_proc_call(env *e, object *func, object *args,
-                           parse_data *data) {
-    object *ret_val = NIL;
+/*
+ * internal defines are bound for the whole body, forward references
+ * included, so they are collected before walking it
+ */
+void walk_body(scope_walk *w, object *body, symbol_set *defines) {
+    int depth = w->bound.count;
 
-    env *func_env = func->compound_proc->env;
-    int total = func->compound_proc->param_count;
-    symbol *varg_sym = func->compound_proc->varg;
-    int given_num = 0;
+    for (object *form = body; form && form->type == T_PAIR;
+         form = form->pair->cdr) {
+        walk_defines(w, form->pair->car, defines);
+    }
 
-    object *params = ref(func->compound_proc->parameters);
-    object *param = NIL;
+    walk_list(w, body);
+    w->bound.count = depth;
+}
 
-    object *varg_val = NIL;
-    object *ptr = NIL;
+/*
+ * tail calls of a named let: calls of its name in tail position of its body
+ * with one argument per binding are marked so that evaluating them rebinds
+ * the loop variables instead of calling a procedure
+ */
+typedef struct loop_walk_t {
+    scope_walk *w;
+    symbol *name;
+    int count;
+    /* the name is used some other way */
+    bool escapes;
+} loop_walk;
+
+void loop_tail(loop_walk *l, object *expr);
+
+void loop_mention(loop_walk *l, object *expr) {
+    for (; expr && expr->type == T_PAIR && !l->escapes;
+         expr = expr->pair->cdr) {
+        loop_mention(l, expr->pair->car);
+    }
+    if (expr && expr->type == T_SYMBOL && expr->symbol == l->name) {
+        l->escapes = true;
+    }
+}
 
-    object *given = NIL;
-    for_each_object_list_entry(given, args) {
-        unref(param);
-        param = params ? car(ref(params)) : NIL;
+void loop_mention_inits(loop_walk *l, object *bindings) {
+    for (; bindings && bindings->type == T_PAIR;
+         bindings = bindings->pair->cdr) {
+        object *b = bindings->pair->car;
+        if (b && b->type == T_PAIR) {
+            loop_mention(l, b->pair->cdr);
+        }
+    }
+}
 
-        ERROR(ASSERT(param || varg_sym,
-                     "Function passed too many arguments. "
-                     "Expected %d.",
-                     total)) {
-            unref(idx);
-            unref(given);
-            unref(param);
-            unref(params);
-            ret_val = error;
-            goto ret;
+bool bindings_have(object *bindings, symbol *sym) {
+    for (; bindings && bindings->type == T_PAIR;
+         bindings = bindings->pair->cdr) {
+        object *b = bindings->pair->car;
+        if (b && b->type == T_PAIR && b->pair->car &&
+            b->pair->car->type == T_SYMBOL && b->pair->car->symbol == sym) {
+            return true;
         }
+    }
+    return false;
+}
 
-        // varg handle
-        if (!param) {
-            if (!varg_val) {
-                varg_val = cons(ref(given), NIL);
-                ptr = ref(varg_val);
-            } else {
-                setcdr(ref(ptr), cons(ref(given), NIL));
-                ptr = cdr(ptr);
-            }
-            continue;
+void loop_tail_seq(loop_walk *l, object *seq) {
+    for (; seq && seq->type == T_PAIR; seq = seq->pair->cdr) {
+        if (seq->pair->cdr) {
+            loop_mention(l, seq->pair->car);
+        } else {
+            loop_tail(l, seq->pair->car);
         }
+    }
+}
 
-        object *eval_val = eval_from_ast(ref(given), e, data);
-        ERROR(ref(eval_val)) {
-            unref(idx);
-            unref(given);
-            unref(param);
-            unref(params);
-            unref(eval_val);
-            ret_val = error;
-            goto ret;
+void loop_tail_body(loop_walk *l, object *body) {
+    for (object *form = body; form && form->type == T_PAIR;
+         form = form->pair->cdr) {
+        if (define_target(l->w, form->pair->car) == l->name) {
+            /* shadowed for the whole body */
+            return;
         }
-        env_put(func_env, param->symbol, eval_val);
+    }
+    loop_tail_seq(l, body);
+}
 
-        given_num++;
-        params = cdr(params);
+void loop_tail_call(loop_walk *l, object *expr) {
+    int count = 0;
+    object *arg = expr->pair->cdr;
+    for (; arg && arg->type == T_PAIR; arg = arg->pair->cdr) {
+        loop_mention(l, arg->pair->car);
+        count++;
     }
+    if (arg || count != l->count) {
+        l->escapes = true;
+        return;
+    }
+    pair_mark_tail_call(expr);
+}
 
-    unref(param);
-    unref(params);
-    unref(ptr);
+void loop_tail(loop_walk *l, object *expr) {
+    if (!expr || expr->type != T_PAIR || !expr->pair->car ||
+        expr->pair->car->type != T_SYMBOL) {
+        loop_mention(l, expr);
+        return;
+    }
 
-    if (varg_sym) {
-        env_put(func_env, varg_sym, varg_val);
+    scope_walk *w = l->w;
+    symbol *sym = expr->pair->car->symbol;
+    object *args = expr->pair->cdr;
+    if (sym == l->name) {
+        loop_tail_call(l, expr);
+        return;
+    }
+    if (!args || args->type != T_PAIR) {
+        loop_mention(l, args);
+        return;
     }
 
-    ERROR(
-        ASSERT(total == given_num,
-               "Exception: incorrect number of arguments, given: %d, total: %d",
-               given_num, total)) {
-        ret_val = error;
-        goto ret;
+    object *first = args->pair->car;
+    object *rest = args->pair->cdr;
+    if (sym == w->if_) {
+        loop_mention(l, first);
+        for (; rest && rest->type == T_PAIR; rest = rest->pair->cdr) {
+            loop_tail(l, rest->pair->car);
+        }
+    } else if (sym == w->begin) {
+        loop_tail_body(l, args);
+    } else if (sym == w->let) {
+        if (first && first->type == T_SYMBOL) {
+            if (!rest || rest->type != T_PAIR) {
+                loop_mention(l, rest);
+                return;
+            }
+            loop_mention_inits(l, rest->pair->car);
+            if (first->symbol == l->name ||
+                bindings_have(rest->pair->car, l->name)) {
+                return;
+            }
+            loop_tail_body(l, rest->pair->cdr);
+        } else {
+            loop_mention_inits(l, first);
+            if (!bindings_have(first, l->name)) {
+                loop_tail_body(l, rest);
+            }
+        }
+    } else if (sym == w->letrec || sym == w->letrec_star) {
+        if (!bindings_have(first, l->name)) {
+            loop_mention_inits(l, first);
+            loop_tail_body(l, rest);
+        }
+    } else if (sym == w->do_) {
+        loop_mention_inits(l, first);
+        if (bindings_have(first, l->name) || !rest || rest->type != T_PAIR) {
+            return;
+        }
+        object *clause = rest->pair->car;
+        loop_mention(l, rest->pair->cdr);
+        if (clause && clause->type == T_PAIR) {
+            loop_mention(l, clause->pair->car);
+            loop_tail_seq(l, clause->pair->cdr);
+        }
+    } else if (sym == w->case_) {
+        loop_mention(l, first);
+        for (; rest && rest->type == T_PAIR; rest = rest->pair->cdr) {
+            object *clause = rest->pair->car;
+            if (!clause || clause->type != T_PAIR) {
+                continue;
+            }
+            object *seq = clause->pair->cdr;
+            if (seq && seq->type == T_PAIR && seq->pair->car &&
+                seq->pair->car->type == T_SYMBOL &&
+                seq->pair->car->symbol == w->arrow) {
+                loop_mention(l, seq->pair->cdr);
+            } else {
+                loop_tail_seq(l, seq);
+            }
+        }
+    } else if (sym == w->cond) {
+        for (; args && args->type == T_PAIR; args = args->pair->cdr) {
+            object *clause = args->pair->car;
+            if (!clause || clause->type != T_PAIR) {
+                loop_mention(l, clause);
+                continue;
+            }
+            object *test = clause->pair->car;
+            object *seq = clause->pair->cdr;
+            if (!(test && test->type == T_SYMBOL && test->symbol == w->else_)) {
+                loop_mention(l, test);
+            }
+            if (seq && seq->type == T_PAIR && seq->pair->car &&
+                seq->pair->car->type == T_SYMBOL &&
+                seq->pair->car->symbol == w->arrow) {
+                loop_mention(l, seq->pair->cdr);
+            } else {
+                loop_tail_seq(l, seq);
+            }
+        }
+    } else {
+        loop_mention(l, expr);
     }
+}
 
-    ret_val = eval_from_ast(ref(func->compound_proc->body), func_env, data);
+/* expr has a (set! name ...) in it */
+bool loop_assigned(loop_walk *l, object *expr) {
+    if (!expr || expr->type != T_PAIR) {
+        return false;
+    }
+    object *head = expr->pair->car;
+    object *args = expr->pair->cdr;
+    if (head && head->type == T_SYMBOL && head->symbol == l->w->set && args &&
+        args->type == T_PAIR && args->pair->car &&
+        args->pair->car->type == T_SYMBOL &&
+        args->pair->car->symbol == l->name) {
+        return true;
+    }
+    for (; expr && expr->type == T_PAIR; expr = expr->pair->cdr) {
+        if (loop_assigned(l, expr->pair->car)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-ret:
-    unref(func);
-    unref(args);
-    return ret_val;
+/*
+ * mark the tail calls of the named let (let name bindings body...), returns
+ * whether the name needs to be bound to a procedure as well. a name the
+ * body assigns may call something else, so none of its calls are marked
+ */
+bool loop_mark(scope_walk *w, symbol *name, object *bindings, object *body) {
+    loop_walk l = {.w = w, .name = name};
+    if (loop_assigned(&l, body)) {
+        return true;
+    }
+    for (; bindings && bindings->type == T_PAIR;
+         bindings = bindings->pair->cdr) {
+        l.count++;
+    }
+    loop_tail_body(&l, body);
+    return l.escapes;
 }
 
-typedef struct pattern_bind_t {
-    symbol *sym;
-    object *value;
-    struct list_head head;
-} pattern_bind;
+void template_analyze(lambda_template *template, object *params,
+                      object *body, env *e, parse_data *data) {
+    scope_walk w;
+    scope_walk_init(&w, template, e, data);
 
-void free_pattern_bind(pattern_bind *pattern_binds) {
-    while (!list_empty(&pattern_binds->head)) {
-        pattern_bind *entry = list_next_entry(pattern_binds, head);
-        list_del(&entry->head);
-        unref(entry->value);
-        my_free(entry);
-    }
-    my_free(pattern_binds);
+    walk_params(&w, params);
+    walk_body(&w, body, &template->defines);
+    free_symbol_set(&w.bound);
 }
 
-pattern_bind *pattern_bind_get(pattern_bind *binds, symbol *sym) {
-    pattern_bind *entry;
-    list_for_each_entry(entry, &binds->head, head) {
-        if (entry->sym == sym) {
-            return entry;
+object *new_template(object *params, object *body, env *e, parse_data *data) {
+    int count = 0;
+    symbol *varg = NULL;
+
+    object *ptr = params;
+    for (; ptr && ptr->type == T_PAIR; ptr = ptr->pair->cdr) {
+        object *arg = ptr->pair->car;
+        ERROR(ASSERT(arg && arg->type == T_SYMBOL,
+                     "compound proc: must be pass symbol as params")) {
+            unref(params);
+            unref(body);
+            return error;
         }
+        count++;
+    }
+    if (ptr) {
+        ERROR(ASSERT(ptr->type == T_SYMBOL,
+                     "compound proc: must be pass symbol as params")) {
+            unref(params);
+            unref(body);
+            return error;
+        }
+        varg = ptr->symbol;
     }
-    return NULL;
-}
 
-typedef enum pattern_match_code {
-    MATCH,
-    NOT_MATCH,
-    SYNTAX_ERR
-} pattern_match_code;
+    lambda_template *template = my_malloc(sizeof(lambda_template));
+    template->params = count ? my_malloc(sizeof(symbol *) * count) : NULL;
+    template->param_count = count;
+    template->varg = varg;
 
-object *object_list_append(object *list, object *o) {
-    /* assert(!list || list->type == T_PAIR); */
+    int i = 0;
+    for (ptr = params; ptr && ptr->type == T_PAIR; ptr = ptr->pair->cdr) {
+        template->params[i++] = ptr->pair->car->symbol;
+    }
 
-    object *ret_val = NIL;
-    object *last_idx = NIL;
-    for_each_object_list(list) {
-        unref(last_idx);
-        last_idx = ref(idx);
+    template->macro_epoch = data->macro_epoch;
+    template_analyze(template, params, body, e, data);
+    template->body = cons(new_symbol(lookup(data, "begin")), body);
+    unref(params);
+
+    object *o = new_object(T_TEMPLATE);
+    o->template = template;
+    return o;
+}
+
+void free_template(object *o) {
+    lambda_template *template = o->template;
+    my_free(template->params);
+    unref(template->body);
+    free_symbol_set(&template->free_vars);
+    free_symbol_set(&template->assigned);
+    free_symbol_set(&template->defines);
+    my_free(template);
+}
+
+/*
+ * the template is built once per defining form and kept in the cache slot of
+ * its pair, so evaluating the same lambda again only allocates the closure
+ */
+object *form_template(object *form, object *params, object *body, env *e,
+                      parse_data *data) {
+    object *cache = form->pair->cache;
+    if (cache && cache->type == T_TEMPLATE) {
+        unref(params);
+        unref(body);
+        return ref(cache);
     }
 
-    if (last_idx == NIL) {
-        ret_val = cons(o, NIL);
-    } else {
-        /* assert(cdr(ref(last_idx)) == NIL); */
-        setcdr(last_idx, cons(o, NIL));
-        ret_val = ref(list);
+    object *template = new_template(params, body, e, data);
+    ERROR_REF(template) {
+        unref(template);
+        return error;
     }
-    unref(list);
-    return ret_val;
+
+    unref(form->pair->cache);
+    form->pair->cache = ref(template);
+    return template;
 }
 
-void collect_pattern(object *pattern, pattern_bind *pattern_values) {
-    if (!pattern) {
+/*
+ * a macro bound after the template was analyzed may be called by its body
+ * under a name that was a free variable then. its uses are looked for again
+ * in e, the env the body runs in, once per macro bound
+ */
+void template_refresh(lambda_template *template, env *e, parse_data *data) {
+    if (template->macro_epoch == data->macro_epoch) {
         return;
     }
-
-    if (pattern->type == T_SYMBOL) {
-        pattern_bind *entry = pattern_bind_get(pattern_values, pattern->symbol);
-        if (!entry) {
-            entry = my_malloc(sizeof(pattern_bind));
-            entry->sym = pattern->symbol;
-            entry->value = NIL;
-            list_add(&entry->head, &pattern_values->head);
+    template->macro_epoch = data->macro_epoch;
+    for (int i = 0; i < template->free_vars.count && !template->macro_use;
+         i++) {
+        object **value = env_lookup(e, template->free_vars.symbols[i]);
+        if (value && *value && (*value)->type == T_MACRO_PROC) {
+            template->macro_use = true;
         }
-    } else if (pattern->type == T_PAIR) {
-        collect_pattern(car(ref(pattern)), pattern_values);
-        collect_pattern(cdr(ref(pattern)), pattern_values);
     }
-    unref(pattern);
-    // TODO: vector
 }
 
-pattern_match_code match_ident_pattern(pattern_bind *pattern_binds,
-                                       object *literals, object *pattern,
-                                       object *expr, parse_data *data) {
-    pattern_match_code ret_val = MATCH;
-    symbol *underscore = lookup(data, "_");
+/*
+ * closure conversion: the values of the free variables bound in local frames
+ * are copied into one flat frame whose parent is the global env, so the
+ * closure does not keep the frames of its definition alive. variables that
+ * may still change after the closure is created (assigned by set!, or bound
+ * later by an internal define) keep the closure linked to the full chain.
+ */
+env *closure_env(env *e, lambda_template *template, parse_data *data) {
+    template_refresh(template, e, data);
+    if (!e->parent || template->macro_use) {
+        return env_ref(e);
+    }
 
-    // TODO: to object list contain function
+    env *global = e;
+    while (global->parent) {
+        global = global->parent;
+    }
 
-    object *literal = NIL;
-    for_each_object_list_entry(literal, literals) {
-        if (literal && literal->symbol == pattern->symbol) {
-            if (!(expr && expr->type == T_SYMBOL &&
-                  literal->symbol == expr->symbol)) {
-                ret_val = NOT_MATCH;
+    env *capture = NULL;
+    for (int i = 0; i < template->free_vars.count; i++) {
+        symbol *sym = template->free_vars.symbols[i];
+        object **value = NULL;
+        for (env *frame = e; frame->parent; frame = frame->parent) {
+            lambda_template *scope =
+                frame->template ? frame->template->template : NULL;
+            if (scope) {
+                template_refresh(scope, frame, data);
+            }
+            value = env_frame_slot(frame, sym);
+            if (value) {
+                if ((scope && (scope->macro_use ||
+                               symbol_set_has(&scope->assigned, sym))) ||
+                    symbol_set_has(&template->assigned, sym)) {
+                    goto chain;
+                }
+                /* a closure defined in the same frame keeps it alive
+                 * anyway, copying it would only hide the cycle */
+                if (*value && (*value)->type == T_COMPOUND_PROC &&
+                    (*value)->compound_proc->env == frame) {
+                    goto chain;
+                }
+                break;
+            }
+            if (scope && symbol_set_has(&scope->defines, sym)) {
+                /* bound later by an internal define of that frame */
+                goto chain;
             }
-            unref(idx);
-            unref(literal);
-            goto ret;
         }
-    }
 
-    if (pattern->symbol != underscore) {
-        pattern_bind *entry = pattern_bind_get(pattern_binds, pattern->symbol);
-        if (!entry) {
-            entry = my_malloc(sizeof(pattern_bind));
-            entry->sym = pattern->symbol;
-            entry->value = NIL;
-            list_add(&entry->head, &pattern_binds->head);
+        if (!value) {
+            if (!env_lookup(global, sym)) {
+                goto chain;
+            }
+            continue;
         }
 
-        entry->value = object_list_append(entry->value, ref(expr));
+        if (!capture) {
+            capture = new_env_sized(global, template->free_vars.count);
+        }
+        capture->symbols[capture->count] = sym;
+        capture->objects[capture->count] = ref(*value);
+        capture->count++;
     }
 
-ret:
-    unref(literals);
-    unref(pattern);
-    unref(expr);
-    return ret_val;
-}
-pattern_match_code match_pattern(pattern_bind *pattern_binds, object *literals,
-                                 object *pattern, object *expr,
-                                 parse_data *data);
+    return capture ? capture : env_ref(global);
 
-bool object_symbol_eq(object *obj_sym, symbol *sym) {
-    bool ret_val = false;
-    if (obj_sym && obj_sym->type == T_SYMBOL && obj_sym->symbol == sym) {
-        ret_val = true;
-    }
-    unref(obj_sym);
-    return ret_val;
+chain:
+    env_unref(capture);
+    return env_ref(e);
 }
 
-pattern_match_code match_list_pattern(pattern_bind *pattern_binds,
-                                      object *literals, object *pattern_list,
-                                      object *expr, parse_data *data) {
+/* a closure over env as is, without closure conversion */
+object *make_compound_proc(env *env, object *template) {
+    /* closure and its proc share one allocation */
+    object *o = my_malloc(sizeof(object) + sizeof(compound_proc));
+    o->type = T_COMPOUND_PROC;
+    o->ref_count = 1;
+    o->compound_proc = (compound_proc *)(o + 1);
+    o->compound_proc->template = template;
+    o->compound_proc->env = env;
+    return o;
+}
 
-    pattern_match_code ret_val = MATCH;
+object *new_compound_proc(env *env, object *template, parse_data *data) {
+    return make_compound_proc(closure_env(env, template->template, data),
+                              template);
+}
 
-    symbol *ellipsis = lookup(data, "...");
+void free_compound_proc(object *o) {
+    compound_proc *proc = o->compound_proc;
+    unref(proc->template);
+    env_unref(proc->env);
+}
 
-    object *pattern = NIL;
-    object *expr_idx = expr;
-    for_each_object_list_entry(pattern, pattern_list) {
-        object *next_idx = object_list_next(ref(idx));
-        if (object_list_has_next(next_idx) &&
-            object_symbol_eq(object_list_entry(object_list_next(ref(idx))),
-                             ellipsis)) {
+object *new_macro_proc(object *literals, object *syntax_rules) {
+    object *o = new_object(T_MACRO_PROC);
+    macro_proc *proc = my_malloc(sizeof(macro_proc));
+    proc->literals = literals;
+    proc->syntax_rules = syntax_rules;
+    o->macro_proc = proc;
+    return o;
+}
 
-            int num = (int)(object_list_len(ref(expr_idx)) -
-                            object_list_len(ref(idx)) + 2);
-            if (num == 0) {
-                collect_pattern(ref(pattern), pattern_binds);
-            }
-
-            while (num-- > 0) {
-                if (match_pattern(pattern_binds, ref(literals), ref(pattern),
-                                  object_list_entry(ref(expr_idx)),
-                                  data) == NOT_MATCH) {
-                    unref(idx);
-                    unref(pattern);
-                    unref(expr_idx);
-
-                    ret_val = NOT_MATCH;
-                    goto ret;
-                }
-                expr_idx = object_list_next(expr_idx);
-            }
-            idx = object_list_next(idx);
-        } else {
-            if (object_list_has_next(ref(expr_idx)) &&
-                match_pattern(pattern_binds, ref(literals), ref(pattern),
-                              object_list_entry(ref(expr_idx)),
-                              data) == MATCH) {
-                expr_idx = object_list_next(expr_idx);
-            } else {
-                unref(idx);
-                unref(pattern);
-                unref(expr_idx);
-
-                ret_val = NOT_MATCH;
-                goto ret;
-            }
-        }
-    }
-
-    if (object_list_has_next(expr_idx)) {
-        ret_val = NOT_MATCH;
-    }
+void free_macro_proc(object *o) {
+    macro_proc *proc = o->macro_proc;
+    unref(proc->literals);
+    unref(proc->syntax_rules);
+    my_free(proc);
+}
 
-ret:
-    unref(literals);
-    unref(pattern_list);
+env *new_env(env *parent) {
+    env *e = my_malloc(sizeof(env));
+    e->parent = env_ref(parent);
+    e->ref_count = 1;
+    return e;
+}
 
-    return ret_val;
+/*
+ * frame with room for capacity bindings, allocated together with the frame
+ */
+env *new_env_sized(env *parent, int capacity) {
+    env *e = my_malloc(sizeof(env) +
+                       (sizeof(symbol *) + sizeof(object *)) * capacity);
+    e->parent = env_ref(parent);
+    e->ref_count = 1;
+    e->capacity = capacity;
+    e->symbols = (symbol **)(e + 1);
+    e->objects = (object **)(e->symbols + capacity);
+    return e;
 }
 
-pattern_match_code match_pattern(pattern_bind *pattern_binds, object *literals,
-                                 object *pattern, object *expr,
-                                 parse_data *data) {
-    pattern_match_code code = NOT_MATCH;
+static inline bool env_inline_slots(env *e) {
+    return e->symbols == (symbol **)(e + 1);
+}
 
-    if (pattern) {
-        switch (pattern->type) {
-        case T_PAIR:
-            code = match_list_pattern(pattern_binds, ref(literals),
-                                      ref(pattern), ref(expr), data);
-            break;
-        case T_SYMBOL:
-            code = match_ident_pattern(pattern_binds, ref(literals),
-                                       ref(pattern), ref(expr), data);
-            break;
-        case T_STRING:
-        case T_NUMBER:
-            // TODO: impl equal?
-            code = NOT_MATCH;
-            break;
-        default:
-            code = SYNTAX_ERR;
-            break;
-        }
-    } else {
-        if (!expr) {
-            code = MATCH;
-        }
+env *env_ref(env *e) {
+    if (e) {
+        e->ref_count++;
     }
-    unref(literals);
-    unref(pattern);
-    unref(expr);
-    return code;
+    return e;
 }
 
-pattern_match_code match_srpattern(pattern_bind **pattern_binds,
-                                   object *literals, object *srpattern,
-                                   object *expr, parse_data *data) {
+static bool env_self_held(env *e);
+static void env_clear(env *e);
 
-    if (!*pattern_binds) {
-        *pattern_binds = my_malloc(sizeof(pattern_bind));
-        INIT_LIST_HEAD(&(*pattern_binds)->head);
+void env_unref(env *e) {
+    if (!e) {
+        return;
     }
-
-    // ignore first pattern
-    pattern_match_code code =
-        match_pattern(*pattern_binds, literals, cdr(srpattern), expr, data);
-    if (code != MATCH) {
-        free_pattern_bind(*pattern_binds);
-        *pattern_binds = NULL;
+    if (!(--e->ref_count)) {
+        free_env(e);
+        return;
+    }
+    if (e->parent && !e->on_stack && env_self_held(e)) {
+        /* held while its closures are dropped, which unref it */
+        e->ref_count++;
+        env_clear(e);
+        env_unref(e);
     }
-    return code;
 }
 
-object *object_list_entry_ref(object *list, size_t index) {
-    object *ret_val = NIL;
-    int i = -1;
-    object *o = NIL;
-    for_each_object_list_entry(o, list) {
-        i++;
-        if (i == (int)index) {
-            ret_val = o;
-            unref(idx);
-            break;
-        }
+void free_env(env *e) {
+    for (int i = 0; i < e->count; i++) {
+        unref(e->objects[i]);
     }
-
-    if (i != (int)index) {
-        ret_val = new_error("list len = %d < index = %d", i, index);
+    if (!env_inline_slots(e)) {
+        my_free(e->symbols);
+        my_free(e->objects);
     }
-
-    unref(list);
-    return ret_val;
+    unref(e->template);
+    env_unref(e->parent);
+    my_free(e);
 }
 
-typedef enum transform_tempalte_code {
-    TTC_SYNTAX_ERR,
-    TTC_INDEX_RANGE_ERR,
-    TTC_OK
-} transform_tempalte_code;
-
-transform_tempalte_code transform_template(object **result,
-                                           pattern_bind *pattern_binds,
-                                           object *template, size_t index,
-                                           bool is_ellipsis_ident,
-                                           parse_data *data);
+/*
+ * frame stack: frames whose lifetime ends with the form that created them
+ */
+#define ENV_STACK_CHUNK_SIZE (64 * 1024)
 
-transform_tempalte_code
-transform_list_template(object **result, pattern_bind *pattern_binds,
-                        object *template_list, size_t index,
-                        bool is_ellipsis_ident, parse_data *data) {
-    /* assert(*result == NIL); */
+env *env_stack_push(parse_data *data, env *parent, int capacity) {
+    size_t size =
+        sizeof(env) + (sizeof(symbol *) + sizeof(object *)) * capacity;
 
-    transform_tempalte_code ret_val = TTC_OK;
+    env_stack_chunk *chunk = data->env_stack;
+    if (!chunk || chunk->used + size > chunk->size) {
+        env_stack_chunk *spare = data->env_stack_spare;
+        if (spare && spare->size >= size) {
+            data->env_stack_spare = NULL;
+        } else {
+            size_t chunk_size =
+                size > ENV_STACK_CHUNK_SIZE ? size : ENV_STACK_CHUNK_SIZE;
+            spare = my_malloc(sizeof(env_stack_chunk) + chunk_size);
+            spare->size = chunk_size;
+        }
+        spare->prev = chunk;
+        spare->used = 0;
+        data->env_stack = chunk = spare;
+    }
 
-    symbol *ellipsis = lookup(data, "...");
-    object *template = NIL;
+    env *e = (env *)((char *)(chunk + 1) + chunk->used);
+    chunk->used += size;
+
+    memset(e, 0, size);
+    e->parent = env_ref(parent);
+    e->ref_count = 1;
+    e->capacity = capacity;
+    e->symbols = (symbol **)(e + 1);
+    e->objects = (object **)(e->symbols + capacity);
+    e->on_stack = true;
+    return e;
+}
 
-    object *ptr = NIL;
-    for_each_object_list_entry(template, template_list) {
-        object *next_idx = object_list_next(ref(idx));
-        if (object_list_has_next(next_idx) &&
-            object_symbol_eq(object_list_entry(object_list_next(ref(idx))),
-                             ellipsis) &&
-            !is_ellipsis_ident) {
-            int i = 0;
-            object *ret = NIL;
-            while ((ret_val = transform_template(
-                        &ret, pattern_binds, ref(template), i,
-                        is_ellipsis_ident, data)) == TTC_OK) {
-                if (!*result) {
-                    *result = cons(ret, NIL);
-                    ptr = ref(*result);
-                } else {
-                    setcdr(ref(ptr), cons(ret, NIL));
-                    ptr = cdr(ptr);
-                }
-                ret = NIL;
-                i++;
-            }
+void env_stack_pop(parse_data *data, env *e) {
+    assert(e->on_stack && e->ref_count == 1);
 
-            if (ret_val == TTC_SYNTAX_ERR) {
-                unref(idx);
-                unref(template);
-                break;
-            } else if (ret_val == TTC_INDEX_RANGE_ERR) {
-                ret_val = TTC_OK;
-            }
+    for (int i = 0; i < e->count; i++) {
+        unref(e->objects[i]);
+    }
+    if (!env_inline_slots(e)) {
+        /* grew past its reserved slots */
+        my_free(e->symbols);
+        my_free(e->objects);
+    }
+    unref(e->template);
+    env_unref(e->parent);
+
+    env_stack_chunk *chunk = data->env_stack;
+    chunk->used = (char *)e - (char *)(chunk + 1);
+    if (!chunk->used && chunk->prev) {
+        data->env_stack = chunk->prev;
+        my_free(data->env_stack_spare);
+        data->env_stack_spare = chunk;
+    }
+}
 
-            idx = object_list_next(idx);
-        } else {
-            object *ret = NIL;
-            ret_val = transform_template(&ret, pattern_binds, ref(template),
-                                         index, is_ellipsis_ident, data);
-            if (ret_val == TTC_OK) {
-                if (!*result) {
-                    *result = cons(ret, NIL);
-                    ptr = ref(*result);
-                } else {
-                    setcdr(ref(ptr), cons(ret, NIL));
-                    ptr = cdr(ptr);
-                }
-            } else {
-                /* assert(ret == NIL); */
+static void env_clear(env *e) {
+    for (int i = 0; i < e->count; i++) {
+        object *o = e->objects[i];
+        e->objects[i] = NIL;
+        unref(o);
+    }
+}
 
-                unref(idx);
-                unref(template);
-                break;
+/*
+ * closures defined inside a frame (internal defines) reference it back. a
+ * frame whose every reference comes from such closures, held by nothing but
+ * the frame, is a cycle nothing else can reach
+ */
+static bool env_self_held(env *e) {
+    if (e->ref_count > e->count) {
+        return false;
+    }
+    int self_refs = 0;
+    for (int i = 0; i < e->count; i++) {
+        object *o = e->objects[i];
+        if (!o || o->type != T_COMPOUND_PROC || o->compound_proc->env != e) {
+            continue;
+        }
+        /* each closure counted once, however many slots hold it */
+        int held = 0;
+        bool first = true;
+        for (int j = 0; j < e->count; j++) {
+            if (e->objects[j] == o) {
+                first = first && j >= i;
+                held++;
             }
         }
+        if (o->ref_count == held && first) {
+            self_refs++;
+        }
     }
+    return self_refs == e->ref_count;
+}
 
-    if (ret_val != TTC_OK) {
-        unref(*result);
-        *result = NIL;
-    }
+/* release a call or let frame, see env_self_held */
+void env_release_frame(env *e) { env_unref(e); }
 
-    unref(ptr);
-    unref(template_list);
-    return ret_val;
+object **env_frame_slot(env *e, symbol *sym) {
+    for (int i = 0; i < e->count; i++) {
+        if (e->symbols[i] == sym) {
+            return &e->objects[i];
+        }
+    }
+    return NULL;
 }
 
-transform_tempalte_code transform_symbol_template(object **result,
-                                                  pattern_bind *pattern_binds,
-                                                  object *template,
-                                                  size_t index) {
-    assert(*result == NIL);
-    assert(template && template->type == T_SYMBOL);
+object **env_lookup(env *e, symbol *sym) {
+    for (; e; e = e->parent) {
+        object **slot = env_frame_slot(e, sym);
+        if (slot) {
+            return slot;
+        }
+    }
+    return NULL;
+}
 
-    transform_tempalte_code code = TTC_OK;
-    pattern_bind *entry = pattern_bind_get(pattern_binds, template->symbol);
+object *env_get(env *e, symbol *sym) {
+    object **slot = env_lookup(e, sym);
+    if (!slot) {
+        return new_error("Exception: variable %s is not bound", sym->name);
+    }
+    return ref(*slot);
+}
 
-    if (entry) {
-        object *ret = object_list_entry_ref(ref(entry->value), index);
-        ERROR(ref(ret)) {
-            unref(error);
-            unref(ret);
-            code = TTC_INDEX_RANGE_ERR;
-            goto ret;
+symbol *env_get_sym(env *e, object *o) {
+    for (int i = 0; i < e->count; i++) {
+        if (e->objects[i] == o) {
+            unref(o);
+            return e->symbols[i];
         }
-        *result = ret;
+    }
+
+    if (e->parent) {
+        return env_get_sym(e->parent, o);
     } else {
-        *result = ref(template);
+        unref(o);
+        return NULL;
     }
+}
 
-ret:
-    unref(template);
-    return code;
+void env_put(env *e, symbol *sym, object *obj) {
+    for (int i = 0; i < e->count; i++) {
+        if (e->symbols[i] == sym) {
+            unref(e->objects[i]);
+            e->objects[i] = obj;
+            return;
+        }
+    }
+
+#define ENV_INC 10
+    if (e->count == e->capacity) {
+        e->capacity += ENV_INC;
+        if (env_inline_slots(e)) {
+            symbol **symbols = my_malloc(sizeof(symbol *) * e->capacity);
+            object **objects = my_malloc(sizeof(object *) * e->capacity);
+            memcpy(symbols, e->symbols, sizeof(symbol *) * e->count);
+            memcpy(objects, e->objects, sizeof(object *) * e->count);
+            e->symbols = symbols;
+            e->objects = objects;
+        } else {
+            e->symbols =
+                my_realloc(e->symbols, sizeof(symbol *) * e->capacity);
+            e->objects =
+                my_realloc(e->objects, sizeof(object *) * e->capacity);
+        }
+    }
+
+    e->symbols[e->count] = sym;
+    e->objects[e->count] = obj;
+    e->count++;
 }
 
-// is_ellipsis_ident
-transform_tempalte_code transform_template(object **result,
-                                           pattern_bind *pattern_binds,
-                                           object *template, size_t index,
-                                           bool is_ellipsis_ident,
-                                           parse_data *data) {
-    assert(*result == NIL);
+object *env_set(env *e, symbol *sym, object *obj) {
+    object **slot = env_lookup(e, sym);
+    if (!slot) {
+        unref(obj);
+        return new_error("Exception: variable %s is not bound", sym->name);
+    }
+    unref(*slot);
+    *slot = obj;
+    return NIL;
+}
 
-    transform_tempalte_code ret_val = TTC_OK;
+void free_object(object *o) {
+    if (!o) {
+        return;
+    }
 
-    symbol *ellipsis = lookup(data, "...");
+    switch (o->type) {
+    case T_ERR:
+        free_error(o);
+        break;
+    case T_NUMBER:
+        free_number(o);
+        break;
+    case T_STRING:
+        free_string(o);
+        break;
+    case T_PAIR:
+        free_pair(o);
+        break;
+    case T_PRIMITIVE_PROC:
+        free_primitive_proc(o);
+        break;
+    case T_COMPOUND_PROC:
+        free_compound_proc(o);
+        break;
+    case T_MACRO_PROC:
+        free_macro_proc(o);
+        break;
+    case T_TEMPLATE:
+        free_template(o);
+        break;
+    case T_CASE_TABLE:
+        free_case_table(o);
+        break;
+#ifndef MY_OS
+    case T_GENERATOR:
+        free_generator(o);
+        break;
+#endif
+    case T_SYMBOL:
+        break;
+    default:
+        break;
+    }
 
-    if (template) {
-        switch (template->type) {
-        case T_PAIR:
-            if (object_symbol_eq(object_list_entry(ref(template)), ellipsis) &&
-                !is_ellipsis_ident) {
-                object *next_idx = object_list_next(ref(template));
-                if (object_list_has_next(ref(next_idx))) {
-                    ret_val = transform_template(result, pattern_binds,
-                                                 object_list_entry(next_idx),
-                                                 index, true, data);
+    my_free(o);
+}
+
+/* an object that is not a list */
+void atom_write(struct lisp_out *out, object *o, env *e) {
+    if (!o) {
+        lisp_out_puts(out, "()");
+        return;
+    }
+
+    switch (o->type) {
+    case T_SYMBOL:
+        lisp_out_puts(out, o->symbol->name);
+        break;
+    case T_STRING:
+        lisp_out_putc(out, '"');
+        lisp_out_write(out, o->str->str_p, o->str->len);
+        lisp_out_putc(out, '"');
+        break;
+    case T_NUMBER: {
+#define NUMBER_BUF_SIZE 1024
+        char buf[NUMBER_BUF_SIZE] = {'\0'};
+        format_number(buf, o->number);
+        lisp_out_puts(out, buf);
+        break;
+    }
+    case T_BOOLEAN:
+        lisp_out_puts(out, o->bool_val ? "#t" : "#f");
+        break;
+    case T_ERR:
+        error_write(out, o->err);
+        break;
+    case T_PRIMITIVE_PROC:
+    case T_COMPOUND_PROC:
+    case T_CONTINUATION: {
+        symbol *symbol = e ? env_get_sym(e, ref(o)) : NULL;
+        lisp_out_puts(out, "#<procedure");
+        if (symbol) {
+            lisp_out_putc(out, ' ');
+            lisp_out_puts(out, symbol->name);
+        }
+        lisp_out_putc(out, '>');
+        break;
+    }
+    case T_GENERATOR:
+        lisp_out_puts(out, "#<generator>");
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * print o into out. lists are walked with an explicit stack of the pairs
+ * being printed, one per open parenthesis, each with the elements written.
+ */
+void object_write_limited(struct lisp_out *out, object *o, env *e,
+                          size_t max_depth, size_t max_length) {
+#define WRITE_STACK_SIZE 32
+    struct write_frame {
+        object *pair;
+        size_t count;
+    } stack_buf[WRITE_STACK_SIZE];
+    struct write_frame *stack = stack_buf;
+    size_t depth = 0;
+    size_t capacity = WRITE_STACK_SIZE;
+
+    object *next = o;
+    for (;;) {
+        while (next && next->type == T_PAIR && depth != max_depth) {
+            if (depth == capacity) {
+                capacity *= 2;
+                if (stack == stack_buf) {
+                    stack = my_malloc(capacity * sizeof(*stack));
+                    memcpy(stack, stack_buf, sizeof(stack_buf));
                 } else {
-                    unref(next_idx);
-                    ret_val = TTC_SYNTAX_ERR;
+                    stack = my_realloc(stack, capacity * sizeof(*stack));
                 }
-            } else {
-                ret_val = transform_list_template(result, pattern_binds,
-                                                  ref(template), index,
-                                                  is_ellipsis_ident, data);
             }
+            lisp_out_putc(out, '(');
+            stack[depth++] = (struct write_frame){next, 1};
+            next = next->pair->car;
+        }
+        if (next && next->type == T_PAIR) {
+            lisp_out_puts(out, "...");
+        } else {
+            atom_write(out, next, e);
+        }
 
+        /* close the lists that are done, then go on with the next element */
+        for (; depth; depth--) {
+            struct write_frame *frame = &stack[depth - 1];
+            object *rest = frame->pair->pair->cdr;
+            if (rest && rest->type == T_PAIR) {
+                if (frame->count == max_length) {
+                    lisp_out_puts(out, " ...)");
+                    continue;
+                }
+                lisp_out_putc(out, ' ');
+                frame->pair = rest;
+                frame->count++;
+                next = rest->pair->car;
+                break;
+            }
+            if (rest) {
+                lisp_out_puts(out, " . ");
+                atom_write(out, rest, e);
+            }
+            lisp_out_putc(out, ')');
+        }
+        if (!depth) {
             break;
-        case T_SYMBOL:
-            ret_val = transform_symbol_template(result, pattern_binds,
-                                                ref(template), index);
-            break;
-        case T_STRING:
-        case T_NUMBER:
-            *result = ref(template);
-            break;
-        default:
+        }
+    }
+
+    if (stack != stack_buf) {
+        my_free(stack);
+    }
+    unref(o);
+}
+
+void object_write(struct lisp_out *out, object *o, env *e) {
+    object_write_limited(out, o, e, (size_t)-1, (size_t)-1);
+}
+
+char *to_string(object *o, env *e) {
+    struct lisp_out out;
+    lisp_out_init_mem(&out);
+    object_write(&out, o, e);
+    return lisp_out_take(&out);
+}
+
+void object_print(object *o, env *e) {
+#define PRINT_BUF_SIZE 4096
+    char buf[PRINT_BUF_SIZE];
+    struct lisp_out out;
+    lisp_out_init_stdout(&out, buf, sizeof(buf));
+    object_write(&out, o, e);
+    lisp_out_flush(&out);
+}
+
+size_t object_list_len(object *list) {
+    if (!list)
+        return 0;
+
+    size_t i = 0;
+    object *o = NIL;
+    for_each_object_list_entry(o, list) { i++; }
+    unref(list);
+    return i;
+}
+
+/*
+ * the frames of a loop body are reused across iterations unless the body may
+ * have captured them
+ */
+static inline bool loop_frame_reusable(lambda_template *template) {
+    return !template->makes_closure && !template->macro_use;
+}
+
+/*
+ * rebind the params of a loop frame to next for another iteration, in place
+ * when nothing can hold the frame, otherwise in a fresh frame
+ */
+void loop_rebind(env **frame, lambda_template *template, object **next) {
+    env *e = *frame;
+    if (loop_frame_reusable(template)) {
+        for (int i = 0; i < template->param_count; i++) {
+            unref(e->objects[i]);
+            e->objects[i] = next[i];
+        }
+        /* the internal defines of the body are unbound again */
+        for (int i = template->param_count; i < e->count; i++) {
+            unref(e->objects[i]);
+        }
+        e->count = template->param_count;
+        return;
+    }
+
+    *frame = new_env_sized(e->parent, e->capacity);
+    (*frame)->template = ref(e->template);
+    for (int i = 0; i < template->param_count; i++) {
+        env_put(*frame, template->params[i], next[i]);
+    }
+    env_release_frame(e);
+}
+
+/*
+ * the forms of the body, run by begin directly so the (begin ...) the
+ * template keeps them in is not a call of its own in backtraces
+ */
+static object *template_body_eval(lambda_template *template, env *frame,
+                                  parse_data *data) {
+    return primitive_begin(frame, ref(template->body->pair->cdr), data);
+}
+
+/*
+ * evaluate the body of the frame's template. for a named let the marked tail
+ * calls come back here as TailCall and the body runs again
+ */
+object *template_eval(env **frame, parse_data *data) {
+    lambda_template *template = (*frame)->template->template;
+    if (!template->loop) {
+        return template_body_eval(template, *frame, data);
+    }
+
+    object *next[template->param_count + 1];
+    loop_state state = {
+        .prev = data->loop,
+        .name = template->loop,
+        .next = next,
+    };
+    data->loop = &state;
+
+    object *ret_val;
+    for (;;) {
+        ret_val = template_body_eval(template, *frame, data);
+        if (ret_val != &TailCall || !state.jump) {
             break;
         }
-    } else {
-        *result = NIL;
+        unref(ret_val);
+        state.jump = false;
+        loop_rebind(frame, template, next);
     }
-    unref(template);
+
+    data->loop = state.prev;
     return ret_val;
 }
 
-object *macro_proc_call(env *e, object *func, object *args, parse_data *data) {
-    macro_proc *proc = func->macro_proc;
+/* evaluate a marked tail call (name arg...) into the innermost loop name */
+object *loop_call(object *expr, env *e, parse_data *data) {
+    loop_state *state = data->loop;
+    while (state && state->name != expr->pair->car->symbol) {
+        state = state->prev;
+    }
+    if (!state) {
+        return NULL;
+    }
+
+    int i = 0;
+    for (object *arg = expr->pair->cdr; arg; arg = arg->pair->cdr) {
+        object *val = eval_from_ast(ref(arg->pair->car), e, data);
+        ERROR_REF(val) {
+            unref(val);
+            while (i--) {
+                unref(state->next[i]);
+            }
+            return error;
+        }
+        state->next[i++] = val;
+    }
+    state->jump = true;
+    return ref(&TailCall);
+}
 
+object *compound_proc_call(env *e, object *func, object *args,
+                           parse_data *data) {
     object *ret_val = NIL;
-    transform_tempalte_code ttcode = TTC_SYNTAX_ERR;
-    object *syntax_rule = NIL;
-    for_each_object_list_entry(syntax_rule, proc->syntax_rules) {
-        object *srpattern = car(ref(syntax_rule));
 
-        pattern_bind *pattern_binds = NULL;
-        pattern_match_code ret = match_srpattern(
-            &pattern_binds, ref(proc->literals), srpattern, ref(args), data);
+    lambda_template *template = func->compound_proc->template->template;
+    int total = template->param_count;
+    int given_num = 0;
 
-        if (ret == MATCH) {
-            object *template = car(cdr(ref(syntax_rule)));
+    env *frame =
+        new_env_sized(func->compound_proc->env,
+                      total + (template->varg ? 1 : 0) + template->defines.count);
+    frame->template = ref(func->compound_proc->template);
 
-            ttcode = transform_template(&ret_val, pattern_binds, template, 0,
-                                        false, data);
-            free_pattern_bind(pattern_binds);
-            unref(syntax_rule);
+    object *varg_val = NIL;
+    object *ptr = NIL;
+
+    object *given = NIL;
+    for_each_object_list_entry(given, args) {
+        ERROR(ASSERT(given_num < total || template->varg,
+                     "Function passed too many arguments. "
+                     "Expected %d.",
+                     total)) {
             unref(idx);
-            break;
+            unref(given);
+            ret_val = error;
+            goto ret;
+        }
+
+        object *eval_val = eval_from_ast(ref(given), e, data);
+        ERROR_REF(eval_val) {
+            unref(idx);
+            unref(given);
+            unref(eval_val);
+            ret_val = error;
+            goto ret;
+        }
+
+        if (given_num < total) {
+            env_put(frame, template->params[given_num], eval_val);
+            given_num++;
+            continue;
+        }
+
+        // varg handle
+        if (!varg_val) {
+            varg_val = cons(eval_val, NIL);
+            ptr = ref(varg_val);
+        } else {
+            setcdr(ref(ptr), cons(eval_val, NIL));
+            ptr = cdr(ptr);
         }
     }
 
-    if (ttcode != TTC_OK) {
-        ret_val = new_error("Exception: invalid syntax");
-    } else {
-        /* my_printf("template value: "); */
-        /* object_print(ref(ret_val), e); */
-        /* my_printf("\n"); */
+    if (template->varg) {
+        env_put(frame, template->varg, varg_val);
+        varg_val = NIL;
+    }
 
-        ret_val = eval_from_ast(ret_val, e, data);
+    ERROR(
+        ASSERT(total == given_num,
+               "Exception: incorrect number of arguments, given: %d, total: %d",
+               given_num, total)) {
+        ret_val = error;
+        goto ret;
     }
 
-    unref(args);
+    ret_val = template_eval(&frame, data);
+
+ret:
+    unref(ptr);
+    unref(varg_val);
+    env_release_frame(frame);
     unref(func);
+    unref(args);
+    return ret_val;
+}
+
+typedef struct pattern_bind_t {
+    symbol *sym;
+    object *value;
+    struct list_head head;
+} pattern_bind;
+
+void free_pattern_bind(pattern_bind *pattern_binds) {
+    while (!list_empty(&pattern_binds->head)) {
+        pattern_bind *entry = list_next_entry(pattern_binds, head);
+        list_del(&entry->head);
+        unref(entry->value);
+        my_free(entry);
+    }
+    my_free(pattern_binds);
+}
+
+pattern_bind *pattern_bind_get(pattern_bind *binds, symbol *sym) {
+    pattern_bind *entry;
+    list_for_each_entry(entry, &binds->head, head) {
+        if (entry->sym == sym) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+typedef enum pattern_match_code {
+    MATCH,
+    NOT_MATCH,
+    SYNTAX_ERR
+} pattern_match_code;
+
+object *object_list_append(object *list, object *o) {
+    /* assert(!list || list->type == T_PAIR); */
+
+    object *ret_val = NIL;
+    object *last_idx = NIL;
+    for_each_object_list(list) {
+        unref(last_idx);
+        last_idx = ref(idx);
+    }
+
+    if (last_idx == NIL) {
+        ret_val = cons(o, NIL);
+    } else {
+        /* assert(cdr(ref(last_idx)) == NIL); */
+        setcdr(last_idx, cons(o, NIL));
+        ret_val = ref(list);
+    }
+    unref(list);
+    return ret_val;
+}
+
+void collect_pattern(object *pattern, pattern_bind *pattern_values) {
+    if (!pattern) {
+        return;
+    }
+
+    if (pattern->type == T_SYMBOL) {
+        pattern_bind *entry = pattern_bind_get(pattern_values, pattern->symbol);
+        if (!entry) {
+            entry = my_malloc(sizeof(pattern_bind));
+            entry->sym = pattern->symbol;
+            entry->value = NIL;
+            list_add(&entry->head, &pattern_values->head);
+        }
+    } else if (pattern->type == T_PAIR) {
+        collect_pattern(car(ref(pattern)), pattern_values);
+        collect_pattern(cdr(ref(pattern)), pattern_values);
+    }
+    unref(pattern);
+    // TODO: vector
+}
+
+pattern_match_code match_ident_pattern(pattern_bind *pattern_binds,
+                                       object *literals, object *pattern,
+                                       object *expr, parse_data *data) {
+    pattern_match_code ret_val = MATCH;
+    symbol *underscore = lookup(data, "_");
+
+    // TODO: to object list contain function
+
+    object *literal = NIL;
+    for_each_object_list_entry(literal, literals) {
+        if (literal && literal->symbol == pattern->symbol) {
+            if (!(expr && expr->type == T_SYMBOL &&
+                  literal->symbol == expr->symbol)) {
+                ret_val = NOT_MATCH;
+            }
+            unref(idx);
+            unref(literal);
+            goto ret;
+        }
+    }
+
+    if (pattern->symbol != underscore) {
+        pattern_bind *entry = pattern_bind_get(pattern_binds, pattern->symbol);
+        if (!entry) {
+            entry = my_malloc(sizeof(pattern_bind));
+            entry->sym = pattern->symbol;
+            entry->value = NIL;
+            list_add(&entry->head, &pattern_binds->head);
+        }
+
+        entry->value = object_list_append(entry->value, ref(expr));
+    }
+
+ret:
+    unref(literals);
+    unref(pattern);
+    unref(expr);
+    return ret_val;
+}
+pattern_match_code match_pattern(pattern_bind *pattern_binds, object *literals,
+                                 object *pattern, object *expr,
+                                 parse_data *data);
+
+bool object_symbol_eq(object *obj_sym, symbol *sym) {
+    bool ret_val = false;
+    if (obj_sym && obj_sym->type == T_SYMBOL && obj_sym->symbol == sym) {
+        ret_val = true;
+    }
+    unref(obj_sym);
+    return ret_val;
+}
+
+pattern_match_code match_list_pattern(pattern_bind *pattern_binds,
+                                      object *literals, object *pattern_list,
+                                      object *expr, parse_data *data) {
+
+    pattern_match_code ret_val = MATCH;
+
+    symbol *ellipsis = lookup(data, "...");
+
+    object *pattern = NIL;
+    object *expr_idx = expr;
+    for_each_object_list_entry(pattern, pattern_list) {
+        object *next_idx = object_list_next(ref(idx));
+        if (object_list_has_next(next_idx) &&
+            object_symbol_eq(object_list_entry(object_list_next(ref(idx))),
+                             ellipsis)) {
+
+            int num = (int)(object_list_len(ref(expr_idx)) -
+                            object_list_len(ref(idx)) + 2);
+            if (num == 0) {
+                collect_pattern(ref(pattern), pattern_binds);
+            }
+
+            while (num-- > 0) {
+                if (match_pattern(pattern_binds, ref(literals), ref(pattern),
+                                  object_list_entry(ref(expr_idx)),
+                                  data) == NOT_MATCH) {
+                    unref(idx);
+                    unref(pattern);
+                    unref(expr_idx);
+
+                    ret_val = NOT_MATCH;
+                    goto ret;
+                }
+                expr_idx = object_list_next(expr_idx);
+            }
+            idx = object_list_next(idx);
+        } else {
+            if (object_list_has_next(ref(expr_idx)) &&
+                match_pattern(pattern_binds, ref(literals), ref(pattern),
+                              object_list_entry(ref(expr_idx)),
+                              data) == MATCH) {
+                expr_idx = object_list_next(expr_idx);
+            } else {
+                unref(idx);
+                unref(pattern);
+                unref(expr_idx);
+
+                ret_val = NOT_MATCH;
+                goto ret;
+            }
+        }
+    }
+
+    if (object_list_has_next(expr_idx)) {
+        ret_val = NOT_MATCH;
+    }
+
+ret:
+    unref(literals);
+    unref(pattern_list);
+
+    return ret_val;
+}
+
+pattern_match_code match_pattern(pattern_bind *pattern_binds, object *literals,
+                                 object *pattern, object *expr,
+                                 parse_data *data) {
+    pattern_match_code code = NOT_MATCH;
+
+    if (pattern) {
+        switch (pattern->type) {
+        case T_PAIR:
+            code = match_list_pattern(pattern_binds, ref(literals),
+                                      ref(pattern), ref(expr), data);
+            break;
+        case T_SYMBOL:
+            code = match_ident_pattern(pattern_binds, ref(literals),
+                                       ref(pattern), ref(expr), data);
+            break;
+        case T_STRING:
+        case T_NUMBER:
+            // TODO: impl equal?
+            code = NOT_MATCH;
+            break;
+        default:
+            code = SYNTAX_ERR;
+            break;
+        }
+    } else {
+        if (!expr) {
+            code = MATCH;
+        }
+    }
+    unref(literals);
+    unref(pattern);
+    unref(expr);
+    return code;
+}
+
+pattern_match_code match_srpattern(pattern_bind **pattern_binds,
+                                   object *literals, object *srpattern,
+                                   object *expr, parse_data *data) {
+
+    if (!*pattern_binds) {
+        *pattern_binds = my_malloc(sizeof(pattern_bind));
+        INIT_LIST_HEAD(&(*pattern_binds)->head);
+    }
+
+    // ignore first pattern
+    pattern_match_code code =
+        match_pattern(*pattern_binds, literals, cdr(srpattern), expr, data);
+    if (code != MATCH) {
+        free_pattern_bind(*pattern_binds);
+        *pattern_binds = NULL;
+    }
+    return code;
+}
+
+object *object_list_entry_ref(object *list, size_t index) {
+    object *ret_val = NIL;
+    int i = -1;
+    object *o = NIL;
+    for_each_object_list_entry(o, list) {
+        i++;
+        if (i == (int)index) {
+            ret_val = o;
+            unref(idx);
+            break;
+        }
+    }
+
+    if (i != (int)index) {
+        ret_val = new_error("list len = %d < index = %d", i, index);
+    }
+
+    unref(list);
+    return ret_val;
+}
+
+typedef enum transform_tempalte_code {
+    TTC_SYNTAX_ERR,
+    TTC_INDEX_RANGE_ERR,
+    TTC_OK
+} transform_tempalte_code;
+
+transform_tempalte_code transform_template(object **result,
+                                           pattern_bind *pattern_binds,
+                                           object *template, size_t index,
+                                           bool is_ellipsis_ident,
+                                           parse_data *data);
+
+transform_tempalte_code
+transform_list_template(object **result, pattern_bind *pattern_binds,
+                        object *template_list, size_t index,
+                        bool is_ellipsis_ident, parse_data *data) {
+    /* assert(*result == NIL); */
+
+    transform_tempalte_code ret_val = TTC_OK;
+
+    symbol *ellipsis = lookup(data, "...");
+    object *template = NIL;
+
+    object *ptr = NIL;
+    for_each_object_list_entry(template, template_list) {
+        object *next_idx = object_list_next(ref(idx));
+        if (object_list_has_next(next_idx) &&
+            object_symbol_eq(object_list_entry(object_list_next(ref(idx))),
+                             ellipsis) &&
+            !is_ellipsis_ident) {
+            int i = 0;
+            object *ret = NIL;
+            while ((ret_val = transform_template(
+                        &ret, pattern_binds, ref(template), i,
+                        is_ellipsis_ident, data)) == TTC_OK) {
+                if (!*result) {
+                    *result = cons(ret, NIL);
+                    ptr = ref(*result);
+                } else {
+                    setcdr(ref(ptr), cons(ret, NIL));
+                    ptr = cdr(ptr);
+                }
+                ret = NIL;
+                i++;
+            }
+
+            if (ret_val == TTC_SYNTAX_ERR) {
+                unref(idx);
+                unref(template);
+                break;
+            } else if (ret_val == TTC_INDEX_RANGE_ERR) {
+                ret_val = TTC_OK;
+            }
+
+            idx = object_list_next(idx);
+        } else {
+            object *ret = NIL;
+            ret_val = transform_template(&ret, pattern_binds, ref(template),
+                                         index, is_ellipsis_ident, data);
+            if (ret_val == TTC_OK) {
+                if (!*result) {
+                    *result = cons(ret, NIL);
+                    ptr = ref(*result);
+                } else {
+                    setcdr(ref(ptr), cons(ret, NIL));
+                    ptr = cdr(ptr);
+                }
+            } else {
+                /* assert(ret == NIL); */
+
+                unref(idx);
+                unref(template);
+                break;
+            }
+        }
+    }
+
+    if (ret_val != TTC_OK) {
+        unref(*result);
+        *result = NIL;
+    }
+
+    unref(ptr);
+    unref(template_list);
+    return ret_val;
+}
+
+transform_tempalte_code transform_symbol_template(object **result,
+                                                  pattern_bind *pattern_binds,
+                                                  object *template,
+                                                  size_t index) {
+    assert(*result == NIL);
+    assert(template && template->type == T_SYMBOL);
+
+    transform_tempalte_code code = TTC_OK;
+    pattern_bind *entry = pattern_bind_get(pattern_binds, template->symbol);
+
+    if (entry) {
+        object *ret = object_list_entry_ref(ref(entry->value), index);
+        ERROR_REF(ret) {
+            unref(error);
+            unref(ret);
+            code = TTC_INDEX_RANGE_ERR;
+            goto ret;
+        }
+        *result = ret;
+    } else {
+        *result = ref(template);
+    }
+
+ret:
+    unref(template);
+    return code;
+}
+
+// is_ellipsis_ident
+transform_tempalte_code transform_template(object **result,
+                                           pattern_bind *pattern_binds,
+                                           object *template, size_t index,
+                                           bool is_ellipsis_ident,
+                                           parse_data *data) {
+    assert(*result == NIL);
+
+    transform_tempalte_code ret_val = TTC_OK;
+
+    symbol *ellipsis = lookup(data, "...");
+
+    if (template) {
+        switch (template->type) {
+        case T_PAIR:
+            if (object_symbol_eq(object_list_entry(ref(template)), ellipsis) &&
+                !is_ellipsis_ident) {
+                object *next_idx = object_list_next(ref(template));
+                if (object_list_has_next(ref(next_idx))) {
+                    ret_val = transform_template(result, pattern_binds,
+                                                 object_list_entry(next_idx),
+                                                 index, true, data);
+                } else {
+                    unref(next_idx);
+                    ret_val = TTC_SYNTAX_ERR;
+                }
+            } else {
+                ret_val = transform_list_template(result, pattern_binds,
+                                                  ref(template), index,
+                                                  is_ellipsis_ident, data);
+            }
+
+            break;
+        case T_SYMBOL:
+            ret_val = transform_symbol_template(result, pattern_binds,
+                                                ref(template), index);
+            break;
+        case T_STRING:
+        case T_NUMBER:
+            *result = ref(template);
+            break;
+        default:
+            break;
+        }
+    } else {
+        *result = NIL;
+    }
+    unref(template);
+    return ret_val;
+}
+
+/* the expansion of a macro use, or an error */
+object *macro_expand(object *func, object *args, parse_data *data) {
+    macro_proc *proc = func->macro_proc;
+
+    object *ret_val = NIL;
+    transform_tempalte_code ttcode = TTC_SYNTAX_ERR;
+    object *syntax_rule = NIL;
+    for_each_object_list_entry(syntax_rule, proc->syntax_rules) {
+        object *srpattern = car(ref(syntax_rule));
+
+        pattern_bind *pattern_binds = NULL;
+        pattern_match_code ret = match_srpattern(
+            &pattern_binds, ref(proc->literals), srpattern, ref(args), data);
+
+        if (ret == MATCH) {
+            object *template = car(cdr(ref(syntax_rule)));
+
+            ttcode = transform_template(&ret_val, pattern_binds, template, 0,
+                                        false, data);
+            free_pattern_bind(pattern_binds);
+            unref(syntax_rule);
+            unref(idx);
+            break;
+        }
+    }
+
+    if (ttcode != TTC_OK) {
+        unref(ret_val);
+        ret_val = new_error("Exception: invalid syntax");
+    }
+
+    unref(args);
+    unref(func);
+
+    return ret_val;
+}
+
+object *macro_proc_call(env *e, object *func, object *args, parse_data *data) {
+    object *expansion = macro_expand(func, args, data);
+    if (expansion && expansion->type == T_ERR) {
+        return expansion;
+    }
+
+    /* my_printf("template value: "); */
+    /* object_print(ref(expansion), e); */
+    /* my_printf("\n"); */
+
+    return eval_from_ast(expansion, e, data);
+}
+
+/*
+ * macro expansion ahead of evaluation: macro uses are replaced by their
+ * expansions, with special forms and local scope recognized like
+ * walk_form. names not bound to a macro yet are left for the evaluator.
+ */
+typedef struct expand_walk_t {
+    scope_walk w;
+    parse_data *data;
+    expand_hook *hook;
+    void *ctx;
+    /* expansions left, a macro that keeps expanding into itself stops */
+    int budget;
+} expand_walk;
+
+#define EXPAND_BUDGET 4096
+
+object *expand_expr(expand_walk *x, object *expr);
+
+/* the elements of a list expanded, the tail included */
+object *expand_list(expand_walk *x, object *list) {
+    object *head = NIL;
+    object **tail = &head;
+    for (; list && list->type == T_PAIR; list = list->pair->cdr) {
+        *tail = cons(expand_expr(x, list->pair->car), NIL);
+        tail = &(*tail)->pair->cdr;
+    }
+    *tail = expand_expr(x, list);
+    return head;
+}
+
+object *expand_body(expand_walk *x, object *body) {
+    int depth = x->w.bound.count;
+    for (object *form = body; form && form->type == T_PAIR;
+         form = form->pair->cdr) {
+        symbol *target = define_target(&x->w, form->pair->car);
+        if (target) {
+            symbol_set_push(&x->w.bound, target);
+        }
+    }
+
+    object *ret_val = expand_list(x, body);
+    x->w.bound.count = depth;
+    return ret_val;
+}
+
+object *expand_lambda(expand_walk *x, object *params, object *body) {
+    int depth = x->w.bound.count;
+    walk_params(&x->w, params);
+    object *ret_val = expand_body(x, body);
+    x->w.bound.count = depth;
+    return ret_val;
+}
+
+/* ((var init...)...) with the inits expanded */
+object *expand_bindings(expand_walk *x, object *bindings) {
+    object *head = NIL;
+    object **tail = &head;
+    for (; bindings && bindings->type == T_PAIR;
+         bindings = bindings->pair->cdr) {
+        object *b = bindings->pair->car;
+        *tail = cons(b && b->type == T_PAIR
+                         ? cons(ref(b->pair->car), expand_list(x, b->pair->cdr))
+                         : ref(b),
+                     NIL);
+        tail = &(*tail)->pair->cdr;
+    }
+    *tail = ref(bindings);
+    return head;
+}
+
+/* ((var init step...)...), the vars are bound for the steps only */
+object *expand_do_specs(expand_walk *x, object *specs) {
+    object *inits = NIL;
+    object **tail = &inits;
+    object *spec = specs;
+    for (; spec && spec->type == T_PAIR; spec = spec->pair->cdr) {
+        object *b = spec->pair->car;
+        bool has_init = b && b->type == T_PAIR && b->pair->cdr &&
+                        b->pair->cdr->type == T_PAIR;
+        *tail = cons(has_init ? expand_expr(x, b->pair->cdr->pair->car) : NIL,
+                     NIL);
+        tail = &(*tail)->pair->cdr;
+    }
+
+    walk_bindings(&x->w, specs);
+
+    object *head = NIL;
+    tail = &head;
+    object *init = inits;
+    for (spec = specs; spec && spec->type == T_PAIR;
+         spec = spec->pair->cdr, init = init->pair->cdr) {
+        object *b = spec->pair->car;
+        object *o = ref(b);
+        if (b && b->type == T_PAIR && b->pair->cdr &&
+            b->pair->cdr->type == T_PAIR) {
+            unref(o);
+            o = cons(ref(b->pair->car),
+                     cons(ref(init->pair->car),
+                          expand_list(x, b->pair->cdr->pair->cdr)));
+        }
+        *tail = cons(o, NIL);
+        tail = &(*tail)->pair->cdr;
+    }
+    *tail = ref(spec);
+    unref(inits);
+    return head;
+}
+
+/* cond clauses, each element of a clause is an expression */
+object *expand_cond_clauses(expand_walk *x, object *clauses) {
+    object *head = NIL;
+    object **tail = &head;
+    for (; clauses && clauses->type == T_PAIR; clauses = clauses->pair->cdr) {
+        *tail = cons(expand_list(x, clauses->pair->car), NIL);
+        tail = &(*tail)->pair->cdr;
+    }
+    *tail = ref(clauses);
+    return head;
+}
+
+/* case clauses, the datums are quoted */
+object *expand_case_clauses(expand_walk *x, object *clauses) {
+    object *head = NIL;
+    object **tail = &head;
+    for (; clauses && clauses->type == T_PAIR; clauses = clauses->pair->cdr) {
+        object *clause = clauses->pair->car;
+        *tail = cons(clause && clause->type == T_PAIR
+                         ? cons(ref(clause->pair->car),
+                                expand_list(x, clause->pair->cdr))
+                         : ref(clause),
+                     NIL);
+        tail = &(*tail)->pair->cdr;
+    }
+    *tail = ref(clauses);
+    return head;
+}
+
+object *expand_macro_use(expand_walk *x, object *expr, symbol *sym) {
+    object **slot = env_lookup(x->w.env, sym);
+    if (!slot || !*slot || (*slot)->type != T_MACRO_PROC) {
+        return expand_list(x, expr);
+    }
+    object *macro = ref(*slot);
+    if (!x->budget) {
+        unref(macro);
+        return ref(expr);
+    }
+    x->budget--;
+
+    object *expansion = macro_expand(ref(macro), ref(expr->pair->cdr), x->data);
+    if (expansion && expansion->type == T_ERR) {
+        /* the evaluator reports it when the form is reached */
+        unref(expansion);
+        unref(macro);
+        return ref(expr);
+    }
+
+    if (x->hook) {
+        x->hook(x->ctx, sym, macro);
+    }
+    object *ret_val = expand_expr(x, expansion);
+    unref(expansion);
+    unref(macro);
+    return ret_val;
+}
+
+object *expand_form(expand_walk *x, object *expr) {
+    scope_walk *w = &x->w;
+    object *head = expr->pair->car;
+    object *args = expr->pair->cdr;
+
+    if (!head || head->type != T_SYMBOL ||
+        symbol_set_has(&w->bound, head->symbol)) {
+        return expand_list(x, expr);
+    }
+
+    symbol *sym = head->symbol;
+    if (sym == w->quote || sym == w->define_syntax ||
+        sym == w->syntax_rules) {
+        return ref(expr);
+    }
+
+    if (!args || args->type != T_PAIR) {
+        return expand_macro_use(x, expr, sym);
+    }
+
+    object *first = args->pair->car;
+    object *rest = args->pair->cdr;
+    int depth = w->bound.count;
+    object *ret_val = NIL;
+    if (sym == w->lambda) {
+        ret_val = cons(ref(head),
+                       cons(ref(first), expand_lambda(x, first, rest)));
+    } else if (sym == w->define && first && first->type == T_PAIR) {
+        ret_val =
+            cons(ref(head),
+                 cons(ref(first), expand_lambda(x, first->pair->cdr, rest)));
+    } else if (sym == w->let && first && first->type == T_SYMBOL && rest &&
+               rest->type == T_PAIR) {
+        object *bindings = expand_bindings(x, rest->pair->car);
+        symbol_set_push(&w->bound, first->symbol);
+        walk_bindings(w, rest->pair->car);
+        ret_val = cons(ref(head),
+                       cons(ref(first),
+                            cons(bindings, expand_body(x, rest->pair->cdr))));
+    } else if (sym == w->let) {
+        object *bindings = expand_bindings(x, first);
+        walk_bindings(w, first);
+        ret_val = cons(ref(head), cons(bindings, expand_body(x, rest)));
+    } else if (sym == w->letrec || sym == w->letrec_star) {
+        walk_bindings(w, first);
+        object *bindings = expand_bindings(x, first);
+        ret_val = cons(ref(head), cons(bindings, expand_body(x, rest)));
+    } else if (sym == w->do_) {
+        object *specs = expand_do_specs(x, first);
+        ret_val = cons(ref(head), cons(specs, expand_list(x, rest)));
+    } else if (sym == w->cond) {
+        ret_val = cons(ref(head), expand_cond_clauses(x, args));
+    } else if (sym == w->case_) {
+        ret_val = cons(ref(head), cons(expand_expr(x, first),
+                                       expand_case_clauses(x, rest)));
+    } else {
+        ret_val = expand_macro_use(x, expr, sym);
+    }
+    w->bound.count = depth;
+    return ret_val;
+}
+
+object *expand_expr(expand_walk *x, object *expr) {
+    if (!expr || expr->type != T_PAIR) {
+        return ref(expr);
+    }
+    return expand_form(x, expr);
+}
+
+object *expand_macros(object *form, env *e, parse_data *data,
+                      expand_hook *hook, void *ctx) {
+    expand_walk x = {
+        .data = data,
+        .hook = hook,
+        .ctx = ctx,
+        .budget = EXPAND_BUDGET,
+    };
+    scope_walk_init(&x.w, NULL, e, data);
+
+    object *ret_val = expand_expr(&x, form);
+    free_symbol_set(&x.w.bound);
+    unref(form);
+    return ret_val;
+}
+
+object *proc_call(env *e, object *func, object *args, parse_data *data) {
+    object *ret_val = NIL;
+
+    switch (func->type) {
+    case T_PRIMITIVE_PROC:
+        ret_val = func->primitive_proc->proc(e, ref(args), data);
+        break;
+    case T_COMPOUND_PROC:
+        ret_val = compound_proc_call(e, ref(func), ref(args), data);
+        break;
+    case T_MACRO_PROC:
+        ret_val = macro_proc_call(e, ref(func), ref(args), data);
+        break;
+    case T_CONTINUATION:
+        ret_val = continuation_call(e, ref(func), ref(args), data);
+        break;
+    default:
+        ret_val = new_error("Exception: func type is not supported");
+        break;
+    }
+
+    unref(func);
+    unref(args);
+    return ret_val;
+}
+
+/* the call forms stack of data, grown as calls nest */
+static void call_push(parse_data *data, object *form) {
+    if (data->call_depth == data->call_capacity) {
+        data->call_capacity =
+            data->call_capacity ? data->call_capacity * 2 : 64;
+        data->calls = my_realloc(data->calls,
+                                 data->call_capacity * sizeof(object *));
+    }
+    data->calls[data->call_depth++] = form;
+}
+
+static void call_pop(parse_data *data) {
+    unref(data->calls[--data->call_depth]);
+}
+
+#ifndef MY_OS
+/*
+ * segments of heap stack: recursion in the evaluator is not bounded by the
+ * native stack, when little of it is left the evaluation continues on a
+ * new segment and returns to the previous one when done
+ */
+#define EVAL_SEGMENT_SIZE (1024 * 1024)
+/* what the deepest eval_from_ast leaves for the primitives it calls */
+#define EVAL_STACK_MARGIN (64 * 1024)
+/* the native stack used when the bounds of the thread's are not known */
+#define EVAL_NATIVE_STACK (512 * 1024)
+
+struct eval_segment_t {
+    ucontext_t ctx;
+    ucontext_t caller;
+    /* the evaluation run on it */
+    object *exp;
+    env *env;
+    parse_data *data;
+    object *ret;
+};
+
+/* makecontext passes ints, so the segment comes in two halves */
+static void eval_segment_main(u32 hi, u32 lo) {
+    eval_segment *s = (eval_segment *)((uintptr_t)hi << 32 | lo);
+    s->ret = eval_from_ast(s->exp, s->env, s->data);
+}
+
+static object *eval_on_segment(object *exp, env *env, parse_data *data) {
+    eval_segment *s = data->segment_spare;
+    data->segment_spare = NULL;
+    if (!s) {
+        s = my_malloc(sizeof(eval_segment) + EVAL_SEGMENT_SIZE);
+    }
+    s->exp = exp;
+    s->env = env;
+    s->data = data;
+
+    getcontext(&s->ctx);
+    s->ctx.uc_stack.ss_sp = s + 1;
+    s->ctx.uc_stack.ss_size = EVAL_SEGMENT_SIZE;
+    s->ctx.uc_link = &s->caller;
+    uintptr_t p = (uintptr_t)s;
+    makecontext(&s->ctx, (void (*)(void))eval_segment_main, 2, (u32)(p >> 32),
+                (u32)p);
+
+    char *limit = data->stack_limit;
+    data->stack_limit = (char *)(s + 1) + EVAL_STACK_MARGIN;
+    swapcontext(&s->caller, &s->ctx);
+    data->stack_limit = limit;
+
+    object *ret_val = s->ret;
+    my_free(data->segment_spare);
+    data->segment_spare = s;
+    return ret_val;
+}
+
+/* the stack of the calling thread, low and high are NULL when not known */
+static void thread_stack(char **low, char **high) {
+    static __thread char *stack_low, *stack_high;
+    static __thread bool known;
+    if (!known) {
+        pthread_attr_t attr;
+        void *addr;
+        size_t size;
+        if (!pthread_getattr_np(pthread_self(), &attr)) {
+            if (!pthread_attr_getstack(&attr, &addr, &size)) {
+                stack_low = addr;
+                stack_high = stack_low + size;
+            }
+            pthread_attr_destroy(&attr);
+        }
+        known = true;
+    }
+    *low = stack_low;
+    *high = stack_high;
+}
+#endif
+
+/*
+ * let the evaluations of data started below the caller move off the stack
+ * of the thread when little of it is left. on a segment or a generator
+ * stack the limit set for it is kept. returns the limit before, to give to
+ * eval_stack_leave
+ */
+char *eval_stack_enter(parse_data *data) {
+#ifndef MY_OS
+    char *limit = data->stack_limit;
+    char *frame = __builtin_frame_address(0);
+    char *low, *high;
+    thread_stack(&low, &high);
+    if (low && low < frame && frame < high) {
+        data->stack_limit = low + EVAL_STACK_MARGIN;
+    } else if (!low && !limit) {
+        data->stack_limit = frame - EVAL_NATIVE_STACK;
+    }
+    return limit;
+#else
+    (void)data;
+    return NULL;
+#endif
+}
+
+void eval_stack_leave(parse_data *data, char *limit) {
+#ifndef MY_OS
+    data->stack_limit = limit;
+#else
+    (void)data;
+    (void)limit;
+#endif
+}
+
+object *eval_list(object *expr, env *env, parse_data *data) {
+    if (expr->pair->cache == &TailCall) {
+        object *ret_val = loop_call(expr, env, data);
+        if (ret_val) {
+            unref(expr);
+            return ret_val;
+        }
+    }
+
+    object *operator= eval_from_ast(car(ref(expr)), env, data);
+    if (operator&& operator->type == T_ERR && operator->err->escape) {
+        unref(expr);
+        return operator;
+    }
+
+    if (operator&& !(operator->type &(T_PROCEDURE | T_MACRO_PROC))) {
+        object *err =
+            new_error("Exception: attempt to apply non-procedure %O", operator);
+        unref(operator);
+        unref(expr);
+        return err;
+    }
+
+    call_push(data, ref(expr));
+    object *operands = cdr(expr);
+    object *ret_val = proc_call(env, operator, operands, data);
+    call_pop(data);
+    return ret_val;
+}
+
+object *eval_from_ast(object *exp, env *env, parse_data *data) {
+    object *ret_val = NIL;
+#ifndef MY_OS
+    if ((char *)__builtin_frame_address(0) < data->stack_limit) {
+        return eval_on_segment(exp, env, data);
+    }
+#endif
+
+    if (!exp) {
+        ret_val = NIL;
+        /* unref(exp); */
+    } else if (exp->type == T_SYMBOL) {
+        ret_val = env_get(env, exp->symbol);
+        unref(exp);
+    } else if (exp->type == T_PAIR) {
+        ret_val = eval_list(exp, env, data);
+    } else {
+        ret_val = exp;
+    }
+    return ret_val;
+}
+
+void env_add_primitive(parse_data *data, env *env, char *name,
+                       primitive_proc_ptr *proc) {
+    env_put(env, lookup(data, name), new_primitive_proc(proc));
+}
+
+const char *object_type_name(object_type type) {
+    switch (type) {
+    case T_PRIMITIVE_PROC:
+    case T_COMPOUND_PROC:
+    case T_CONTINUATION:
+    case T_PROCEDURE:
+        return "procedure";
+    case T_NUMBER:
+        return "number";
+    case T_BOOLEAN:
+        return "boolean";
+    case T_SYMBOL:
+        return "symbol";
+    case T_PAIR:
+        return "pair";
+    case T_CHARACTER:
+        return "character";
+    case T_ERR:
+        return "error";
+    case T_GENERATOR:
+        return "generator";
+    default:
+        return "unknown";
+    }
+}
+
+const char *type_name(object *o) {
+    if (o == NIL) {
+        return "()";
+    }
+    return object_type_name(o->type);
+}
+
+object *primitive_define(env *e, object *args, parse_data *data) {
+    object *ret_val = NIL;
+
+    object *variable = car(ref(args));
+    object *value = NIL;
+    if (variable->type == T_SYMBOL) {
+        value = cdr(ref(args));
+        if (value != NIL) {
+            unref(value);
+            value = eval_from_ast(car(cdr(ref(args))), e, data);
+            ERROR_REF(value) {
+                unref(value);
+                ret_val = error;
+                goto ret;
+            }
+        } else {
+            unref(value);
+            value = NIL;
+        }
+    } else {
+        unref(variable);
+        variable = car(car(ref(args)));
+        ERROR(ASSERT(variable->type == T_SYMBOL, "invalid syntax")) {
+            ret_val = error;
+            goto ret;
+        }
+
+        object *template = form_template(args, cdr(car(ref(args))),
+                                         cdr(ref(args)), e, data);
+        ERROR_REF(template) {
+            unref(template);
+            ret_val = error;
+            goto ret;
+        }
+        value = new_compound_proc(e, template, data);
+    }
+
+    if (value && value->type == T_MACRO_PROC) {
+        data->macro_epoch++;
+    }
+    env_put(e, variable->symbol, value);
+
+ret:
+    unref(args);
+    unref(variable);
+
+    return ret_val;
+}
+
+object *is_type(object *o, object_type type) {
+    object *ret_val = NIL;
+
+    if (!o) {
+        if (type == T_NULL) {
+            ret_val = ref(&True);
+        } else {
+            ret_val = ref(&False);
+        }
+    } else if (o->type == T_ERR) {
+        ret_val = ref(o);
+    } else if (o->type & type) {
+        ret_val = ref(&True);
+    } else {
+        ret_val = ref(&False);
+    }
+
+    unref(o);
+    return ret_val;
+}
+
+object *assert_fun_args_count(char *fun, object *args, int count) {
+    if (object_list_len(args) != (size_t)count) {
+        return new_error("Exception: incorrect argument count in call %s", fun);
+    } else {
+        return NIL;
+    }
+}
+
+object *assert_fun_args_count_min(char *fun, object *args, int min) {
+    int size = object_list_len(args);
+    if (min > size) {
+        return new_error("Exception: incorrect argument count in call %s", fun);
+    } else {
+        return NIL;
+    }
+}
+
+object *primitive_is_type(env *e, object *args, char *func, object_type type,
+                          parse_data *data) {
+    ERROR(assert_fun_args_count(func, ref(args), 1)) {
+        unref(args);
+        return error;
+    }
+    return is_type(eval_from_ast(car(args), e, data), type);
+}
+
+object *primitive_is_boolean(env *e, object *args, parse_data *data) {
+    return primitive_is_type(e, args, "boolean?", T_BOOLEAN, data);
+}
+
+object *primitive_is_pair(env *e, object *args, parse_data *data) {
+    return primitive_is_type(e, args, "pair?", T_PAIR, data);
+}
+
+object *primitive_is_null(env *e, object *args, parse_data *data) {
+    return primitive_is_type(e, args, "null?", T_NULL, data);
+}
+
+object *primitive_is_number(env *e, object *args, parse_data *data) {
+    return primitive_is_type(e, args, "number?", T_NUMBER, data);
+}
+
+object *primitive_is_complex(env *e, object *args, parse_data *data) {
+    return primitive_is_number(e, args, data);
+}
+
+typedef bool number_pred(number *);
+
+object *primitive_is_number_pred(env *e, object *args, parse_data *data,
+                                 number_pred pred) {
+    object *ret = primitive_is_number(e, ref(args), data);
+    if (ret != &True) {
+        unref(args);
+        return ret;
+    }
+    unref(ret);
+
+    object *o = eval_from_ast(car(args), e, data);
+    number *number = o->number;
+
+    if (pred(number)) {
+        ret = ref(&True);
+    } else {
+        ret = ref(&False);
+    }
+
+    unref(o);
+    return ret;
+}
+
+bool number_pred_real(number *n) { return !n->flag.complex; }
+
+object *primitive_is_real(env *e, object *args, parse_data *data) {
+    return primitive_is_number_pred(e, args, data, number_pred_real);
+}
+
+bool number_pred_rational(number *n) {
+    return !n->flag.complex && n->flag.exact_zip & 0x0f;
+}
+
+object *primitive_is_rational(env *e, object *args, parse_data *data) {
+    return primitive_is_number_pred(e, args, data, number_pred_rational);
+}
+
+bool number_pred_integer(number *n) { return !n->flag.naninf; }
+object *primitive_is_integer(env *e, object *args, parse_data *data) {
+    return primitive_is_number_pred(e, args, data, number_pred_integer);
+}
+
+object *primitive_is_string(env *e, object *args, parse_data *data) {
+    return primitive_is_type(e, args, "string?", T_STRING, data);
+}
+
+object *primitive_is_procedure(env *e, object *args, parse_data *data) {
+    return primitive_is_type(e, args, "procedure?", T_PROCEDURE, data);
+}
+
+object *primitive_is_symbol(env *e, object *args, parse_data *data) {
+    return primitive_is_type(e, args, "symbol?", T_SYMBOL, data);
+}
+
+object *primitive_is_error(env *e, object *args, parse_data *data) {
+    ERROR(assert_fun_args_count("error?", ref(args), 1)) {
+        unref(args);
+        return error;
+    }
+
+    object *ret_val = NIL;
+    object *param = eval_from_ast(car(args), e, data);
+    if (param && param->type == T_ERR && param->err->escape) {
+        return param;
+    }
+    if (param && param->type == T_ERR) {
+        ret_val = ref(&True);
+    } else {
+        ret_val = ref(&False);
+    }
+    unref(param);
+    return ret_val;
+}
+
+/*
+ * (backtrace) the source forms being evaluated, innermost first, special
+ * forms like if and begin too. they are the forms as read, without the
+ * values of their arguments or their environments
+ */
+object *primitive_backtrace(env *e, object *args, parse_data *data) {
+    (void)e;
+    ERROR(assert_fun_args_count("backtrace", ref(args), 0)) {
+        unref(args);
+        return error;
+    }
+    unref(args);
+
+    object *ret_val = NIL;
+    for (u32 i = 0; i < data->call_depth; i++) {
+        ret_val = cons(ref(data->calls[i]), ret_val);
+    }
+    return ret_val;
+}
+
+object *primitive_quote(env *e, object *args, parse_data *data) {
+    if (!args) {
+        /* unref(args); */
+        return NIL;
+    }
+    ERROR(assert_fun_args_count("quote", ref(args), 1)) {
+        unref(args);
+        return error;
+    }
+    return car(args);
+}
+
+object *primitive_if(env *e, object *args, parse_data *data) {
+    object *ret_val = NIL;
+
+    size_t arg_len = object_list_len(ref(args));
+
+    ERROR(ASSERT(2 <= arg_len && arg_len <= 3, "Exception: invalid syntax")) {
+        ret_val = error;
+        goto ret;
+    }
+
+    object *test = eval_from_ast(car(ref(args)), e, data);
+    object *consequent = car(cdr(ref(args)));
+    object *alternate = arg_len == 3 ? car(cdr(cdr(ref(args)))) : NIL;
+
+    ERROR_REF(test) {
+        unref(test);
+        unref(consequent);
+        unref(alternate);
+        ret_val = error;
+        goto ret;
+    }
+    if (test != &False) {
+        // true
+        unref(alternate);
+        ret_val = eval_from_ast(consequent, e, data);
+    } else {
+        // false
+        unref(consequent);
+        ret_val = alternate ? eval_from_ast(alternate, e, data) : NIL;
+    }
+    unref(test);
+
+ret:
+    unref(args);
+    return ret_val;
+}
+
+bool object_symbol_equal(object *sym, char *s) {
+    if (!sym || sym->type != T_SYMBOL) {
+        unref(sym);
+        return false;
+    }
+
+    bool ret_val = false;
+    if (!strcmp(sym->symbol->name, s)) {
+        ret_val = true;
+    } else {
+        ret_val = false;
+    }
+    unref(sym);
+    return ret_val;
+}
+
+object *make_if(object *test, object *consequent, object *alternate,
+                parse_data *data) {
+    /* assert(consequent); */
+
+    object *ret_val;
+    object *sym_if = new_symbol(lookup(data, "if"));
+    if (alternate) {
+        ret_val =
+            cons(sym_if, cons(test, cons(consequent, cons(alternate, NIL))));
+    } else {
+        ret_val = cons(sym_if, cons(test, cons(consequent, NIL)));
+    }
+    return ret_val;
+}
+
+object *primitive_cond(env *e, object *args, parse_data *data) {
+    object *ret_val = NIL;
+
+    object *clause = NIL;
+
+    object *sym_begin = new_symbol(lookup(data, "begin"));
+
+    object *test = NIL;
+    object *consequent = NIL;
+    object *ptr = NIL;
+
+    object *cond_to_if = NIL;
+
+    for_each_object_list_entry(clause, args) {
+        test = car(ref(clause));
+        if (object_symbol_equal(ref(test), "else")) {
+            object *rest = cdr(ref(idx));
+            ERROR(ASSERT(!rest, "else clause isn't last")) {
+                unref(idx);
+                unref(clause);
+
+                unref(rest);
+                unref(test);
+
+                ret_val = error;
+                goto ret;
+            }
+            /* unref(rest); */
+
+            object *expression = cons(ref(sym_begin), cdr(ref(clause)));
+            if (!cond_to_if) {
+                cond_to_if = expression;
+            } else {
+                setcdr(ref(ptr), cons(expression, NIL));
+            }
+            unref(idx);
+            unref(clause);
+            unref(test);
+            break;
+        }
+
+        /* test = eval(test, e, data); */
+        object *arrow = car(cdr(ref(clause)));
+        if (object_symbol_equal(arrow, "=>")) {
+            // (<test> => <expression>)
+            // expression = procedure object
+            // TODO: impl
+            ERROR(ASSERT(object_list_len(ref(clause)) == 3,
+                         "Exception: misplaced aux keyword =>")) {
+                unref(idx);
+                unref(clause);
+
+                ret_val = error;
+                goto ret;
+            }
+
+            consequent = cons(car(cdr(cdr(ref(clause)))), test);
+        } else {
+            // (<test> => <expression>*)
+            consequent = cons(ref(sym_begin), cdr(ref(clause)));
+        }
+
+        if (!cond_to_if) {
+            cond_to_if = make_if(test, consequent, NIL, data);
+            ptr = cdr(cdr(ref(cond_to_if)));
+        } else {
+            setcdr(ref(ptr), cons(make_if(test, consequent, NIL, data), NIL));
+            ptr = cdr(cdr(car(cdr(ptr))));
+        }
+    }
+
+    ret_val = eval_from_ast(ref(cond_to_if), e, data);
+
+ret:
+    unref(cond_to_if);
+    unref(ptr);
+    unref(args);
+    unref(sym_begin);
+
+    return ret_val;
+}
+
+object *primitive_begin(env *e, object *args, parse_data *data) {
+    object *ret_val = NIL;
+    object *result = NIL;
+    object *form = NIL;
+    for_each_object_list_entry(form, args) {
+        object *o = eval_from_ast(ref(form), e, data);
+        ERROR_REF(o) {
+            ret_val = error;
+            goto loop_exit;
+        }
+
+        unref(result);
+        result = ref(o);
+
+        unref(o);
+        continue;
+    loop_exit:
+        unref(idx);
+        unref(form);
+        unref(o);
+        unref(result);
+        goto error;
+    }
 
+    ret_val = result;
+ error:
+    unref(args);
     return ret_val;
 }
 
-object *proc_call(env *e, object *func, object *args, parse_data *data) {
-    object *ret_val = NIL;
-
-    switch (func->type) {
-    case T_PRIMITIVE_PROC:
-        ret_val = func->primitive_proc->proc(e, ref(args), data);
-        break;
-    case T_COMPOUND_PROC:
-        ret_val = compound_proc_call(e, ref(func), ref(args), data);
-        break;
-    case T_MACRO_PROC:
-        ret_val = macro_proc_call(e, ref(func), ref(args), data);
-        break;
-    default:
-        ret_val = new_error("Exception: func type is not supported");
-        break;
+/*
+ * exceptions. raise calls the innermost handler with the outer ones
+ * installed. at a guard, or with no handler left, the raise becomes an
+ * error returned up the evaluation like any other, which the guard takes.
+ */
+static object *apply_1(env *e, object *proc, object *arg, parse_data *data) {
+    lambda_template *template = proc->type == T_COMPOUND_PROC
+                                    ? proc->compound_proc->template->template
+                                    : NULL;
+    if (!template || template->param_count + !!template->varg != 1) {
+        object *quoted =
+            cons(new_symbol(lookup(data, "quote")), cons(arg, NIL));
+        return proc_call(e, proc, cons(quoted, NIL), data);
     }
 
-    unref(func);
-    unref(args);
+    /* bound directly, as an error passed through quote would be propagated */
+    env *frame = new_env_sized(proc->compound_proc->env,
+                               1 + template->defines.count);
+    frame->template = ref(proc->compound_proc->template);
+    if (template->param_count) {
+        env_put(frame, template->params[0], arg);
+    } else {
+        env_put(frame, template->varg, cons(arg, NIL));
+    }
+    object *ret_val = template_eval(&frame, data);
+    env_release_frame(frame);
+    unref(proc);
     return ret_val;
 }
 
-object *eval_list(object *expr, env *env, parse_data *data) {
-    object *operator= eval_from_ast(car(ref(expr)), env, data);
+/* the error that carries obj up to a guard or out of the evaluation */
+static object *raised_error(object *obj) {
+    object *err = obj;
+    if (!obj || obj->type != T_ERR) {
+        err = new_error("Exception: uncaught raise of %O", obj);
+        err->err->payload = obj;
+    }
+    err->err->raised = true;
+    return err;
+}
 
-    if (operator&& !(operator->type &(T_PROCEDURE | T_MACRO_PROC))) {
-        char *s = to_string(operator);
-        object *err =
-            new_error("Exception: attempt to apply non-procedure %s", s);
-        my_free(s);
-        unref(expr);
-        return err;
+/* offer obj to the first of handlers, in the dynamic environment of raise */
+static object *raise_to(env *e, object *handlers, object *obj, bool continuable,
+                        parse_data *data) {
+    while (handlers && handlers->pair->car == &HandlersLink) {
+        handlers = handlers->pair->cdr;
+    }
+    if (!handlers || !handlers->pair->car) {
+        return raised_error(obj);
     }
 
-    object *operands = cdr(expr);
-    return proc_call(env, operator, operands, data);
+    object *saved = data->handlers;
+    data->handlers = ref(handlers->pair->cdr);
+    object *ret = apply_1(e, ref(handlers->pair->car), ref(obj), data);
+    unref(data->handlers);
+    data->handlers = saved;
+
+    if (continuable || (ret && ret->type == T_ERR)) {
+        unref(obj);
+        return ret;
+    }
+    unref(ret);
+    object *err =
+        new_error("Exception: handler returned from raise of %O", obj);
+    unref(obj);
+    return raise_to(e, handlers->pair->cdr, err, false, data);
 }
 
-object *eval_from_ast(object *exp, env *env, parse_data *data) {
-    object *ret_val = NIL;
+static object *primitive_raise_with(env *e, object *args, char *name,
+                                    bool continuable, parse_data *data) {
+    ERROR(assert_fun_args_count(name, ref(args), 1)) {
+        unref(args);
+        return error;
+    }
 
-    if (!exp) {
-        ret_val = NIL;
-        /* unref(exp); */
-    } else if (exp->type == T_SYMBOL) {
-        ret_val = env_get(env, exp->symbol);
-        unref(exp);
-    } else if (exp->type == T_PAIR) {
-        ret_val = eval_list(exp, env, data);
-    } else {
-        ret_val = exp;
+    object *obj = eval_from_ast(car(args), e, data);
+    ERROR_REF(obj) {
+        unref(obj);
+        return error;
     }
-    return ret_val;
+    return raise_to(e, data->handlers, obj, continuable, data);
 }
 
-void env_add_primitive(parse_data *data, env *env, char *name,
-                       primitive_proc_ptr *proc) {
-    env_put(env, lookup(data, name), new_primitive_proc(proc));
+object *primitive_raise(env *e, object *args, parse_data *data) {
+    return primitive_raise_with(e, args, "raise", false, data);
 }
 
-const char *object_type_name(object_type type) {
-    switch (type) {
-    case T_PRIMITIVE_PROC:
-    case T_COMPOUND_PROC:
-        return "procedure";
-    case T_NUMBER:
-        return "number";
-    case T_BOOLEAN:
-        return "boolean";
-    case T_SYMBOL:
-        return "symbol";
-    case T_PAIR:
-        return "pair";
-    case T_CHARACTER:
-        return "character";
-    case T_ERR:
-        return "error";
-    default:
-        return "unknown";
-    }
+object *primitive_raise_continuable(env *e, object *args, parse_data *data) {
+    return primitive_raise_with(e, args, "raise-continuable", true, data);
 }
 
-const char *type_name(object *o) {
-    if (o == NIL) {
-        return "()";
+object *primitive_with_exception_handler(env *e, object *args,
+                                         parse_data *data) {
+    char *name = "with-exception-handler";
+    ERROR(assert_fun_args_count(name, ref(args), 2)) {
+        unref(args);
+        return error;
     }
-    return object_type_name(o->type);
-}
 
-object *primitive_define(env *e, object *args, parse_data *data) {
-    object *ret_val = NIL;
+    object *handler = eval_from_ast(car(ref(args)), e, data);
+    ERROR(assert_fun_arg_type(name, ref(handler), 0, T_PROCEDURE)) {
+        unref(handler);
+        unref(args);
+        return error;
+    }
+    object *thunk = eval_from_ast(car(cdr(args)), e, data);
+    ERROR(assert_fun_arg_type(name, ref(thunk), 1, T_PROCEDURE)) {
+        unref(handler);
+        unref(thunk);
+        return error;
+    }
 
-    object *variable = car(ref(args));
-    object *value = NIL;
-    if (variable->type == T_SYMBOL) {
-        value = cdr(ref(args));
-        if (value != NIL) {
-            unref(value);
-            value = eval_from_ast(car(cdr(ref(args))), e, data);
-        } else {
-            unref(value);
-            value = NIL;
-        }
-    } else {
-        unref(variable);
-        variable = car(car(ref(args)));
-        ERROR(ASSERT(variable->type == T_SYMBOL, "invalid syntax")) {
-            ret_val = error;
-            goto ret;
+    object *outer = data->handlers;
+    object *installed = cons(handler, ref(outer));
+    data->handlers = ref(installed);
+    object *ret = proc_call(e, thunk, NIL, data);
+    unref(data->handlers);
+    data->handlers = outer;
+
+    if (ret && ret->type == T_ERR && !ret->err->raised &&
+        !ret->err->escape) {
+        /* an error of the evaluator is offered once it gets here */
+        ret = raise_to(e, installed, ret, false, data);
+    }
+    unref(installed);
+    return ret;
+}
+
+/* the clauses of a guard, evaluated in frame; *matched when one applied */
+static object *guard_clauses(env *frame, object *clauses, bool *matched,
+                             parse_data *data) {
+    for (; clauses && clauses->type == T_PAIR; clauses = clauses->pair->cdr) {
+        object *clause = clauses->pair->car;
+        ERROR(ASSERT(clause && clause->type == T_PAIR,
+                     "invalid syntax guard")) {
+            *matched = true;
+            return error;
         }
 
-        object *params = cdr(car(ref(args)));
-        object *begin = new_symbol(lookup(data, "begin"));
-        object *body = cons(begin, cdr(ref(args)));
+        object *test = object_symbol_equal(ref(clause->pair->car), "else")
+                           ? ref(&True)
+                           : eval_from_ast(ref(clause->pair->car), frame, data);
+        if (test == &False) {
+            unref(test);
+            continue;
+        }
+        *matched = true;
 
-        env *env = new_env();
-        env->parent = e;
-        value = new_compound_proc(env, params, body);
-        ERROR(ref(value)) {
-            unref(value);
-            ret_val = error;
-            goto ret;
+        object *body = clause->pair->cdr;
+        ERROR_REF(test) {
+            unref(test);
+            return error;
+        }
+        if (!body) {
+            return test;
+        }
+        if (body->type == T_PAIR &&
+            object_symbol_equal(ref(body->pair->car), "=>")) {
+            object *receiver = eval_from_ast(car(cdr(ref(body))), frame, data);
+            ERROR_REF(receiver) {
+                unref(receiver);
+                unref(test);
+                return error;
+            }
+            return apply_1(frame, receiver, test, data);
         }
+        unref(test);
+        return primitive_begin(frame, ref(body), data);
     }
-
-    env_put(e, variable->symbol, value);
-
-ret:
-    unref(args);
-    unref(variable);
-
-    return ret_val;
+    return NIL;
 }
 
-object *is_type(object *o, object_type type) {
-    object *ret_val = NIL;
+/* (guard (var clause ...) body ...) */
+object *primitive_guard(env *e, object *args, parse_data *data) {
+    object *spec = args && args->type == T_PAIR ? args->pair->car : NIL;
+    ERROR(ASSERT(spec && spec->type == T_PAIR && spec->pair->car &&
+                     spec->pair->car->type == T_SYMBOL,
+                 "invalid syntax guard")) {
+        unref(args);
+        return error;
+    }
 
-    if (!o) {
-        if (type == T_NULL) {
-            ret_val = ref(&True);
-        } else {
-            ret_val = ref(&False);
-        }
-    } else if (o->type == T_ERR) {
-        ret_val = ref(o);
-    } else if (o->type & type) {
-        ret_val = ref(&True);
-    } else {
-        ret_val = ref(&False);
+    object *outer = data->handlers;
+    data->handlers = cons(NIL, ref(outer));
+    object *ret = primitive_begin(e, cdr(ref(args)), data);
+    unref(data->handlers);
+    data->handlers = outer;
+    if (!ret || ret->type != T_ERR || ret->err->escape) {
+        unref(args);
+        return ret;
     }
 
-    unref(o);
-    return ret_val;
-}
+    object *condition = ref(ret->err->payload ? ret->err->payload : ret);
+    env *frame = new_env_sized(e, 1);
+    env_put(frame, spec->pair->car->symbol, ref(condition));
+    bool matched = false;
+    object *result = guard_clauses(frame, spec->pair->cdr, &matched, data);
+    env_release_frame(frame);
 
-object *assert_fun_args_count(char *fun, object *args, int count) {
-    if (object_list_len(args) != (size_t)count) {
-        return new_error("Exception: incorrect argument count in call %s", fun);
-    } else {
-        return NIL;
+    if (!matched) {
+        /* nothing took it, on to the handlers outside */
+        result = raise_to(e, data->handlers, ref(condition), true, data);
     }
+    unref(condition);
+    unref(ret);
+    unref(args);
+    return result;
 }
 
-object *assert_fun_args_count_min(char *fun, object *args, int min) {
-    int size = object_list_len(args);
-    if (min > size) {
-        return new_error("Exception: incorrect argument count in call %s", fun);
-    } else {
-        return NIL;
-    }
-}
+/* the formats of the errors made by error, to give their parts back */
+static const char user_error_fmt[] = "Exception: %s";
+static const char user_error_irritants_fmt[] = "Exception: %s %O";
 
-object *primitive_is_type(env *e, object *args, char *func, object_type type,
-                          parse_data *data) {
-    ERROR(assert_fun_args_count(func, ref(args), 1)) {
+/* (error message irritant ...) raises a new error object */
+object *primitive_error(env *e, object *args, parse_data *data) {
+    ERROR(assert_fun_args_count_min("error", ref(args), 1)) {
         unref(args);
         return error;
     }
-    return is_type(eval_from_ast(car(args), e, data), type);
-}
-
-object *primitive_is_boolean(env *e, object *args, parse_data *data) {
-    return primitive_is_type(e, args, "boolean?", T_BOOLEAN, data);
-}
 
-object *primitive_is_pair(env *e, object *args, parse_data *data) {
-    return primitive_is_type(e, args, "pair?", T_PAIR, data);
-}
+    object *message = eval_from_ast(car(ref(args)), e, data);
+    ERROR(assert_fun_arg_type("error", ref(message), 0, T_STRING)) {
+        unref(message);
+        unref(args);
+        return error;
+    }
 
-object *primitive_is_null(env *e, object *args, parse_data *data) {
-    return primitive_is_type(e, args, "null?", T_NULL, data);
+    object *irritants = NIL;
+    object **tail = &irritants;
+    object *operands = cdr(args);
+    object *operand = NIL;
+    for_each_object_list_entry(operand, operands) {
+        object *o = eval_from_ast(ref(operand), e, data);
+        ERROR_REF(o) {
+            unref(idx);
+            unref(operand);
+            unref(o);
+            unref(operands);
+            unref(irritants);
+            unref(message);
+            return error;
+        }
+        *tail = cons(o, NIL);
+        tail = &(*tail)->pair->cdr;
+    }
+    unref(operands);
+
+    object *err =
+        irritants ? new_error(user_error_irritants_fmt, message->str->str_p,
+                              irritants)
+                  : new_error(user_error_fmt, message->str->str_p);
+    unref(irritants);
+    unref(message);
+    return raise_to(e, data->handlers, err, false, data);
 }
 
-object *primitive_is_number(env *e, object *args, parse_data *data) {
-    return primitive_is_type(e, args, "number?", T_NUMBER, data);
-}
+object *primitive_error_object_message(env *e, object *args,
+                                       parse_data *data) {
+    ERROR(assert_fun_args_count("error-object-message", ref(args), 1)) {
+        unref(args);
+        return error;
+    }
+    object *o = eval_from_ast(car(args), e, data);
+    ERROR(assert_fun_arg_type("error-object-message", ref(o), 0, T_ERR)) {
+        unref(o);
+        return error;
+    }
 
-object *primitive_is_complex(env *e, object *args, parse_data *data) {
-    return primitive_is_number(e, args, data);
+    error *err = o->err;
+    const char *message = err->fmt == user_error_fmt ||
+                                  err->fmt == user_error_irritants_fmt
+                              ? err->args[0].s
+                              : error_message(err);
+    object *ret_val = new_string(make_string((char *)message, strlen(message)));
+    unref(o);
+    return ret_val;
 }
 
-typedef bool number_pred(number *);
-
-object *primitive_is_number_pred(env *e, object *args, parse_data *data,
-                                 number_pred pred) {
-    object *ret = primitive_is_number(e, ref(args), data);
-    if (ret == &False) {
-        return ret;
+object *primitive_error_object_irritants(env *e, object *args,
+                                         parse_data *data) {
+    ERROR(assert_fun_args_count("error-object-irritants", ref(args), 1)) {
+        unref(args);
+        return error;
     }
-    unref(ret);
-
     object *o = eval_from_ast(car(args), e, data);
-    number *number = o->number;
-
-    if (pred(number)) {
-        ret = ref(&True);
-    } else {
-        ret = ref(&False);
+    ERROR(assert_fun_arg_type("error-object-irritants", ref(o), 0, T_ERR)) {
+        unref(o);
+        return error;
     }
 
+    object *ret_val =
+        o->err->fmt == user_error_irritants_fmt ? ref(o->err->args[1].o) : NIL;
     unref(o);
-    return ret;
+    return ret_val;
 }
 
-bool number_pred_real(number *n) { return !n->flag.complex; }
+/*
+ * escape continuations. applying one returns an error marked with it and
+ * carrying the value, which every caller passes up as it does any error,
+ * until the call/ec that made it takes it. guard and the exception
+ * handlers let it through. a continuation can only escape out of its
+ * call/ec while that runs, it is never resumed later, so there is no call/cc
+ */
+object *continuation_call(env *e, object *k, object *args, parse_data *data) {
+    ERROR(assert_fun_args_count("continuation", ref(args), 1)) {
+        unref(k);
+        unref(args);
+        return error;
+    }
+    object *value = eval_from_ast(car(args), e, data);
+    ERROR_REF(value) {
+        unref(value);
+        unref(k);
+        return error;
+    }
 
-object *primitive_is_real(env *e, object *args, parse_data *data) {
-    return primitive_is_number_pred(e, args, data, number_pred_real);
+    if (!k->continuation_active) {
+        object *err = new_error(
+            "Exception: continuation called after its call/ec returned");
+        unref(value);
+        unref(k);
+        return err;
+    }
+    object *err = new_error("Exception: continuation escaped");
+    err->err->escape = k;
+    err->err->payload = value;
+    return err;
 }
 
-bool number_pred_rational(number *n) {
-    return !n->flag.complex && n->flag.exact_zip & 0x0f;
-}
+object *primitive_call_ec(env *e, object *args, parse_data *data) {
+    ERROR(assert_fun_args_count("call/ec", ref(args), 1)) {
+        unref(args);
+        return error;
+    }
+    object *proc = eval_from_ast(car(args), e, data);
+    ERROR(assert_fun_arg_type("call/ec", ref(proc), 0, T_PROCEDURE)) {
+        unref(proc);
+        return error;
+    }
 
-object *primitive_is_rational(env *e, object *args, parse_data *data) {
-    return primitive_is_number_pred(e, args, data, number_pred_rational);
+    object *k = new_object(T_CONTINUATION);
+    k->continuation_active = true;
+    object *ret_val = apply_1(e, proc, ref(k), data);
+    k->continuation_active = false;
+
+    if (ret_val && ret_val->type == T_ERR && ret_val->err->escape == k) {
+        object *value = ref(ret_val->err->payload);
+        unref(ret_val);
+        ret_val = value;
+    }
+    unref(k);
+    return ret_val;
+}
+
+#ifndef MY_OS
+/*
+ * generators run their thunk on a stack of their own and are switched to
+ * and back with swapcontext. what the evaluator keeps in last in first out
+ * order is exchanged for the generator's own on each switch. the stack is
+ * mapped with an inaccessible page below it and only takes memory as it is
+ * used, deeper evaluation moves to segments like anywhere else
+ */
+#define GENERATOR_STACK_SIZE (1024 * 1024)
+
+typedef struct eval_state_t {
+    env_stack_chunk *env_stack;
+    loop_state *loop;
+    object *handlers;
+    object **calls;
+    u32 call_depth;
+    u32 call_capacity;
+    char *stack_limit;
+    object *generator;
+} eval_state;
+
+enum generator_status {
+    GENERATOR_NEW,
+    GENERATOR_SUSPENDED,
+    GENERATOR_RUNNING,
+    GENERATOR_DONE,
+};
+
+struct generator_t {
+    ucontext_t ctx;
+    ucontext_t caller;
+    enum generator_status status;
+    /* resumed to unwind, as it is freed while suspended */
+    bool closing;
+    object *thunk;
+    parse_data *data;
+    /* the evaluator state of whichever side is not running */
+    eval_state state;
+    /* handed over by yield and by the end of the thunk */
+    object *value;
+    /* the mapping, its first page is the guard */
+    char *stack;
+    size_t stack_guard;
+    /*
+     * the last pair of the generator's handlers. while it runs the rest are
+     * the handlers of the next that resumed it
+     */
+    object *handlers_link;
+};
+
+/* escaped to by yield when its generator is closed */
+static object GeneratorClose = {.type = T_NULL, .ref_count = 1};
+
+static object *generator_closed(void) {
+    object *err = new_error("Exception: generator closed");
+    err->err->escape = ref(&GeneratorClose);
+    return err;
 }
 
-bool number_pred_integer(number *n) { return !n->flag.naninf; }
-object *primitive_is_integer(env *e, object *args, parse_data *data) {
-    return primitive_is_number_pred(e, args, data, number_pred_integer);
+static void eval_state_swap(parse_data *data, eval_state *s) {
+    eval_state running = {
+        .env_stack = data->env_stack,
+        .loop = data->loop,
+        .handlers = data->handlers,
+        .calls = data->calls,
+        .call_depth = data->call_depth,
+        .call_capacity = data->call_capacity,
+        .stack_limit = data->stack_limit,
+        .generator = data->generator,
+    };
+    data->env_stack = s->env_stack;
+    data->loop = s->loop;
+    data->handlers = s->handlers;
+    data->calls = s->calls;
+    data->call_depth = s->call_depth;
+    data->call_capacity = s->call_capacity;
+    data->stack_limit = s->stack_limit;
+    data->generator = s->generator;
+    *s = running;
 }
 
-object *primitive_is_string(env *e, object *args, parse_data *data) {
-    return primitive_is_type(e, args, "string?", T_STRING, data);
+static void generator_main(u32 hi, u32 lo) {
+    object *g = (object *)((uintptr_t)hi << 32 | lo);
+    generator *gen = g->generator;
+    object *thunk = gen->thunk;
+    gen->thunk = NIL;
+    gen->value = proc_call(thunk->compound_proc->env, thunk, NIL, gen->data);
+    gen->status = GENERATOR_DONE;
 }
 
-object *primitive_is_procedure(env *e, object *args, parse_data *data) {
-    return primitive_is_type(e, args, "procedure?", T_PROCEDURE, data);
+/* the stack of gen below its guard page, false when it can not be mapped */
+static bool generator_map_stack(generator *gen) {
+    size_t guard = sysconf(_SC_PAGESIZE);
+    char *p = mmap(NULL, guard + GENERATOR_STACK_SIZE, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    if (mprotect(p + guard, GENERATOR_STACK_SIZE, PROT_READ | PROT_WRITE)) {
+        munmap(p, guard + GENERATOR_STACK_SIZE);
+        return false;
+    }
+    gen->stack = p;
+    gen->stack_guard = guard;
+    return true;
 }
 
-object *primitive_is_symbol(env *e, object *args, parse_data *data) {
-    return primitive_is_type(e, args, "symbol?", T_SYMBOL, data);
+/* what gen holds to run, once it is done or closed */
+static void generator_release(generator *gen) {
+    /* every frame has been popped, only the chunks are left */
+    env_stack_chunk *chunk = gen->state.env_stack;
+    while (chunk) {
+        env_stack_chunk *prev = chunk->prev;
+        my_free(chunk);
+        chunk = prev;
+    }
+    my_free(gen->state.calls);
+    unref(gen->state.handlers);
+    gen->state = (eval_state){};
+    if (gen->stack) {
+        munmap(gen->stack, gen->stack_guard + GENERATOR_STACK_SIZE);
+        gen->stack = NULL;
+    }
+    unref(gen->handlers_link);
+    gen->handlers_link = NIL;
 }
 
-object *primitive_is_error(env *e, object *args, parse_data *data) {
-    ERROR(assert_fun_args_count("error?", ref(args), 1)) {
-        unref(args);
-        return error;
+/* run g until it yields or returns, and take what it handed over */
+static object *generator_resume(object *g) {
+    generator *gen = g->generator;
+    if (gen->status == GENERATOR_NEW) {
+        if (!generator_map_stack(gen)) {
+            gen->status = GENERATOR_DONE;
+            return new_error("Exception: generator can not map a stack");
+        }
+        getcontext(&gen->ctx);
+        gen->ctx.uc_stack.ss_sp = gen->stack + gen->stack_guard;
+        gen->ctx.uc_stack.ss_size = GENERATOR_STACK_SIZE;
+        gen->ctx.uc_link = &gen->caller;
+        uintptr_t p = (uintptr_t)g;
+        makecontext(&gen->ctx, (void (*)(void))generator_main, 2,
+                    (u32)(p >> 32), (u32)p);
+        gen->state.stack_limit =
+            gen->stack + gen->stack_guard + EVAL_STACK_MARGIN;
+        gen->state.generator = g;
+        gen->handlers_link = cons(ref(&HandlersLink), NIL);
+        gen->state.handlers = ref(gen->handlers_link);
     }
 
-    object *ret_val = NIL;
-    object *param = eval_from_ast(car(args), e, data);
-    if (param && param->type == T_ERR) {
-        ret_val = ref(&True);
-    } else {
-        ret_val = ref(&False);
+    /* a raise the generator does not handle goes to the handlers of next */
+    setcdr(ref(gen->handlers_link), ref(gen->data->handlers));
+    gen->status = GENERATOR_RUNNING;
+    eval_state_swap(gen->data, &gen->state);
+    swapcontext(&gen->caller, &gen->ctx);
+    eval_state_swap(gen->data, &gen->state);
+    setcdr(ref(gen->handlers_link), NIL);
+
+    if (gen->status == GENERATOR_DONE) {
+        generator_release(gen);
     }
-    unref(param);
+    object *ret_val = gen->value;
+    gen->value = NIL;
     return ret_val;
 }
 
-object *primitive_quote(env *e, object *args, parse_data *data) {
-    if (!args) {
-        /* unref(args); */
-        return NIL;
+void free_generator(object *o) {
+    generator *gen = o->generator;
+    if (gen->status == GENERATOR_SUSPENDED) {
+        /*
+         * its yield returns an escape, which unwinds the frames it holds.
+         * yield keeps failing after, so the thunk can only return
+         */
+        gen->closing = true;
+        unref(generator_resume(o));
     }
-    ERROR(assert_fun_args_count("quote", ref(args), 1)) {
+    generator_release(gen);
+    unref(gen->thunk);
+    my_free(gen);
+}
+
+/* (make-generator thunk) */
+object *primitive_make_generator(env *e, object *args, parse_data *data) {
+    ERROR(assert_fun_args_count("make-generator", ref(args), 1)) {
         unref(args);
         return error;
     }
-    return car(args);
+    object *thunk = eval_from_ast(car(args), e, data);
+    ERROR(assert_fun_arg_type("make-generator", ref(thunk), 0,
+                              T_COMPOUND_PROC)) {
+        unref(thunk);
+        return error;
+    }
+
+    object *g = new_object(T_GENERATOR);
+    g->generator = my_malloc(sizeof(generator));
+    g->generator->thunk = thunk;
+    g->generator->data = data;
+    return g;
 }
 
-object *primitive_if(env *e, object *args, parse_data *data) {
-    object *ret_val = NIL;
+/* (yield obj) hands obj to the next that resumed the running generator */
+object *primitive_yield(env *e, object *args, parse_data *data) {
+    ERROR(assert_fun_args_count("yield", ref(args), 1)) {
+        unref(args);
+        return error;
+    }
+    ERROR(ASSERT(data->generator, "Exception: yield outside of a generator")) {
+        unref(args);
+        return error;
+    }
+    object *value = eval_from_ast(car(args), e, data);
+    ERROR_REF(value) {
+        unref(value);
+        return error;
+    }
 
-    size_t arg_len = object_list_len(ref(args));
+    generator *gen = data->generator->generator;
+    if (gen->closing) {
+        /* a body that took the escape does not get to suspend again */
+        unref(value);
+        return generator_closed();
+    }
+    gen->value = value;
+    gen->status = GENERATOR_SUSPENDED;
+    swapcontext(&gen->ctx, &gen->caller);
 
-    ERROR(ASSERT(2 <= arg_len && arg_len <= 3, "Exception: invalid syntax")) {
-        ret_val = error;
-        goto ret;
+    if (gen->closing) {
+        return generator_closed();
     }
+    return NIL;
+}
 
-    object *test = eval_from_ast(car(ref(args)), e, data);
-    object *consequent = car(cdr(ref(args)));
-    object *alternate = arg_len == 3 ? car(cdr(cdr(ref(args)))) : NIL;
+/*
+ * (next generator [default]) the value the generator yields next. once its
+ * thunk has returned, default, or an error without it
+ */
+object *primitive_next(env *e, object *args, parse_data *data) {
+    ERROR(assert_fun_args_count_min("next", ref(args), 1)) {
+        unref(args);
+        return error;
+    }
+    ERROR(ASSERT(object_list_len(ref(args)) <= 2,
+                 "Exception: incorrect argument count in call next")) {
+        unref(args);
+        return error;
+    }
 
-    ERROR(ref(test)) {
-        unref(test);
-        unref(consequent);
-        unref(alternate);
-        ret_val = error;
-        goto ret;
+    object *g = eval_from_ast(car(ref(args)), e, data);
+    ERROR(assert_fun_arg_type("next", ref(g), 0, T_GENERATOR)) {
+        unref(g);
+        unref(args);
+        return error;
     }
-    if (test != &False) {
-        // true
-        unref(alternate);
-        ret_val = eval_from_ast(consequent, e, data);
-    } else {
-        // false
-        unref(consequent);
-        ret_val = alternate ? eval_from_ast(alternate, e, data) : NIL;
+    generator *gen = g->generator;
+    ERROR(ASSERT(gen->status != GENERATOR_RUNNING,
+                 "Exception: generator is already running")) {
+        unref(g);
+        unref(args);
+        return error;
     }
-    unref(test);
 
-ret:
+    object *ret_val = NIL;
+    if (gen->status != GENERATOR_DONE) {
+        ret_val = generator_resume(g);
+    }
+    if (gen->status == GENERATOR_DONE) {
+        /* an error ending the thunk comes out of the next that saw it */
+        ERROR_REF(ret_val) {
+            unref(ret_val);
+            unref(g);
+            unref(args);
+            return error;
+        }
+        unref(ret_val);
+        object *rest = cdr(ref(args));
+        ret_val = rest ? eval_from_ast(car(rest), e, data)
+                       : new_error("Exception: generator is exhausted");
+    }
+    unref(g);
     unref(args);
     return ret_val;
 }
+#endif
 
-bool object_symbol_equal(object *sym, char *s) {
-    if (!sym || sym->type != T_SYMBOL) {
-        unref(sym);
+enum case_key_kind {
+    CASE_KEY_NONE = 0,
+    CASE_KEY_SYMBOL,
+    CASE_KEY_BOOLEAN,
+    CASE_KEY_NULL,
+    CASE_KEY_FIXNUM,
+    CASE_KEY_CHAR,
+};
+
+/* datums of these kinds are eqv? exactly when kind and value are equal */
+static u32 case_key(object *o, u64 *value) {
+    s64 fixnum;
+
+    if (!o) {
+        *value = 0;
+        return CASE_KEY_NULL;
+    }
+    switch (o->type) {
+    case T_SYMBOL:
+        *value = (u64)(size_t)o->symbol;
+        return CASE_KEY_SYMBOL;
+    case T_BOOLEAN:
+        *value = o->bool_val;
+        return CASE_KEY_BOOLEAN;
+    case T_CHARACTER:
+        *value = o->char_val;
+        return CASE_KEY_CHAR;
+    case T_NUMBER:
+        if (number_get_fixnum(o->number, &fixnum)) {
+            *value = fixnum;
+            return CASE_KEY_FIXNUM;
+        }
+        return CASE_KEY_NONE;
+    default:
+        return CASE_KEY_NONE;
+    }
+}
+
+static inline u64 case_hash(u64 value, u32 kind, int bits) {
+    return ((value ^ ((u64)kind << 59)) * 0x9e3779b97f4a7c15ULL) >>
+           (64 - bits);
+}
+
+static bool case_eqv(object *o1, object *o2) {
+    if (o1 == o2) {
+        return true;
+    }
+    if (!o1 || !o2 || o1->type != o2->type || o1->type != T_NUMBER) {
         return false;
     }
+    return number_eq(o1->number, o2->number);
+}
 
-    bool ret_val = false;
-    if (!strcmp(sym->symbol->name, s)) {
-        ret_val = true;
-    } else {
-        ret_val = false;
+void free_case_table(object *o) {
+    case_table *t = o->case_table;
+    for (int i = 0; i < t->clause_count; i++) {
+        unref(t->clauses[i].body);
     }
-    unref(sym);
-    return ret_val;
+    for (int i = 0; i < t->other_count; i++) {
+        unref(t->others[i]);
+    }
+    my_free(t->clauses);
+    my_free(t->entries);
+    my_free(t->dense);
+    my_free(t->others);
+    my_free(t->other_clauses);
+    my_free(t);
 }
 
-object *make_if(object *test, object *consequent, object *alternate,
-                parse_data *data) {
-    /* assert(consequent); */
+/* the first clause listing a datum wins */
+static void case_table_insert(case_table *t, u64 value, u32 kind,
+                              int clause) {
+    if (t->dense) {
+        u64 i = value - (u64)t->dense_min;
+        if (t->dense[i] < 0) {
+            t->dense[i] = clause;
+        }
+        return;
+    }
 
-    object *ret_val;
-    object *sym_if = new_symbol(lookup(data, "if"));
-    if (alternate) {
-        ret_val =
-            cons(sym_if, cons(test, cons(consequent, cons(alternate, NIL))));
-    } else {
-        ret_val = cons(sym_if, cons(test, cons(consequent, NIL)));
+    u64 mask = (1ULL << t->entry_bits) - 1;
+    u64 i = case_hash(value, kind, t->entry_bits);
+    for (; t->entries[i].kind; i = (i + 1) & mask) {
+        if (t->entries[i].kind == kind && t->entries[i].value == value) {
+            return;
+        }
     }
-    return ret_val;
+    t->entries[i] = (case_entry){.value = value, .kind = kind, .clause = clause};
 }
 
-object *primitive_cond(env *e, object *args, parse_data *data) {
-    object *ret_val = NIL;
-
-    object *clause = NIL;
+/* clause of the datum eqv? to key, or -1 */
+int case_table_lookup(case_table *t, object *key) {
+    u64 value;
+    u32 kind = case_key(key, &value);
 
-    object *sym_begin = new_symbol(lookup(data, "begin"));
+    if (!kind) {
+        for (int i = 0; i < t->other_count; i++) {
+            if (case_eqv(key, t->others[i])) {
+                return t->other_clauses[i];
+            }
+        }
+        return -1;
+    }
 
-    object *test = NIL;
-    object *consequent = NIL;
-    object *ptr = NIL;
+    if (t->dense) {
+        u64 i = value - (u64)t->dense_min;
+        return kind == t->dense_kind && i < t->dense_size ? t->dense[i] : -1;
+    }
+    if (!t->entries) {
+        return -1;
+    }
 
-    object *cond_to_if = NIL;
+    u64 mask = (1ULL << t->entry_bits) - 1;
+    for (u64 i = case_hash(value, kind, t->entry_bits); t->entries[i].kind;
+         i = (i + 1) & mask) {
+        if (t->entries[i].kind == kind && t->entries[i].value == value) {
+            return t->entries[i].clause;
+        }
+    }
+    return -1;
+}
 
-    for_each_object_list_entry(clause, args) {
-        test = car(ref(clause));
-        if (object_symbol_equal(ref(test), "else")) {
-            object *rest = cdr(ref(idx));
-            ERROR(ASSERT(!rest, "else clause isn't last")) {
-                unref(idx);
-                unref(clause);
+/* a range of fixnums or characters at most this sparse is indexed directly */
+#define CASE_DENSE_SLACK 2
+
+/*
+ * compile the clauses of (case key clause...) into a case_table, cached on
+ * the form
+ */
+object *case_table_get(object *args, parse_data *data) {
+    object *cache = args->pair->cache;
+    if (cache && cache->type == T_CASE_TABLE) {
+        return ref(cache);
+    }
 
-                unref(rest);
-                unref(test);
+    symbol *else_ = lookup(data, "else");
+    symbol *arrow = lookup(data, "=>");
+    int clause_count = 0;
+    int key_count = 0;
+    int other_count = 0;
+    u32 dense_kind = CASE_KEY_NONE;
+    s64 min = 0, max = 0;
+
+    object *clauses = args->pair->cdr;
+    object *ptr = clauses;
+    for (; ptr && ptr->type == T_PAIR; ptr = ptr->pair->cdr) {
+        object *clause = ptr->pair->car;
+        ERROR(ASSERT(clause && clause->type == T_PAIR && clause->pair->cdr &&
+                         clause->pair->cdr->type == T_PAIR,
+                     "invalid syntax case")) {
+            return error;
+        }
+        clause_count++;
 
-                ret_val = error;
-                goto ret;
+        object *body = clause->pair->cdr;
+        object *first = body->pair->car;
+        if (first && first->type == T_SYMBOL && first->symbol == arrow) {
+            ERROR(ASSERT(object_list_len(ref(body)) == 2,
+                         "invalid syntax case")) {
+                return error;
             }
-            /* unref(rest); */
+        }
 
-            object *expression = cons(ref(sym_begin), cdr(ref(clause)));
-            if (!cond_to_if) {
-                cond_to_if = expression;
-            } else {
-                setcdr(ref(ptr), cons(expression, NIL));
+        object *datums = clause->pair->car;
+        if (datums && datums->type == T_SYMBOL && datums->symbol == else_) {
+            ERROR(ASSERT(!ptr->pair->cdr, "else clause isn't last")) {
+                return error;
             }
-            unref(idx);
-            unref(clause);
-            unref(test);
-            break;
+            continue;
+        }
+        ERROR(ASSERT(!datums || datums->type == T_PAIR,
+                     "invalid syntax case")) {
+            return error;
         }
 
-        /* test = eval(test, e, data); */
-        object *arrow = car(cdr(ref(clause)));
-        if (object_symbol_equal(arrow, "=>")) {
-            // (<test> => <expression>)
-            // expression = procedure object
-            // TODO: impl
-            ERROR(ASSERT(object_list_len(ref(clause)) == 3,
-                         "Exception: misplaced aux keyword =>")) {
-                unref(idx);
-                unref(clause);
-
-                ret_val = error;
-                goto ret;
+        for (; datums && datums->type == T_PAIR; datums = datums->pair->cdr) {
+            u64 value;
+            u32 kind = case_key(datums->pair->car, &value);
+            if (!kind) {
+                other_count++;
+                continue;
             }
-
-            consequent = cons(car(cdr(cdr(ref(clause)))), test);
-        } else {
-            // (<test> => <expression>*)
-            consequent = cons(ref(sym_begin), cdr(ref(clause)));
+            if (!key_count) {
+                dense_kind = kind;
+                min = max = (s64)value;
+            } else if (kind != dense_kind) {
+                dense_kind = CASE_KEY_NONE;
+            }
+            if ((s64)value < min) {
+                min = (s64)value;
+            }
+            if ((s64)value > max) {
+                max = (s64)value;
+            }
+            key_count++;
         }
-
-        if (!cond_to_if) {
-            cond_to_if = make_if(test, consequent, NIL, data);
-            ptr = cdr(cdr(ref(cond_to_if)));
-        } else {
-            setcdr(ref(ptr), cons(make_if(test, consequent, NIL, data), NIL));
-            ptr = cdr(cdr(car(cdr(ptr))));
+        ERROR(ASSERT(!datums, "invalid syntax case")) {
+            return error;
         }
     }
+    ERROR(ASSERT(!ptr, "invalid syntax case")) {
+        return error;
+    }
 
-    ret_val = eval_from_ast(ref(cond_to_if), e, data);
+    case_table *t = my_malloc(sizeof(case_table));
+    t->clauses = my_malloc(sizeof(case_clause) * (clause_count + 1));
+    t->else_clause = -1;
+    if (other_count) {
+        t->others = my_malloc(sizeof(object *) * other_count);
+        t->other_clauses = my_malloc(sizeof(int) * other_count);
+    }
 
-ret:
-    unref(cond_to_if);
-    unref(ptr);
-    unref(args);
-    unref(sym_begin);
+    u64 range = (u64)max - (u64)min;
+    if ((dense_kind == CASE_KEY_FIXNUM || dense_kind == CASE_KEY_CHAR) &&
+        range < (u64)key_count * CASE_DENSE_SLACK) {
+        t->dense_kind = dense_kind;
+        t->dense_min = min;
+        t->dense_size = range + 1;
+        t->dense = my_malloc(sizeof(int) * t->dense_size);
+        for (u64 i = 0; i < t->dense_size; i++) {
+            t->dense[i] = -1;
+        }
+    } else if (key_count) {
+        t->entry_bits = 1;
+        while ((1 << t->entry_bits) < key_count * 2) {
+            t->entry_bits++;
+        }
+        t->entries = my_malloc(sizeof(case_entry) << t->entry_bits);
+    }
 
-    return ret_val;
-}
+    for (ptr = clauses; ptr; ptr = ptr->pair->cdr) {
+        object *clause = ptr->pair->car;
+        object *body = clause->pair->cdr;
+        int n = t->clause_count++;
 
-object *primitive_begin(env *e, object *args, parse_data *data) {
-    object *ret_val = NIL;
-    object *result = NIL;
-    object *form = NIL;
-    for_each_object_list_entry(form, args) {
-        object *o = eval_from_ast(ref(form), e, data);
-        ERROR(ref(o)) {
-            ret_val = error;
-            goto loop_exit;
+        t->clauses[n].body = ref(body);
+        t->clauses[n].arrow = body->pair->car &&
+                              body->pair->car->type == T_SYMBOL &&
+                              body->pair->car->symbol == arrow;
+
+        object *datums = clause->pair->car;
+        if (datums && datums->type == T_SYMBOL) {
+            t->else_clause = n;
+            continue;
+        }
+        for (; datums; datums = datums->pair->cdr) {
+            object *datum = datums->pair->car;
+            u64 value;
+            u32 kind = case_key(datum, &value);
+            if (kind) {
+                case_table_insert(t, value, kind, n);
+            } else {
+                t->others[t->other_count] = ref(datum);
+                t->other_clauses[t->other_count++] = n;
+            }
         }
+    }
 
-        unref(result);
-        result = ref(o);
+    object *o = new_object(T_CASE_TABLE);
+    o->case_table = t;
+    unref(args->pair->cache);
+    args->pair->cache = ref(o);
+    return o;
+}
 
-        unref(o);
-        continue;
-    loop_exit:
-        unref(idx);
-        unref(form);
-        unref(o);
-        unref(result);
-        goto error;
+object *primitive_case(env *e, object *args, parse_data *data) {
+    ERROR(ASSERT(args && args->type == T_PAIR, "invalid syntax case")) {
+        unref(args);
+        return error;
+    }
+
+    object *table = case_table_get(args, data);
+    ERROR_REF(table) {
+        unref(table);
+        unref(args);
+        return error;
     }
 
-    ret_val = result;
- error:
+    object *ret_val = NIL;
+    object *key = eval_from_ast(car(ref(args)), e, data);
+    ERROR_REF(key) {
+        unref(key);
+        ret_val = error;
+        goto ret;
+    }
+
+    case_table *t = table->case_table;
+    int n = case_table_lookup(t, key);
+    if (n < 0) {
+        n = t->else_clause;
+    }
+    if (n >= 0 && t->clauses[n].arrow) {
+        /* (receiver 'key) */
+        object *receiver = car(cdr(ref(t->clauses[n].body)));
+        object *quoted =
+            cons(new_symbol(lookup(data, "quote")), cons(ref(key), NIL));
+        ret_val = eval_from_ast(cons(receiver, cons(quoted, NIL)), e, data);
+    } else if (n >= 0) {
+        ret_val = primitive_begin(e, ref(t->clauses[n].body), data);
+    }
+    unref(key);
+
+ret:
+    unref(table);
     unref(args);
     return ret_val;
 }
@@ -1609,18 +4251,36 @@ object *primitive_cons(env *e, object *args, parse_data *data) {
         unref(args);
         return error;
     }
-    return cons(eval_from_ast(car(ref(args)), e, data),
-                eval_from_ast(car(cdr(args)), e, data));
+    object *a = eval_from_ast(car(ref(args)), e, data);
+    ERROR_REF(a) {
+        unref(a);
+        unref(args);
+        return error;
+    }
+    object *d = eval_from_ast(car(cdr(args)), e, data);
+    ERROR_REF(d) {
+        unref(d);
+        unref(a);
+        return error;
+    }
+    return cons(a, d);
 }
 
 object *primitive_lambda(env *e, object *args, parse_data *data) {
-    object *params = car(ref(args));
-    object *begin = new_symbol(lookup(data, "begin"));
-    object *body = cons(begin, cdr(args));
-    env *env = new_env();
-    env->parent = e;
+    ERROR(ASSERT(args && args->type == T_PAIR, "invalid syntax lambda")) {
+        unref(args);
+        return error;
+    }
+
+    object *template =
+        form_template(args, car(ref(args)), cdr(ref(args)), e, data);
+    unref(args);
+    ERROR_REF(template) {
+        unref(template);
+        return error;
+    }
 
-    return new_compound_proc(env, params, body);
+    return new_compound_proc(e, template, data);
 }
 
 object *primitive_define_syntax(env *e, object *args, parse_data *data) {
@@ -1666,15 +4326,24 @@ ret:
     return ret_val;
 }
 
-object *primitive_let(env *e, object *args, parse_data *data) {
+/*
+ * a let is analyzed like a lambda whose parameters are the bound variables,
+ * the template is cached on the let form
+ */
+object *let_template(env *e, object *args, parse_data *data) {
+    object *cache = args->pair->cache;
+    if (cache && cache->type == T_TEMPLATE) {
+        return ref(cache);
+    }
 
     object *ret_val = NIL;
 
     object *bindings = car(ref(args));
-    env *let_env = new_env();
+    object *vars = NIL;
+    object *ptr = NIL;
+    symbol_set seen = {};
 
     ERROR(ASSERT(!bindings || bindings->type == T_PAIR, "invalid syntax let")) {
-        unref(bindings);
         ret_val = error;
         goto ret;
     }
@@ -1689,48 +4358,396 @@ object *primitive_let(env *e, object *args, parse_data *data) {
 
         object *var = car(ref(binding));
 
-        ERROR(ASSERT(var && var->type == T_SYMBOL, "invalid syntax let")) {
+        ERROR(ASSERT(var && var->type == T_SYMBOL &&
+                         !symbol_set_has(&seen, var->symbol),
+                     "invalid syntax let")) {
             unref(var);
             ret_val = error;
             goto loop_err_ret1;
         }
+        symbol_set_push(&seen, var->symbol);
 
-        object *value = env_get(let_env, var->symbol);
-        ERROR(ASSERT(value && value->type == T_ERR, "invalid syntax let")) {
-            ret_val = error;
-            goto loop_err_ret2;
-        }
-        object *init = car(cdr(ref(binding)));
-        object *val = eval_from_ast(init, e, data);
-        ERROR(ref(val)) {
-            unref(val);
-            ret_val = error;
-            goto loop_err_ret2;
+        if (!vars) {
+            vars = cons(var, NIL);
+            ptr = ref(vars);
+        } else {
+            setcdr(ref(ptr), cons(var, NIL));
+            ptr = cdr(ptr);
         }
-        env_put(let_env, var->symbol, val);
-
-        unref(value);
-        unref(var);
         continue;
 
-    loop_err_ret2:
-        unref(value);
-        unref(var);
     loop_err_ret1:
         unref(binding);
         unref(idx);
+        unref(vars);
         goto ret;
     }
 
-    let_env->parent = e;
+    ret_val = form_template(args, vars, cdr(ref(args)), e, data);
+
+ret:
+    free_symbol_set(&seen);
+    unref(ptr);
+    unref(bindings);
+    return ret_val;
+}
+
+/*
+ * frame for the bindings of a let-like form, on the frame stack when the body
+ * cannot capture it; internal defines are reserved up front
+ */
+env *let_frame(env *e, object *template, parse_data *data) {
+    lambda_template *scope = template->template;
+    template_refresh(scope, e, data);
+    int capacity = scope->param_count + scope->defines.count;
+    env *frame = scope->makes_closure || scope->macro_use
+                     ? new_env_sized(e, capacity)
+                     : env_stack_push(data, e, capacity);
+    frame->template = template;
+    return frame;
+}
+
+void let_frame_release(env *frame, parse_data *data) {
+    if (frame->on_stack) {
+        env_stack_pop(data, frame);
+    } else {
+        env_release_frame(frame);
+    }
+}
+
+/*
+ * (let name bindings body...): the body runs as a loop in one frame, see
+ * loop_mark. name is only bound to a procedure when it is used otherwise.
+ */
+object *primitive_named_let(env *e, object *args, parse_data *data) {
+    object *ret_val = NIL;
+    symbol *name = args->pair->car->symbol;
+    object *rest = args->pair->cdr;
+
+    ERROR(ASSERT(rest && rest->type == T_PAIR, "invalid syntax let")) {
+        unref(args);
+        return error;
+    }
+
+    object *template = let_template(e, rest, data);
+    ERROR_REF(template) {
+        unref(template);
+        unref(args);
+        return error;
+    }
+
+    lambda_template *scope = template->template;
+    if (!scope->loop) {
+        scope_walk w;
+        scope_walk_init(&w, scope, e, data);
+        scope->loop_escapes = loop_mark(&w, name, rest->pair->car,
+                                        rest->pair->cdr);
+        scope->loop = name;
+    }
+
+    env *outer = e;
+    if (scope->loop_escapes) {
+        outer = new_env_sized(e, 1);
+        env_put(outer, name, make_compound_proc(env_ref(outer), ref(template)));
+    }
+
+    env *frame = let_frame(outer, template, data);
+
+    object *binding = NIL;
+    for_each_object_list_entry(binding, rest->pair->car) {
+        object *val = eval_from_ast(car(cdr(ref(binding))), e, data);
+        ERROR_REF(val) {
+            unref(val);
+            unref(binding);
+            unref(idx);
+            ret_val = error;
+            goto ret;
+        }
+        env_put(frame, binding->pair->car->symbol, val);
+    }
+
+    ret_val = template_eval(&frame, data);
+
+ret:
+    unref(args);
+    let_frame_release(frame, data);
+    if (outer != e) {
+        env_release_frame(outer);
+    }
+    return ret_val;
+}
+
+object *primitive_let(env *e, object *args, parse_data *data) {
+
+    object *ret_val = NIL;
+
+    ERROR(ASSERT(args && args->type == T_PAIR, "invalid syntax let")) {
+        unref(args);
+        return error;
+    }
+
+    if (args->pair->car && args->pair->car->type == T_SYMBOL) {
+        return primitive_named_let(e, args, data);
+    }
+
+    object *template = let_template(e, args, data);
+    ERROR_REF(template) {
+        unref(template);
+        unref(args);
+        return error;
+    }
+
+    env *let_env = let_frame(e, template, data);
+
+    object *binding = NIL;
+    for_each_object_list_entry(binding, args->pair->car) {
+        object *var = car(ref(binding));
+        object *val = eval_from_ast(car(cdr(ref(binding))), e, data);
+        ERROR_REF(val) {
+            unref(val);
+            unref(var);
+            unref(binding);
+            unref(idx);
+            ret_val = error;
+            goto ret;
+        }
+        env_put(let_env, var->symbol, val);
+        unref(var);
+    }
 
     object *body = cdr(ref(args));
     ret_val = primitive_begin(let_env, body, data);
 
 ret:
-    unref(bindings);
     unref(args);
-    free_env(let_env);
+    let_frame_release(let_env, data);
+    return ret_val;
+}
+
+/* append o to the list whose last pair is *ptr */
+static void list_builder_push(object **list, object **ptr, object *o) {
+    if (!*list) {
+        *list = cons(o, NIL);
+        *ptr = ref(*list);
+    } else {
+        setcdr(ref(*ptr), cons(o, NIL));
+        *ptr = cdr(*ptr);
+    }
+}
+
+/*
+ * (letrec* ((var init)...) body...) is a body whose internal defines come
+ * first, the template keeps that body
+ */
+object *letrec_template(env *e, object *args, parse_data *data) {
+    object *cache = args->pair->cache;
+    if (cache && cache->type == T_TEMPLATE) {
+        return ref(cache);
+    }
+
+    object *bindings = args->pair->car;
+    object *body = NIL;
+    object *ptr = NIL;
+    symbol_set seen = {};
+
+    ERROR(ASSERT(!bindings || bindings->type == T_PAIR,
+                 "invalid syntax letrec")) {
+        return error;
+    }
+
+    for (; bindings && bindings->type == T_PAIR;
+         bindings = bindings->pair->cdr) {
+        object *b = bindings->pair->car;
+        ERROR(ASSERT(b && b->type == T_PAIR && b->pair->car &&
+                         b->pair->car->type == T_SYMBOL &&
+                         !symbol_set_has(&seen, b->pair->car->symbol) &&
+                         object_list_len(ref(b)) == 2,
+                     "invalid syntax letrec")) {
+            free_symbol_set(&seen);
+            unref(body);
+            unref(ptr);
+            return error;
+        }
+        symbol_set_push(&seen, b->pair->car->symbol);
+        list_builder_push(&body, &ptr,
+                          cons(new_symbol(lookup(data, "define")), ref(b)));
+    }
+    free_symbol_set(&seen);
+
+    if (ptr) {
+        setcdr(ref(ptr), cdr(ref(args)));
+    } else {
+        body = cdr(ref(args));
+    }
+    unref(ptr);
+
+    return form_template(args, NIL, body, e, data);
+}
+
+object *primitive_letrec(env *e, object *args, parse_data *data) {
+    ERROR(ASSERT(args && args->type == T_PAIR, "invalid syntax letrec")) {
+        unref(args);
+        return error;
+    }
+
+    object *template = letrec_template(e, args, data);
+    unref(args);
+    ERROR_REF(template) {
+        unref(template);
+        return error;
+    }
+
+    env *frame = let_frame(e, template, data);
+    object *ret_val = template_eval(&frame, data);
+    let_frame_release(frame, data);
+    return ret_val;
+}
+
+/*
+ * a do loop is analyzed like a let of its variables whose body holds the
+ * steps, the test clause and the commands
+ */
+object *do_template(env *e, object *args, parse_data *data) {
+    object *cache = args->pair->cache;
+    if (cache && cache->type == T_TEMPLATE) {
+        return ref(cache);
+    }
+
+    object *specs = args->pair->car;
+    object *rest = args->pair->cdr;
+    object *vars = NIL, *vars_ptr = NIL;
+    object *body = NIL, *body_ptr = NIL;
+    symbol_set seen = {};
+    object *ret_val = NIL;
+
+    ERROR(ASSERT((!specs || specs->type == T_PAIR) && rest &&
+                     rest->type == T_PAIR && rest->pair->car &&
+                     rest->pair->car->type == T_PAIR,
+                 "invalid syntax do")) {
+        return error;
+    }
+
+    for (; specs && specs->type == T_PAIR; specs = specs->pair->cdr) {
+        object *spec = specs->pair->car;
+        size_t len = spec ? object_list_len(ref(spec)) : 0;
+        ERROR(ASSERT((len == 2 || len == 3) && spec->pair->car &&
+                         spec->pair->car->type == T_SYMBOL &&
+                         !symbol_set_has(&seen, spec->pair->car->symbol),
+                     "invalid syntax do")) {
+            ret_val = error;
+            goto err;
+        }
+        symbol_set_push(&seen, spec->pair->car->symbol);
+        list_builder_push(&vars, &vars_ptr, car(ref(spec)));
+        if (len == 3) {
+            list_builder_push(&body, &body_ptr, car(cdr(cdr(ref(spec)))));
+        }
+    }
+
+    for_each_object_list(rest->pair->car) {
+        list_builder_push(&body, &body_ptr, car(ref(idx)));
+    }
+    for_each_object_list(rest->pair->cdr) {
+        list_builder_push(&body, &body_ptr, car(ref(idx)));
+    }
+
+    free_symbol_set(&seen);
+    unref(vars_ptr);
+    unref(body_ptr);
+    return form_template(args, vars, body, e, data);
+
+err:
+    free_symbol_set(&seen);
+    unref(vars);
+    unref(vars_ptr);
+    unref(body);
+    unref(body_ptr);
+    return ret_val;
+}
+
+/*
+ * (do ((var init step)...) (test expr...) command...) iterates in one frame,
+ * the steps are evaluated before any variable is rebound
+ */
+object *primitive_do(env *e, object *args, parse_data *data) {
+    object *ret_val = NIL;
+
+    ERROR(ASSERT(args && args->type == T_PAIR, "invalid syntax do")) {
+        unref(args);
+        return error;
+    }
+
+    object *template = do_template(e, args, data);
+    ERROR_REF(template) {
+        unref(template);
+        unref(args);
+        return error;
+    }
+
+    lambda_template *scope = template->template;
+    env *frame = let_frame(e, template, data);
+    object *next[scope->param_count + 1];
+    object *specs = args->pair->car;
+    object *clause = args->pair->cdr->pair->car;
+    object *commands = args->pair->cdr->pair->cdr;
+
+    object *spec = NIL;
+    for_each_object_list_entry(spec, specs) {
+        object *val = eval_from_ast(car(cdr(ref(spec))), e, data);
+        ERROR_REF(val) {
+            unref(val);
+            unref(spec);
+            unref(idx);
+            ret_val = error;
+            goto ret;
+        }
+        env_put(frame, spec->pair->car->symbol, val);
+    }
+
+    for (;;) {
+        object *test = eval_from_ast(ref(clause->pair->car), frame, data);
+        ERROR_REF(test) {
+            unref(test);
+            ret_val = error;
+            goto ret;
+        }
+        bool done = test != &False;
+        unref(test);
+        if (done) {
+            ret_val = primitive_begin(frame, ref(clause->pair->cdr), data);
+            break;
+        }
+
+        object *result = primitive_begin(frame, ref(commands), data);
+        ERROR_REF(result) {
+            unref(result);
+            ret_val = error;
+            goto ret;
+        }
+        unref(result);
+
+        int i = 0;
+        for (object *s = specs; s; s = s->pair->cdr, i++) {
+            object *step = s->pair->car->pair->cdr->pair->cdr;
+            if (!step) {
+                next[i] = ref(frame->objects[i]);
+                continue;
+            }
+            next[i] = eval_from_ast(ref(step->pair->car), frame, data);
+            ERROR_REF(next[i]) {
+                while (i >= 0) {
+                    unref(next[i--]);
+                }
+                ret_val = error;
+                goto ret;
+            }
+        }
+        loop_rebind(&frame, scope, next);
+    }
+
+ret:
+    unref(args);
+    let_frame_release(frame, data);
     return ret_val;
 }
 
@@ -1753,7 +4770,7 @@ object *primitive_object_eq(env *e, object *args, parse_data *data,
     for_each_object_list_entry(operand, args) {
         object *o = eval_from_ast(ref(operand), e, data);
 
-        ERROR(ref(o)) {
+        ERROR_REF(o) {
             ret_val = error;
             goto loop_exit;
         }
@@ -1836,6 +4853,14 @@ object *primitive_eqv(env *e, object *args, parse_data *data) {
 
     object *ret = NIL;
     bool result = false;
+    if (o1 && o1->type == T_ERR) {
+        ret = ref(o1);
+        goto ret;
+    }
+    if (o2 && o2->type == T_ERR) {
+        ret = ref(o2);
+        goto ret;
+    }
     if (o1->type != o2->type) {
         ret = ref(&False);
         goto ret;
@@ -1894,12 +4919,15 @@ object *primitive_set(env *e, object *args, parse_data *data) {
 
     object *expression = eval_from_ast(car(cdr(args)), e, data);
 
-    ERROR(ref(expression)) {
+    ERROR_REF(expression) {
         unref(variable);
         unref(expression);
         return error;
     }
 
+    if (expression && expression->type == T_MACRO_PROC) {
+        data->macro_epoch++;
+    }
     object *ret = env_set(e, variable->symbol, expression);
     unref(variable);
     return ret;
@@ -1927,7 +4955,7 @@ object *primitive_number_op(env *e, object *args, char op, parse_data *data) {
 
     for_each_object_list_entry(operand, args) {
         object *o = eval_from_ast(ref(operand), e, data);
-        ERROR(ref(o)) {
+        ERROR_REF(o) {
             ret_val = error;
             goto loop_exit;
         }
@@ -1994,56 +5022,158 @@ object *primitive_div(env *e, object *a, parse_data *data) {
     return primitive_number_op(e, a, '/', data);
 }
 
-void env_add_primitives(env *env, parse_data *parse_data) {
-    env_add_primitive(parse_data, env, "boolean?", primitive_is_boolean);
-    env_add_primitive(parse_data, env, "number?", primitive_is_number);
-    env_add_primitive(parse_data, env, "string?", primitive_is_string);
-    env_add_primitive(parse_data, env, "procedure?", primitive_is_procedure);
-    env_add_primitive(parse_data, env, "pair?", primitive_is_pair);
-    env_add_primitive(parse_data, env, "null?", primitive_is_null);
-    env_add_primitive(parse_data, env, "symbol?", primitive_is_symbol);
-
-    env_add_primitive(parse_data, env, "complex?", primitive_is_complex);
-    env_add_primitive(parse_data, env, "real?", primitive_is_real);
-    env_add_primitive(parse_data, env, "rational?", primitive_is_rational);
-    env_add_primitive(parse_data, env, "integer?", primitive_is_integer);
-
-    env_add_primitive(parse_data, env, "boolean=?", primitive_boolean_eq);
-    env_add_primitive(parse_data, env, "symbol=?", primitive_symbol_eq);
-    env_add_primitive(parse_data, env, "eqv?", primitive_eqv);
-
-    // todo
-    /* env_add_primitive(parse_data, env, "char?", primitive_is_boolean); */
-    /* env_add_primitive(parse_data, env, "vector?", primitive_is_boolean); */
-
-    env_add_primitive(parse_data, env, "error?", primitive_is_error);
-
-    env_add_primitive(parse_data, env, "+", primitive_add);
-    env_add_primitive(parse_data, env, "-", primitive_sub);
-    env_add_primitive(parse_data, env, "*", primitive_mul);
-    env_add_primitive(parse_data, env, "/", primitive_div);
-
-    env_add_primitive(parse_data, env, "define", primitive_define);
-    env_add_primitive(parse_data, env, "quote", primitive_quote);
+/* (string->number string [radix]), #f when string spells no number */
+object *primitive_string_to_number(env *e, object *args, parse_data *data) {
+    size_t count = object_list_len(ref(args));
+    if (count < 1 || count > 2) {
+        unref(args);
+        return new_error("Exception: incorrect argument count in call %s",
+                         "string->number");
+    }
 
-    env_add_primitive(parse_data, env, "begin", primitive_begin);
+    enum radix_flag radix = RADIX_10;
+    if (count == 2) {
+        object *o = eval_from_ast(car(cdr(ref(args))), e, data);
+        ERROR(assert_fun_arg_type("string->number", ref(o), 1, T_NUMBER)) {
+            unref(o);
+            unref(args);
+            return error;
+        }
+        s64 v = 0;
+        number_get_fixnum(o->number, &v);
+        unref(o);
+        switch (v) {
+        case 2:
+            radix = RADIX_2;
+            break;
+        case 8:
+            radix = RADIX_8;
+            break;
+        case 10:
+            break;
+        case 16:
+            radix = RADIX_16;
+            break;
+        default:
+            unref(args);
+            return new_error("string->number: unsupported radix %d", (int)v);
+        }
+    }
 
-    env_add_primitive(parse_data, env, "car", primitive_car);
-    env_add_primitive(parse_data, env, "cdr", primitive_cdr);
-    env_add_primitive(parse_data, env, "cons", primitive_cons);
+    object *s = eval_from_ast(car(args), e, data);
+    ERROR(assert_fun_arg_type("string->number", ref(s), 0, T_STRING)) {
+        unref(s);
+        return error;
+    }
+    number *n = lisp_scan_number(s->str->str_p, s->str->len, radix);
+    unref(s);
+    return n ? new_number(n) : ref(&False);
+}
 
-    env_add_primitive(parse_data, env, "lambda", primitive_lambda);
+/*
+ * every primitive, bound in the global env under its name. an image refers
+ * to a primitive by its index here
+ */
+static const struct primitive_def {
+    char *name;
+    primitive_proc_ptr *proc;
+} primitives[] = {
+    {"boolean?", primitive_is_boolean},
+    {"number?", primitive_is_number},
+    {"string?", primitive_is_string},
+    {"procedure?", primitive_is_procedure},
+    {"pair?", primitive_is_pair},
+    {"null?", primitive_is_null},
+    {"symbol?", primitive_is_symbol},
+
+    {"complex?", primitive_is_complex},
+    {"real?", primitive_is_real},
+    {"rational?", primitive_is_rational},
+    {"integer?", primitive_is_integer},
+
+    {"boolean=?", primitive_boolean_eq},
+    {"symbol=?", primitive_symbol_eq},
+    {"eqv?", primitive_eqv},
 
-    env_add_primitive(parse_data, env, "if", primitive_if);
-    env_add_primitive(parse_data, env, "cond", primitive_cond);
+    // todo
+    /* {"char?", primitive_is_boolean}, */
+    /* {"vector?", primitive_is_boolean}, */
+
+    {"error?", primitive_is_error},
+    {"raise", primitive_raise},
+    {"raise-continuable", primitive_raise_continuable},
+    {"with-exception-handler", primitive_with_exception_handler},
+    {"guard", primitive_guard},
+    {"error", primitive_error},
+    {"error-object-message", primitive_error_object_message},
+    {"error-object-irritants", primitive_error_object_irritants},
+    {"backtrace", primitive_backtrace},
+    {"call/ec", primitive_call_ec},
+#ifndef MY_OS
+    {"read-all", primitive_read_all},
+    {"write-fasl", primitive_write_fasl},
+    {"read-fasl", primitive_read_fasl},
+    {"load", primitive_load},
+    {"load-cache-stats", primitive_load_cache_stats},
+    {"make-generator", primitive_make_generator},
+    {"yield", primitive_yield},
+    {"next", primitive_next},
+#endif
+
+    {"+", primitive_add},
+    {"-", primitive_sub},
+    {"*", primitive_mul},
+    {"/", primitive_div},
+    {"string->number", primitive_string_to_number},
+
+    {"define", primitive_define},
+    {"quote", primitive_quote},
+
+    {"begin", primitive_begin},
+
+    {"car", primitive_car},
+    {"cdr", primitive_cdr},
+    {"cons", primitive_cons},
+
+    {"lambda", primitive_lambda},
+
+    {"if", primitive_if},
+    {"cond", primitive_cond},
+    {"case", primitive_case},
+
+    {"let", primitive_let},
+    {"letrec", primitive_letrec},
+    {"letrec*", primitive_letrec},
+    {"do", primitive_do},
+
+    {"set!", primitive_set},
+
+    {"define-syntax", primitive_define_syntax},
+    {"syntax-rules", primitive_syntax_rules},
+};
+
+#define PRIMITIVE_COUNT ((int)(sizeof(primitives) / sizeof(primitives[0])))
 
-    env_add_primitive(parse_data, env, "let", primitive_let);
+void env_add_primitives(env *env, parse_data *parse_data) {
+    for (int i = 0; i < PRIMITIVE_COUNT; i++) {
+        env_add_primitive(parse_data, env, primitives[i].name,
+                          primitives[i].proc);
+    }
+}
 
-    env_add_primitive(parse_data, env, "set!", primitive_set);
+/* index of proc in the primitive table, or -1 */
+int primitive_index(primitive_proc_ptr *proc) {
+    for (int i = 0; i < PRIMITIVE_COUNT; i++) {
+        if (primitives[i].proc == proc) {
+            return i;
+        }
+    }
+    return -1;
+}
 
-    env_add_primitive(parse_data, env, "define-syntax",
-                      primitive_define_syntax);
-    env_add_primitive(parse_data, env, "syntax-rules", primitive_syntax_rules);
+primitive_proc_ptr *primitive_at(int index) {
+    return index >= 0 && index < PRIMITIVE_COUNT ? primitives[index].proc
+                                                  : NULL;
 }
 
 void free_symbol(symbol *sym) {
@@ -2065,6 +5195,29 @@ parse_data *make_parse_data() {
     data->symtab = my_malloc(NHASH * sizeof(symbol *));
 
     data->is_eof = false;
+    data->env_stack = NULL;
+    data->env_stack_spare = NULL;
+    data->loop = NULL;
+    data->scan = NULL;
+#ifndef MY_OS
+    data->symtab_lock = NULL;
+#endif
+    data->bool_refs = NULL;
+    data->load_cache_dir = NULL;
+    data->load_cache_hits = 0;
+    data->load_cache_misses = 0;
+    data->out = NULL;
+    data->handlers = NIL;
+    /* above the 0 of templates read from an image, which check once */
+    data->macro_epoch = 1;
+    data->calls = NULL;
+    data->call_depth = 0;
+    data->call_capacity = 0;
+#ifndef MY_OS
+    data->stack_limit = NULL;
+    data->segment_spare = NULL;
+    data->generator = NULL;
+#endif
     return data;
 }
 
@@ -2078,23 +5231,66 @@ void free_parse_data(parse_data **data) {
         free_symbol(symtab[i]);
     }
     my_free(symtab);
+
+    env_stack_chunk *chunk = (*data)->env_stack;
+    while (chunk) {
+        env_stack_chunk *prev = chunk->prev;
+        my_free(chunk);
+        chunk = prev;
+    }
+    my_free((*data)->env_stack_spare);
+    my_free((*data)->calls);
+#ifndef MY_OS
+    my_free((*data)->segment_spare);
+#endif
+    free_lisp_scan((*data)->scan);
     free(*data);
     *data = NULL;
 }
 
 struct lisp_ctx *make_lisp_ctx(struct lisp_ctx_opt opt) {
     struct lisp_ctx *ctx = my_malloc(sizeof(struct lisp_ctx));
+    ctx->opt = opt;
     ctx->parse_data = make_parse_data();
     if (yylex_init_extra(ctx->parse_data, &ctx->scanner)) {
         free_parse_data(&ctx->parse_data);
         return NULL;
     }
-    ctx->global_env = new_env();
-    env_add_primitives(ctx->global_env, ctx->parse_data);
+    if (opt.scanner == LISP_SCANNER_FAST) {
+        ctx->parse_data->scan = make_lisp_scan();
+    }
+    ctx->parse_data->load_cache_dir = opt.load_cache_dir;
+
+    if (opt.flush == LISP_FLUSH_AUTO) {
+#ifdef MY_OS
+        ctx->opt.flush = LISP_FLUSH_FORM;
+#else
+        ctx->opt.flush = isatty(STDOUT_FILENO) ? LISP_FLUSH_FORM
+                                               : LISP_FLUSH_FULL;
+#endif
+    }
+#define LISP_OUT_BUF_SIZE (64 * 1024)
+    lisp_out_init_stdout(&ctx->out, my_malloc(LISP_OUT_BUF_SIZE),
+                         LISP_OUT_BUF_SIZE);
+    ctx->parse_data->out = &ctx->out;
+#ifndef MY_OS
+    if (opt.image) {
+        ERROR(image_read_file(ctx->parse_data, opt.image, &ctx->global_env)) {
+            object_print(error, NULL);
+            my_printf("\n");
+            yylex_destroy(ctx->scanner);
+            free_parse_data(&ctx->parse_data);
+            my_free(ctx->out.buf);
+            my_free(ctx);
+            return NULL;
+        }
+    }
+#endif
+    if (!ctx->global_env) {
+        ctx->global_env = new_env(NULL);
+        env_add_primitives(ctx->global_env, ctx->parse_data);
+    }
 
-#ifdef MY_DEBUG
-    yyset_debug(1, ctx->scanner);
-#endif // MY_DEBUG
     return ctx;
 }
 
@@ -2102,25 +5298,76 @@ void free_lisp_ctx(struct lisp_ctx **ctx) {
     if (*ctx == NULL) {
         return;
     }
+    lisp_out_flush(&(*ctx)->out);
+    my_free((*ctx)->out.buf);
     yylex_destroy((*ctx)->scanner);
-    free_env((*ctx)->global_env);
+    /* top level closures reference the global env */
+    env_clear((*ctx)->global_env);
+    env_unref((*ctx)->global_env);
     free_parse_data(&(*ctx)->parse_data);
     my_free(*ctx);
     *ctx = NULL;
 }
 
-object *eval_from_str(struct lisp_ctx *ctx, char *code) {
-    int len = strlen(code);
-    char *buf = my_malloc(len + 1);
-    memcpy(buf, code, len);
-    YY_BUFFER_STATE str_buffer = yy_scan_string(buf, ctx->scanner);
-    yy_switch_to_buffer(str_buffer, ctx->scanner);
-    yyparse(ctx->scanner, ctx->parse_data);
-    yy_delete_buffer(str_buffer, ctx->scanner);
-    my_free(buf);
-
-    object *ret =
-        eval_from_ast(ctx->parse_data->ast, ctx->global_env, ctx->parse_data);
-    ctx->parse_data->ast = NULL;
+/*
+ * evaluate every form in the len bytes at code, which only has to live for
+ * the call. returns the value of the last form, or the first error, a
+ * syntax error included. the input being read before, as by an eval_from_io
+ * this is called under, is read on from where it was after.
+ */
+object *eval_from_buf(struct lisp_ctx *ctx, const char *code, size_t len) {
+    parse_data *data = ctx->parse_data;
+    struct lisp_scan outer_scan;
+    YY_BUFFER_STATE outer = NULL;
+    YY_BUFFER_STATE buffer = NULL;
+    if (data->scan) {
+        outer_scan = *data->scan;
+        lisp_scan_set_buf(data->scan, code, len);
+    } else {
+        /*
+         * yy_scan_bytes takes the place of the buffer on top of the stack,
+         * so an empty one is pushed over the buffer being read to keep it
+         */
+        outer = yy_create_buffer(NULL, 1, ctx->scanner);
+        yypush_buffer_state(outer, ctx->scanner);
+        /* flex needs two writable NULs past the end, so it takes one copy */
+        buffer = yy_scan_bytes(code, len, ctx->scanner);
+    }
+
+    object *ret = NIL;
+    bool is_eof = data->is_eof;
+    data->is_eof = false;
+    char *limit = eval_stack_enter(data);
+    int status;
+    while (!(status = yyparse(ctx->scanner, data)) && !data->is_eof) {
+        unref(ret);
+        ret = eval_from_ast(data->ast, ctx->global_env, data);
+        data->ast = NULL;
+        if (ret && ret->type == T_ERR) {
+            break;
+        }
+    }
+    if (status) {
+        unref(ret);
+        ret = new_error("Exception: eval syntax error at line %d",
+                        data->scan ? data->scan->line
+                                   : yyget_lineno(ctx->scanner));
+    }
+    eval_stack_leave(data, limit);
+    data->is_eof = is_eof;
+
+    if (data->scan) {
+        data->scan->cur = outer_scan.cur;
+        data->scan->end = outer_scan.end;
+        data->scan->line = outer_scan.line;
+    } else {
+        /* drops buffer and reads on from the one under it */
+        yypop_buffer_state(ctx->scanner);
+        yy_delete_buffer(outer, ctx->scanner);
+    }
     return ret;
 }
+
+object *eval_from_str(struct lisp_ctx *ctx, char *code) {
+    return eval_from_buf(ctx, code, strlen(code));
+}
@@ -7,12 +7,19 @@
 
 #include "os.h"
 #include "number.h"
+#include "my_lisp_out.h"
+
+#ifndef MY_OS
+#include <pthread.h>
+#endif
 
 typedef enum {
     T_PRIMITIVE_PROC = 0x1,
     T_COMPOUND_PROC = 0x2,
-    T_PROCEDURE = T_PRIMITIVE_PROC | T_COMPOUND_PROC,
+    T_CONTINUATION = 0x4000,
+    T_PROCEDURE = T_PRIMITIVE_PROC | T_COMPOUND_PROC | T_CONTINUATION,
     T_NUMBER = 0x4,
+    T_GENERATOR = 0x8,
     T_BOOLEAN = 0x10,
     T_SYMBOL = 0x20,
     T_STRING = 0x40,
@@ -21,11 +28,16 @@ typedef enum {
     T_VECTOR = 0x200,
     T_MACRO_PROC = 0x400,
     T_NULL = 0x800,
+    T_TEMPLATE = 0x1000,
+    T_CASE_TABLE = 0x2000,
     T_ERR = 0x8000,
 } object_type;
 
 typedef struct object_t object;
 
+/* a producer run on a stack of its own, suspended at each yield */
+typedef struct generator_t generator;
+
 typedef struct symbol_t symbol;
 struct symbol_t {
     char *name;
@@ -35,9 +47,15 @@ struct symbol_t {
 typedef struct env_t env;
 struct env_t {
     env *parent;
+    int ref_count;
     int count;
+    int capacity;
     symbol **symbols;
     object **objects;
+    /* template of the lambda or let that created this frame */
+    object *template;
+    /* allocated from the evaluator's frame stack */
+    bool on_stack;
 };
 
 struct string_t {
@@ -49,20 +67,116 @@ typedef struct string_t string;
 struct pair_t {
     object *car;
     object *cdr;
+    /* evaluator data derived from this form (e.g. a lambda template) */
+    object *cache;
 };
 typedef struct pair_t pair;
 
+#define ERROR_ARGS_MAX 4
+
+/*
+ * an error keeps its format and arguments and is formatted when printed.
+ * %O takes an object, which is kept and printed with depth and length
+ * limits; %s arguments are copied into strs.
+ */
 struct error_t {
+    /* NULL when the message came formatted, as from an image */
+    const char *fmt;
+    union error_arg {
+        long long i;
+        const char *s;
+        object *o;
+    } args[ERROR_ARGS_MAX];
+    /* bit i set when args[i] is an object */
+    u8 objects;
+    /* already offered to the exception handlers */
+    bool raised;
+    /* what was passed to raise, when that was not an error itself */
+    object *payload;
+    /* the continuation unwound to, payload is the value passed to it */
+    object *escape;
+    /* formatted on first use */
     char *msg;
+    char strs[];
 };
 
 typedef struct error_t error;
 
-struct compound_proc_t {
-    object *parameters;
-    object *body;
+typedef struct symbol_set_t symbol_set;
+struct symbol_set_t {
+    symbol **symbols;
+    int count;
+    int capacity;
+};
+
+/*
+ * immutable part of a lambda, shared by every closure created from the same
+ * lambda expression
+ */
+struct lambda_template_t {
+    symbol **params;
     int param_count;
     symbol *varg;
+    object *body;
+    /* variables the body references but does not bind */
+    symbol_set free_vars;
+    /* targets of set! anywhere in the body, nested lambdas included */
+    symbol_set assigned;
+    /* names bound by internal defines of the body */
+    symbol_set defines;
+    /* the body calls a macro, its expansion may reference any variable */
+    bool macro_use;
+    /* the macro_epoch of the parse data macro_use was last checked at */
+    u32 macro_epoch;
+    /* the body creates closures, which may keep its frame alive */
+    bool makes_closure;
+    /* name of a named let, its tail calls in the body are marked to iterate */
+    symbol *loop;
+    /* the name is also used other than by marked tail calls */
+    bool loop_escapes;
+};
+typedef struct lambda_template_t lambda_template;
+
+/*
+ * dispatch table of a case form. datums that are symbols, booleans, (),
+ * fixnums or characters are hashed, or indexed directly when they are
+ * fixnums or characters in a dense range; other datums are compared in turn
+ */
+typedef struct case_entry_t {
+    u64 value;
+    /* enum case_key_kind, 0 marks an empty slot */
+    u32 kind;
+    int clause;
+} case_entry;
+
+typedef struct case_clause_t {
+    /* the expressions, or (=> receiver) */
+    object *body;
+    bool arrow;
+} case_clause;
+
+struct case_table_t {
+    case_clause *clauses;
+    int clause_count;
+    /* index of the else clause or -1 */
+    int else_clause;
+
+    case_entry *entries;
+    int entry_bits;
+
+    u32 dense_kind;
+    s64 dense_min;
+    u64 dense_size;
+    int *dense;
+
+    object **others;
+    int *other_clauses;
+    int other_count;
+};
+typedef struct case_table_t case_table;
+
+struct compound_proc_t {
+    object *template;
     env *env;
 };
 typedef struct compound_proc_t compound_proc;
@@ -90,28 +204,113 @@ struct object_t {
     union {
         number *number;
         bool bool_val;
+        /* a continuation is escaped to only before its call/ec returns */
+        bool continuation_active;
         u16 char_val;
         primitive_proc *primitive_proc;
         compound_proc *compound_proc;
+        lambda_template *template;
+        case_table *case_table;
         macro_proc *macro_proc;
         symbol *symbol;
         pair *pair;
         string *str;
         error *err;
+        generator *generator;
     };
 };
 
+/*
+ * frames that cannot escape are carved from a chain of chunks in strict
+ * LIFO order; the last released chunk is kept for reuse
+ */
+typedef struct env_stack_chunk_t env_stack_chunk;
+struct env_stack_chunk_t {
+    env_stack_chunk *prev;
+    size_t size;
+    size_t used;
+};
+
+/*
+ * an active loop body. a marked tail call stores the values of the next
+ * iteration in next and unwinds to the loop by returning a sentinel
+ */
+/*
+ * a segment of heap stack that evaluation continues on once the stack it
+ * runs on is nearly used up
+ */
+typedef struct eval_segment_t eval_segment;
+
+typedef struct loop_state_t loop_state;
+struct loop_state_t {
+    loop_state *prev;
+    symbol *name;
+    object **next;
+    bool jump;
+};
+
+struct lisp_scan;
+
 struct parse_data {
     object *ast;
     symbol **symtab;
     bool is_eof;
+    env_stack_chunk *env_stack;
+    env_stack_chunk *env_stack_spare;
+    loop_state *loop;
+    /* hand-written scanner, NULL when the flex one is used */
+    struct lisp_scan *scan;
+#ifndef MY_OS
+    /* held around symbol table access while a reader thread shares it */
+    pthread_mutex_t *symtab_lock;
+#endif
+    /*
+     * when set, booleans read are counted here rather than in the shared
+     * True and False, and claim_booleans adds them on the evaluating thread
+     */
+    u32 *bool_refs;
+    /* directory of the load cache, NULL to not cache */
+    const char *load_cache_dir;
+    u32 load_cache_hits;
+    u32 load_cache_misses;
+    /* where parse errors are printed, NULL for my_printf */
+    struct lisp_out *out;
+    /*
+     * the installed exception handlers, innermost first. a NIL entry is a
+     * guard, which takes the raise as an error returned up to it
+     */
+    object *handlers;
+    /*
+     * bumped whenever a macro is bound, so templates analyzed before look
+     * for uses of it again, see template_refresh
+     */
+    u32 macro_epoch;
+    /* the call forms being evaluated, outermost first */
+    object **calls;
+    u32 call_depth;
+    u32 call_capacity;
+#ifndef MY_OS
+    /*
+     * below this address eval_from_ast moves to a new segment, NULL to
+     * stay on the native stack. a parse_data is evaluated by one thread
+     */
+    char *stack_limit;
+    /* the last released segment, kept for reuse */
+    eval_segment *segment_spare;
+    /* the generator being run, NULL outside of one */
+    object *generator;
+#endif
 };
 
 symbol *lookup(parse_data *, char *);
+symbol *lookup_n(parse_data *, const char *, size_t);
 object *new_boolean(bool val);
+object *read_boolean(parse_data *data, bool val);
+void claim_booleans(u32 bool_refs[2]);
 object *new_symbol(symbol *s);
 
 string *make_string(char *, size_t);
+string *make_string_take(char *, size_t);
 object *new_string(string *);
 
 object *new_number(number *);
@@ -120,18 +319,55 @@ object *new_character(u16 ch);
 object *cons(object *car, object *cdr);
 object *car(object *pair);
 object *cdr(object *pair);
+object *setcar(object *list, object *car);
+object *setcdr(object *list, object *cdr);
 
 object *NIL;
 
-env *new_env(void);
+env *new_env(env *parent);
+env *new_env_sized(env *parent, int capacity);
+env *env_ref(env *e);
+void env_unref(env *e);
 void free_env(env *e);
+object *env_get(env *e, symbol *sym);
+/* the slot bound to sym in e or a parent, NULL when it is unbound */
+object **env_lookup(env *e, symbol *sym);
 
 void env_add_primitives(env *, parse_data *);
+object *new_primitive_proc(primitive_proc_ptr *proc);
+/* a closure over env as is, without closure conversion */
+object *make_compound_proc(env *env, object *template);
+int primitive_index(primitive_proc_ptr *proc);
+primitive_proc_ptr *primitive_at(int index);
+
+bool pair_is_tail_call(object *pair);
+void pair_mark_tail_call(object *pair);
 
 #define NHASH 9997
 
 object *eval_from_ast(object *exp, env *env, parse_data *data);
+/*
+ * around a top level evaluation: the stack limit of data for the thread
+ * and stack the caller runs on, and the one it had back after
+ */
+char *eval_stack_enter(parse_data *data);
+void eval_stack_leave(parse_data *data, char *limit);
+
+bool symbol_set_has(symbol_set *set, symbol *sym);
+void symbol_set_add(symbol_set *set, symbol *sym);
+void free_symbol_set(symbol_set *set);
+
+/* called with each macro use expand_macros replaces */
+typedef void expand_hook(void *ctx, symbol *name, object *macro);
+object *macro_expand(object *func, object *args, parse_data *data);
+/* form with the uses of macros bound in e expanded ahead of evaluation */
+object *expand_macros(object *form, env *e, parse_data *data,
+                      expand_hook *hook, void *ctx);
 void object_print(object *o, env *);
+void object_write(struct lisp_out *out, object *o, env *e);
+/* like object_write, with "..." past max_depth lists or max_length elements */
+void object_write_limited(struct lisp_out *out, object *o, env *e,
+                          size_t max_depth, size_t max_length);
 
 void free_lisp(parse_data *data);
 
@@ -182,9 +418,25 @@ static inline object *is_error(object *o) {
 
 #define ERROR(e) for (object *error = is_error(e); error; error = NIL)
 
+/* ERROR(ref(o)) without touching the count of o when it is not an error */
+static inline object *is_error_ref(object *o) {
+    return o && o->type == T_ERR ? ref(o) : NIL;
+}
+
+#define ERROR_REF(o) for (object *error = is_error_ref(o); error; error = NIL)
+
+object *new_error(const char *fmt, ...);
+/* the error of an already formatted message of len bytes */
+error *make_error_text(const char *msg, size_t len);
+void error_write(struct lisp_out *out, error *err);
+/* the formatted message, owned by the error */
+const char *error_message(error *err);
+
 #define ASSERT(cond, fmt, ...) (!(cond) ? new_error(fmt, ##__VA_ARGS__) : NIL)
 
 object *assert_fun_arg_type(char *func, object *o, int i, object_type type);
+object *assert_fun_args_count(char *fun, object *args, int count);
+const char *type_name(object *o);
 
 #ifdef MY_OS
 #define YY_INPUT(_buf, result, max_size)
@@ -202,8 +454,31 @@ void my_error(const char *);
 /* extern FILE *stdin; */
 /* extern FILE *stdout; */
 
-struct lisp_ctx_opt {
+enum lisp_flush {
+    /* per form when stdout is a terminal, otherwise LISP_FLUSH_FULL */
+    LISP_FLUSH_AUTO = 0,
+    /* after the value of each top level form */
+    LISP_FLUSH_FORM,
+    /* when the buffer is full and when the input is done */
+    LISP_FLUSH_FULL,
+};
 
+enum lisp_scanner {
+    LISP_SCANNER_FLEX = 0,
+    LISP_SCANNER_FAST,
+};
+
+struct lisp_ctx_opt {
+    enum lisp_scanner scanner;
+    /* eval_from_io parses on a reader thread while the evaluator runs */
+    bool pipeline;
+    /* boot the global env from this heap image instead of the primitives */
+    const char *image;
+    /* directory where load keeps expanded files, NULL to not cache */
+    const char *load_cache_dir;
+    /* eval_from_io prints errors only, not the value of every form */
+    bool quiet;
+    enum lisp_flush flush;
 };
 
 #include "my_lisp.tab.h"
@@ -212,9 +487,15 @@ struct lisp_ctx {
     yyscan_t scanner;
     parse_data *parse_data;
     env *global_env;
+    struct lisp_ctx_opt opt;
+    /* stdout, for the values eval_from_io prints */
+    struct lisp_out out;
 };
 
 struct lisp_ctx *make_lisp_ctx(struct lisp_ctx_opt opt);
 void free_lisp_ctx(struct lisp_ctx **);
 
+object *eval_from_buf(struct lisp_ctx *ctx, const char *code, size_t len);
+object *eval_from_str(struct lisp_ctx *ctx, char *code);
+
 #endif /* MY_LISP_H */
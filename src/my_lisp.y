@@ -23,6 +23,11 @@
     object *obj;
     string *str;
     u16 ch;
+    /* list under construction, appended to through its last pair */
+    struct {
+        object *head;
+        object *tail;
+    } items;
 }
 
 %token LP RP LSB RSB APOSTROPHE GRAVE COMMA COMMA_AT PERIOD
@@ -38,6 +43,11 @@
 %token END_OF_FILE
 
 %type <obj> number boolean symbol string character list_item datum lexeme_datum compound_datum list abbreviation
+%type <items> list_items
+
+/* the datums read before a syntax error are dropped with the parse */
+%destructor { unref($$); } <obj>
+%destructor { unref($$.head); } <items>
 
 %start exp
 
@@ -63,8 +73,8 @@ string: STRING { $$ = new_string($1); }
 number: NUMBER { $$ = new_number($1); }
 ;
 
-boolean: BOOLEAN_T  { $$ = new_boolean(true); }
-| BOOLEAN_F  { $$ = new_boolean(false); }
+boolean: BOOLEAN_T  { $$ = read_boolean(data, true); }
+| BOOLEAN_F  { $$ = read_boolean(data, false); }
 ;
 
 character: CHARACTER { $$ = new_character($1); }
@@ -77,9 +87,17 @@ compound_datum: list
                 // | bytevector
 ;
 
-list_item: datum { $$ = cons($1, NIL); }
-| datum list_item { $$ = cons($1, $2); }
-| datum PERIOD datum { $$ = cons($1, $3); }
+list_items: datum { $$.head = $$.tail = cons($1, NIL); }
+| list_items datum {
+    object *last = cons($2, NIL);
+    setcdr(ref($1.tail), last);
+    $$.head = $1.head;
+    $$.tail = last;
+ }
+;
+
+list_item: list_items { $$ = $1.head; }
+| list_items PERIOD datum { setcdr(ref($1.tail), $3); $$ = $1.head; }
 ;
 
 list: LP list_item RP { $$ = $2;}
@@ -0,0 +1,441 @@
+#include "my_lisp_fasl.h"
+
+#ifndef MY_OS
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+enum fasl_tag {
+    FASL_NIL,
+    FASL_TRUE,
+    FASL_FALSE,
+    /* u32 index into the symbol section */
+    FASL_SYMBOL,
+    /* u32 length and the bytes */
+    FASL_STRING,
+    /* u8 size and the zipped number as it is in memory */
+    FASL_NUMBER,
+    /* u16 */
+    FASL_CHAR,
+    /* u32 n, n datums and the tail, so long lists do not recurse */
+    FASL_LIST,
+};
+
+bool fasl_is(const char *buf, size_t len) {
+    return len >= FASL_MAGIC_SIZE && !memcmp(buf, FASL_MAGIC, FASL_MAGIC_SIZE);
+}
+
+struct fasl_buf {
+    char *data;
+    size_t len;
+    size_t size;
+};
+
+static void fasl_put(struct fasl_buf *b, const void *p, size_t n) {
+    /* an empty section has no data to copy from */
+    if (!n) {
+        return;
+    }
+    if (b->len + n > b->size) {
+        b->size = b->size ? b->size * 2 : 4096;
+        if (b->size < b->len + n) {
+            b->size = b->len + n;
+        }
+        b->data = my_realloc(b->data, b->size);
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void fasl_put_u8(struct fasl_buf *b, u8 v) { fasl_put(b, &v, 1); }
+
+static void fasl_put_u32(struct fasl_buf *b, u32 v) { fasl_put(b, &v, 4); }
+
+/* symbols met while writing, numbered in order of first use */
+struct fasl_writer {
+    struct fasl_buf datums;
+    struct fasl_buf symbols;
+    u32 symbol_count;
+    /* open addressing from symbol to index + 1, 0 is empty */
+    symbol **keys;
+    u32 *values;
+    size_t capacity;
+};
+
+static size_t fasl_symbol_slot(struct fasl_writer *w, symbol *s) {
+    size_t i = ((unsigned long)s >> 4) * 0x9e3779b97f4a7c15ull;
+    for (i &= w->capacity - 1; w->keys[i] && w->keys[i] != s;
+         i = (i + 1) & (w->capacity - 1)) {
+    }
+    return i;
+}
+
+static u32 fasl_symbol_index(struct fasl_writer *w, symbol *s) {
+    if (w->capacity) {
+        size_t slot = fasl_symbol_slot(w, s);
+        if (w->keys[slot] == s) {
+            return w->values[slot] - 1;
+        }
+    }
+
+    if ((w->symbol_count + 1) * 2 > w->capacity) {
+        symbol **keys = w->keys;
+        u32 *values = w->values;
+        size_t capacity = w->capacity;
+
+        w->capacity = capacity ? capacity * 2 : 256;
+        w->keys = my_malloc(w->capacity * sizeof(symbol *));
+        w->values = my_malloc(w->capacity * sizeof(u32));
+        for (size_t i = 0; i < capacity; i++) {
+            if (keys[i]) {
+                size_t slot = fasl_symbol_slot(w, keys[i]);
+                w->keys[slot] = keys[i];
+                w->values[slot] = values[i];
+            }
+        }
+        my_free(keys);
+        my_free(values);
+    }
+
+    size_t slot = fasl_symbol_slot(w, s);
+    w->keys[slot] = s;
+    w->values[slot] = ++w->symbol_count;
+
+    u32 len = strlen(s->name);
+    fasl_put_u32(&w->symbols, len);
+    fasl_put(&w->symbols, s->name, len);
+    return w->symbol_count - 1;
+}
+
+/* o is borrowed */
+static object *fasl_put_datum(struct fasl_writer *w, object *o) {
+    struct fasl_buf *b = &w->datums;
+    if (!o) {
+        fasl_put_u8(b, FASL_NIL);
+        return NIL;
+    }
+
+    switch (o->type) {
+    case T_BOOLEAN:
+        fasl_put_u8(b, o->bool_val ? FASL_TRUE : FASL_FALSE);
+        break;
+    case T_SYMBOL:
+        fasl_put_u8(b, FASL_SYMBOL);
+        fasl_put_u32(b, fasl_symbol_index(w, o->symbol));
+        break;
+    case T_STRING:
+        fasl_put_u8(b, FASL_STRING);
+        fasl_put_u32(b, o->str->len);
+        fasl_put(b, o->str->str_p, o->str->len);
+        break;
+    case T_NUMBER:
+        fasl_put_u8(b, FASL_NUMBER);
+        fasl_put_u8(b, o->number->flag.size);
+        fasl_put(b, o->number, o->number->flag.size);
+        break;
+    case T_CHARACTER:
+        fasl_put_u8(b, FASL_CHAR);
+        fasl_put(b, &o->char_val, sizeof(u16));
+        break;
+    case T_PAIR: {
+        u32 n = 0;
+        object *rest = o;
+        for (; rest && rest->type == T_PAIR; rest = rest->pair->cdr) {
+            n++;
+        }
+
+        fasl_put_u8(b, FASL_LIST);
+        fasl_put_u32(b, n);
+        for (rest = o; rest && rest->type == T_PAIR; rest = rest->pair->cdr) {
+            ERROR(fasl_put_datum(w, rest->pair->car)) { return error; }
+        }
+        return fasl_put_datum(w, rest);
+    }
+    default:
+        return new_error("Exception: write-fasl can not write a %s",
+                         type_name(o));
+    }
+    return NIL;
+}
+
+object *fasl_write(object *datums, char **buf, size_t *len) {
+    struct fasl_writer w = {};
+    object *ret_val = NIL;
+
+    u32 count = 0;
+    for (object *rest = datums; rest && rest->type == T_PAIR;
+         rest = rest->pair->cdr) {
+        ERROR(fasl_put_datum(&w, rest->pair->car)) {
+            ret_val = error;
+            goto ret;
+        }
+        count++;
+    }
+
+    struct fasl_buf out = {};
+    u32 version = FASL_VERSION;
+    fasl_put(&out, FASL_MAGIC, FASL_MAGIC_SIZE);
+    fasl_put_u32(&out, version);
+    fasl_put_u32(&out, w.symbol_count);
+    fasl_put(&out, w.symbols.data, w.symbols.len);
+    fasl_put_u32(&out, count);
+    fasl_put(&out, w.datums.data, w.datums.len);
+    *buf = out.data;
+    *len = out.len;
+
+ret:
+    my_free(w.datums.data);
+    my_free(w.symbols.data);
+    my_free(w.keys);
+    my_free(w.values);
+    unref(datums);
+    return ret_val;
+}
+
+struct fasl_reader {
+    const char *cur;
+    const char *end;
+    symbol **symbols;
+    u32 symbol_count;
+};
+
+static bool fasl_get(struct fasl_reader *r, void *p, size_t n) {
+    if ((size_t)(r->end - r->cur) < n) {
+        return false;
+    }
+    memcpy(p, r->cur, n);
+    r->cur += n;
+    return true;
+}
+
+#define FASL_CORRUPT() new_error("Exception: read-fasl corrupt input")
+
+static object *fasl_get_datum(struct fasl_reader *r) {
+    u8 tag;
+    if (!fasl_get(r, &tag, 1)) {
+        return FASL_CORRUPT();
+    }
+
+    switch (tag) {
+    case FASL_NIL:
+        return NIL;
+    case FASL_TRUE:
+        return new_boolean(true);
+    case FASL_FALSE:
+        return new_boolean(false);
+    case FASL_SYMBOL: {
+        u32 index;
+        if (!fasl_get(r, &index, 4) || index >= r->symbol_count) {
+            return FASL_CORRUPT();
+        }
+        return new_symbol(r->symbols[index]);
+    }
+    case FASL_STRING: {
+        u32 len;
+        if (!fasl_get(r, &len, 4) || (size_t)(r->end - r->cur) < len) {
+            return FASL_CORRUPT();
+        }
+        object *o = new_string(make_string((char *)r->cur, len));
+        r->cur += len;
+        return o;
+    }
+    case FASL_NUMBER: {
+        u8 size;
+        if (!fasl_get(r, &size, 1) || size < sizeof(number) ||
+            (size_t)(r->end - r->cur) < size) {
+            return FASL_CORRUPT();
+        }
+        number *n = my_malloc(size);
+        memcpy(n, r->cur, size);
+        r->cur += size;
+        if (n->flag.size != size) {
+            my_free(n);
+            return FASL_CORRUPT();
+        }
+        return new_number(n);
+    }
+    case FASL_CHAR: {
+        u16 ch;
+        if (!fasl_get(r, &ch, sizeof(u16))) {
+            return FASL_CORRUPT();
+        }
+        return new_character(ch);
+    }
+    case FASL_LIST: {
+        u32 n;
+        if (!fasl_get(r, &n, 4) || !n) {
+            return FASL_CORRUPT();
+        }
+
+        object *head = NIL;
+        object *tail = NIL;
+        for (u32 i = 0; i <= n; i++) {
+            object *o = fasl_get_datum(r);
+            ERROR_REF(o) {
+                unref(error);
+                unref(head);
+                return error;
+            }
+            if (i == n) {
+                setcdr(ref(tail), o);
+                break;
+            }
+            object *last = cons(o, NIL);
+            if (tail) {
+                setcdr(ref(tail), last);
+            } else {
+                head = last;
+            }
+            tail = last;
+        }
+        return head;
+    }
+    default:
+        return FASL_CORRUPT();
+    }
+}
+
+object *fasl_read(parse_data *data, const char *buf, size_t len) {
+    struct fasl_reader r = {.cur = buf, .end = buf + len};
+    u32 version;
+    u32 count;
+    object *head = NIL;
+    object *tail = NIL;
+
+    if (!fasl_is(buf, len)) {
+        return new_error("Exception: read-fasl not a fasl");
+    }
+    r.cur += FASL_MAGIC_SIZE;
+    if (!fasl_get(&r, &version, 4) || version != FASL_VERSION) {
+        return new_error("Exception: read-fasl unsupported version");
+    }
+
+    /* the only fixup: intern each symbol once, datums refer to it by index */
+    if (!fasl_get(&r, &r.symbol_count, 4) ||
+        (size_t)(r.end - r.cur) / 4 < r.symbol_count) {
+        return FASL_CORRUPT();
+    }
+    r.symbols = my_malloc(r.symbol_count * sizeof(symbol *));
+    for (u32 i = 0; i < r.symbol_count; i++) {
+        u32 n;
+        if (!fasl_get(&r, &n, 4) || (size_t)(r.end - r.cur) < n) {
+            head = FASL_CORRUPT();
+            goto ret;
+        }
+        r.symbols[i] = lookup_n(data, r.cur, n);
+        r.cur += n;
+    }
+
+    if (!fasl_get(&r, &count, 4)) {
+        head = FASL_CORRUPT();
+        goto ret;
+    }
+    for (u32 i = 0; i < count; i++) {
+        object *o = fasl_get_datum(&r);
+        ERROR_REF(o) {
+            unref(error);
+            unref(head);
+            head = error;
+            goto ret;
+        }
+        object *last = cons(o, NIL);
+        if (tail) {
+            setcdr(ref(tail), last);
+        } else {
+            head = last;
+        }
+        tail = last;
+    }
+
+ret:
+    my_free(r.symbols);
+    return head;
+}
+
+#ifndef MY_OS
+object *fasl_write_file(const char *path, object *datums) {
+    char *buf;
+    size_t len;
+    ERROR(fasl_write(datums, &buf, &len)) { return error; }
+
+    object *ret_val = NIL;
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        ret_val = new_error("Exception: write-fasl can not open %s", path);
+    } else {
+        if (fwrite(buf, 1, len, out) != len) {
+            ret_val = new_error("Exception: write-fasl can not write %s", path);
+        }
+        fclose(out);
+    }
+    my_free(buf);
+    return ret_val;
+}
+
+object *fasl_read_file(parse_data *data, const char *path) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return new_error("Exception: read-fasl can not open %s", path);
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return new_error("Exception: read-fasl can not map %s", path);
+    }
+    object *ret_val = fasl_read(data, map, st.st_size);
+    munmap(map, st.st_size);
+    return ret_val;
+}
+
+/* (write-fasl path datums) */
+object *primitive_write_fasl(env *e, object *args, parse_data *data) {
+    ERROR(assert_fun_args_count("write-fasl", ref(args), 2)) {
+        unref(args);
+        return error;
+    }
+
+    object *path = eval_from_ast(car(ref(args)), e, data);
+    ERROR(assert_fun_arg_type("write-fasl", ref(path), 0, T_STRING)) {
+        unref(path);
+        unref(args);
+        return error;
+    }
+    object *datums = eval_from_ast(car(cdr(args)), e, data);
+    /* an error is not a datum list, writing it would leave an empty file */
+    ERROR_REF(datums) {
+        unref(datums);
+        unref(path);
+        return error;
+    }
+
+    object *ret_val = fasl_write_file(path->str->str_p, datums);
+    unref(path);
+    return ret_val;
+}
+
+/* (read-fasl path) */
+object *primitive_read_fasl(env *e, object *args, parse_data *data) {
+    ERROR(assert_fun_args_count("read-fasl", ref(args), 1)) {
+        unref(args);
+        return error;
+    }
+
+    object *path = eval_from_ast(car(args), e, data);
+    ERROR(assert_fun_arg_type("read-fasl", ref(path), 0, T_STRING)) {
+        unref(path);
+        return error;
+    }
+
+    object *ret_val = fasl_read_file(data, path->str->str_p);
+    unref(path);
+    return ret_val;
+}
+#endif
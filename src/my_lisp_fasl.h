@@ -0,0 +1,32 @@
+#pragma once
+
+#include "my_lisp.h"
+
+/*
+ * fasl, a binary form of a list of datums that loads without lexing or
+ * parsing. the layout is native endian:
+ *
+ *   magic "\x7f" "FSL", u32 version
+ *   u32 symbol count, then per symbol u32 length and the name
+ *   u32 datum count, then the datums
+ *
+ * each datum is a tag byte followed by its payload, see enum fasl_tag.
+ */
+#define FASL_MAGIC "\x7f" "FSL"
+#define FASL_MAGIC_SIZE 4
+#define FASL_VERSION 1
+
+bool fasl_is(const char *buf, size_t len);
+
+/* encode the datums in a list into a my_malloc buffer, NIL or an error */
+object *fasl_write(object *datums, char **buf, size_t *len);
+/* decode a fasl buffer into a list of datums, or an error */
+object *fasl_read(parse_data *data, const char *buf, size_t len);
+
+#ifndef MY_OS
+object *fasl_write_file(const char *path, object *datums);
+object *fasl_read_file(parse_data *data, const char *path);
+
+object *primitive_write_fasl(env *e, object *args, parse_data *data);
+object *primitive_read_fasl(env *e, object *args, parse_data *data);
+#endif
@@ -0,0 +1,758 @@
+#include "my_lisp_image.h"
+
+#ifndef MY_OS
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+enum image_tag {
+    IMAGE_ENV,
+    IMAGE_PAIR,
+    IMAGE_NUMBER,
+    IMAGE_STRING,
+    IMAGE_SYMBOL,
+    IMAGE_CHAR,
+    IMAGE_ERROR,
+    IMAGE_PRIMITIVE,
+    IMAGE_COMPOUND,
+    IMAGE_MACRO,
+    IMAGE_TEMPLATE,
+};
+
+/* a reference is NIL, one of the booleans or a node index + IMAGE_REF_NODE */
+#define IMAGE_REF_NIL 0
+#define IMAGE_REF_TRUE 1
+#define IMAGE_REF_FALSE 2
+#define IMAGE_REF_NODE 3
+
+/* a symbol reference, or none */
+#define IMAGE_NO_SYMBOL 0xffffffff
+
+/* the pair is a marked named let tail call */
+#define IMAGE_PAIR_TAIL_CALL 0x1
+
+#define IMAGE_TEMPLATE_MACRO_USE 0x1
+#define IMAGE_TEMPLATE_MAKES_CLOSURE 0x2
+#define IMAGE_TEMPLATE_LOOP_ESCAPES 0x4
+
+struct image_buf {
+    char *data;
+    size_t len;
+    size_t size;
+};
+
+static void image_put(struct image_buf *b, const void *p, size_t n) {
+    if (b->len + n > b->size) {
+        b->size = b->size ? b->size * 2 : 4096;
+        if (b->size < b->len + n) {
+            b->size = b->len + n;
+        }
+        b->data = my_realloc(b->data, b->size);
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void image_put_u8(struct image_buf *b, u8 v) { image_put(b, &v, 1); }
+
+static void image_put_u32(struct image_buf *b, u32 v) { image_put(b, &v, 4); }
+
+/* open addressing from a pointer to index + 1, 0 is empty */
+struct image_map {
+    const void **keys;
+    u32 *values;
+    size_t capacity;
+    u32 count;
+};
+
+static size_t image_map_slot(struct image_map *m, const void *p) {
+    size_t i = ((unsigned long)p >> 4) * 0x9e3779b97f4a7c15ull;
+    for (i &= m->capacity - 1; m->keys[i] && m->keys[i] != p;
+         i = (i + 1) & (m->capacity - 1)) {
+    }
+    return i;
+}
+
+/* index of p, adding it as the next index if it is new */
+static u32 image_map_get(struct image_map *m, const void *p, bool *added) {
+    *added = false;
+    if (m->capacity) {
+        size_t slot = image_map_slot(m, p);
+        if (m->keys[slot] == p) {
+            return m->values[slot] - 1;
+        }
+    }
+
+    if ((m->count + 1) * 2 > m->capacity) {
+        const void **keys = m->keys;
+        u32 *values = m->values;
+        size_t capacity = m->capacity;
+
+        m->capacity = capacity ? capacity * 2 : 256;
+        m->keys = my_malloc(m->capacity * sizeof(void *));
+        m->values = my_malloc(m->capacity * sizeof(u32));
+        for (size_t i = 0; i < capacity; i++) {
+            if (keys[i]) {
+                size_t slot = image_map_slot(m, keys[i]);
+                m->keys[slot] = keys[i];
+                m->values[slot] = values[i];
+            }
+        }
+        my_free(keys);
+        my_free(values);
+    }
+
+    size_t slot = image_map_slot(m, p);
+    m->keys[slot] = p;
+    m->values[slot] = ++m->count;
+    *added = true;
+    return m->count - 1;
+}
+
+static void free_image_map(struct image_map *m) {
+    my_free(m->keys);
+    my_free(m->values);
+}
+
+/*
+ * nodes are numbered as they are first referenced and written in that
+ * order, so writing node i discovers the nodes after it and nothing
+ * recurses
+ */
+struct image_writer {
+    struct image_buf nodes;
+    struct image_buf symbols;
+    struct image_map node_map;
+    struct image_map symbol_map;
+    const void **node_ptrs;
+    bool *node_is_env;
+    u32 node_capacity;
+};
+
+static u32 image_node(struct image_writer *w, const void *p, bool is_env) {
+    bool added;
+    u32 index = image_map_get(&w->node_map, p, &added);
+    if (added) {
+        if (index == w->node_capacity) {
+            w->node_capacity = w->node_capacity ? w->node_capacity * 2 : 256;
+            w->node_ptrs =
+                my_realloc(w->node_ptrs, w->node_capacity * sizeof(void *));
+            w->node_is_env =
+                my_realloc(w->node_is_env, w->node_capacity * sizeof(bool));
+        }
+        w->node_ptrs[index] = p;
+        w->node_is_env[index] = is_env;
+    }
+    return index + IMAGE_REF_NODE;
+}
+
+static void image_put_object(struct image_writer *w, object *o) {
+    u32 ref = IMAGE_REF_NIL;
+    if (o && o->type == T_BOOLEAN) {
+        ref = o->bool_val ? IMAGE_REF_TRUE : IMAGE_REF_FALSE;
+    } else if (o) {
+        ref = image_node(w, o, false);
+    }
+    image_put_u32(&w->nodes, ref);
+}
+
+static void image_put_env(struct image_writer *w, env *e) {
+    image_put_u32(&w->nodes, e ? image_node(w, e, true) : IMAGE_REF_NIL);
+}
+
+static void image_put_symbol(struct image_writer *w, symbol *s) {
+    if (!s) {
+        image_put_u32(&w->nodes, IMAGE_NO_SYMBOL);
+        return;
+    }
+
+    bool added;
+    u32 index = image_map_get(&w->symbol_map, s, &added);
+    if (added) {
+        u32 len = strlen(s->name);
+        image_put_u32(&w->symbols, len);
+        image_put(&w->symbols, s->name, len);
+    }
+    image_put_u32(&w->nodes, index);
+}
+
+static void image_put_symbol_set(struct image_writer *w, symbol_set *set) {
+    image_put_u32(&w->nodes, set->count);
+    for (int i = 0; i < set->count; i++) {
+        image_put_symbol(w, set->symbols[i]);
+    }
+}
+
+static void image_put_env_node(struct image_writer *w, env *e) {
+    struct image_buf *b = &w->nodes;
+    image_put_u8(b, IMAGE_ENV);
+    image_put_env(w, e->parent);
+    image_put_object(w, e->template);
+    image_put_u32(b, e->count);
+    for (int i = 0; i < e->count; i++) {
+        image_put_symbol(w, e->symbols[i]);
+        image_put_object(w, e->objects[i]);
+    }
+}
+
+static object *image_put_object_node(struct image_writer *w, object *o) {
+    struct image_buf *b = &w->nodes;
+    switch (o->type) {
+    case T_PAIR:
+        image_put_u8(b, IMAGE_PAIR);
+        image_put_object(w, o->pair->car);
+        image_put_object(w, o->pair->cdr);
+        image_put_u8(b, pair_is_tail_call(o) ? IMAGE_PAIR_TAIL_CALL : 0);
+        break;
+    case T_NUMBER:
+        image_put_u8(b, IMAGE_NUMBER);
+        image_put_u8(b, o->number->flag.size);
+        image_put(b, o->number, o->number->flag.size);
+        break;
+    case T_STRING:
+        image_put_u8(b, IMAGE_STRING);
+        image_put_u32(b, o->str->len);
+        image_put(b, o->str->str_p, o->str->len);
+        break;
+    case T_SYMBOL:
+        image_put_u8(b, IMAGE_SYMBOL);
+        image_put_symbol(w, o->symbol);
+        break;
+    case T_CHARACTER:
+        image_put_u8(b, IMAGE_CHAR);
+        image_put(b, &o->char_val, sizeof(u16));
+        break;
+    case T_ERR: {
+        const char *msg = error_message(o->err);
+        u32 len = strlen(msg);
+        image_put_u8(b, IMAGE_ERROR);
+        image_put_u32(b, len);
+        image_put(b, msg, len);
+        break;
+    }
+    case T_PRIMITIVE_PROC: {
+        int index = primitive_index(o->primitive_proc->proc);
+        if (index < 0) {
+            return new_error("Exception: image can not save a primitive "
+                             "missing from the primitive table");
+        }
+        image_put_u8(b, IMAGE_PRIMITIVE);
+        image_put_u32(b, index);
+        break;
+    }
+    case T_COMPOUND_PROC:
+        image_put_u8(b, IMAGE_COMPOUND);
+        image_put_object(w, o->compound_proc->template);
+        image_put_env(w, o->compound_proc->env);
+        break;
+    case T_MACRO_PROC:
+        image_put_u8(b, IMAGE_MACRO);
+        image_put_object(w, o->macro_proc->literals);
+        image_put_object(w, o->macro_proc->syntax_rules);
+        break;
+    case T_TEMPLATE: {
+        lambda_template *t = o->template;
+        image_put_u8(b, IMAGE_TEMPLATE);
+        image_put_u32(b, t->param_count);
+        for (int i = 0; i < t->param_count; i++) {
+            image_put_symbol(w, t->params[i]);
+        }
+        image_put_symbol(w, t->varg);
+        image_put_object(w, t->body);
+        image_put_symbol_set(w, &t->free_vars);
+        image_put_symbol_set(w, &t->assigned);
+        image_put_symbol_set(w, &t->defines);
+        image_put_symbol(w, t->loop);
+        image_put_u8(b, (t->macro_use ? IMAGE_TEMPLATE_MACRO_USE : 0) |
+                            (t->makes_closure ? IMAGE_TEMPLATE_MAKES_CLOSURE
+                                              : 0) |
+                            (t->loop_escapes ? IMAGE_TEMPLATE_LOOP_ESCAPES
+                                             : 0));
+        break;
+    }
+    default:
+        return new_error("Exception: image can not save a %s", type_name(o));
+    }
+    return NIL;
+}
+
+object *image_write(env *global, char **buf, size_t *len) {
+    struct image_writer w = {};
+    object *ret_val = NIL;
+
+    image_node(&w, global, true);
+    for (u32 i = 0; i < w.node_map.count; i++) {
+        if (w.node_is_env[i]) {
+            image_put_env_node(&w, (env *)w.node_ptrs[i]);
+            continue;
+        }
+        ERROR(image_put_object_node(&w, (object *)w.node_ptrs[i])) {
+            ret_val = error;
+            goto ret;
+        }
+    }
+
+    struct image_buf out = {};
+    image_put(&out, IMAGE_MAGIC, IMAGE_MAGIC_SIZE);
+    image_put_u32(&out, IMAGE_VERSION);
+    image_put_u32(&out, w.symbol_map.count);
+    image_put(&out, w.symbols.data, w.symbols.len);
+    image_put_u32(&out, w.node_map.count);
+    image_put(&out, w.nodes.data, w.nodes.len);
+    *buf = out.data;
+    *len = out.len;
+
+ret:
+    my_free(w.nodes.data);
+    my_free(w.symbols.data);
+    free_image_map(&w.node_map);
+    free_image_map(&w.symbol_map);
+    my_free(w.node_ptrs);
+    my_free(w.node_is_env);
+    return ret_val;
+}
+
+/*
+ * reading takes three passes over the nodes: allocate every node, check
+ * every reference, then link. refcounts come out as the number of
+ * references to each node.
+ */
+enum image_pass {
+    IMAGE_ALLOC,
+    IMAGE_CHECK,
+    IMAGE_LINK,
+};
+
+struct image_reader {
+    const char *cur;
+    const char *end;
+    symbol **symbols;
+    u32 symbol_count;
+    /* object or env per node */
+    void **nodes;
+    bool *node_is_env;
+    u32 node_count;
+    bool corrupt;
+};
+
+static void image_get(struct image_reader *r, void *p, size_t n) {
+    if ((size_t)(r->end - r->cur) < n) {
+        r->corrupt = true;
+        memset(p, 0, n);
+        return;
+    }
+    memcpy(p, r->cur, n);
+    r->cur += n;
+}
+
+static u32 image_get_u32(struct image_reader *r) {
+    u32 v;
+    image_get(r, &v, 4);
+    return v;
+}
+
+static u8 image_get_u8(struct image_reader *r) {
+    u8 v;
+    image_get(r, &v, 1);
+    return v;
+}
+
+static const char *image_get_bytes(struct image_reader *r, size_t n) {
+    const char *p = r->cur;
+    if ((size_t)(r->end - r->cur) < n) {
+        r->corrupt = true;
+        return NULL;
+    }
+    r->cur += n;
+    return p;
+}
+
+static symbol *image_get_symbol(struct image_reader *r, bool nullable) {
+    u32 index = image_get_u32(r);
+    if (index == IMAGE_NO_SYMBOL && nullable) {
+        return NULL;
+    }
+    if (index >= r->symbol_count) {
+        r->corrupt = true;
+        return NULL;
+    }
+    return r->symbols[index];
+}
+
+static void image_get_symbol_set(struct image_reader *r, symbol_set *set,
+                                 enum image_pass pass) {
+    u32 count = image_get_u32(r);
+    if ((size_t)(r->end - r->cur) / 4 < count) {
+        r->corrupt = true;
+        return;
+    }
+    if (pass == IMAGE_ALLOC && count) {
+        set->symbols = my_malloc(count * sizeof(symbol *));
+        set->capacity = count;
+    }
+    for (u32 i = 0; i < count && !r->corrupt; i++) {
+        symbol *s = image_get_symbol(r, false);
+        if (pass == IMAGE_ALLOC) {
+            set->symbols[set->count++] = s;
+        }
+    }
+}
+
+static object *image_get_object(struct image_reader *r, enum image_pass pass) {
+    u32 node_ref = image_get_u32(r);
+    if (node_ref == IMAGE_REF_NIL || pass == IMAGE_ALLOC) {
+        return NIL;
+    }
+    if (node_ref < IMAGE_REF_NODE) {
+        return pass == IMAGE_LINK ? new_boolean(node_ref == IMAGE_REF_TRUE)
+                                  : NIL;
+    }
+
+    u32 index = node_ref - IMAGE_REF_NODE;
+    if (index >= r->node_count || r->node_is_env[index]) {
+        r->corrupt = true;
+        return NIL;
+    }
+    return pass == IMAGE_LINK ? ref(r->nodes[index]) : NIL;
+}
+
+static env *image_get_env(struct image_reader *r, enum image_pass pass) {
+    u32 node_ref = image_get_u32(r);
+    if (node_ref == IMAGE_REF_NIL || pass == IMAGE_ALLOC) {
+        return NULL;
+    }
+
+    u32 index = node_ref - IMAGE_REF_NODE;
+    if (node_ref < IMAGE_REF_NODE || index >= r->node_count ||
+        !r->node_is_env[index]) {
+        r->corrupt = true;
+        return NULL;
+    }
+    return pass == IMAGE_LINK ? env_ref(r->nodes[index]) : NULL;
+}
+
+static object *image_new_object(object_type type) {
+    object *o = my_malloc(sizeof(object));
+    o->type = type;
+    return o;
+}
+
+static void image_get_env_node(struct image_reader *r, u32 i,
+                               enum image_pass pass) {
+    env *parent = image_get_env(r, pass);
+    object *template = image_get_object(r, pass);
+    u32 count = image_get_u32(r);
+    if ((size_t)(r->end - r->cur) / 8 < count) {
+        r->corrupt = true;
+        return;
+    }
+
+    env *e = r->nodes[i];
+    if (pass == IMAGE_ALLOC) {
+        e = r->nodes[i] = new_env_sized(NULL, count);
+        e->ref_count = 0;
+        r->node_is_env[i] = true;
+    } else if (pass == IMAGE_LINK) {
+        e->parent = parent;
+        e->template = template;
+    }
+
+    for (u32 j = 0; j < count && !r->corrupt; j++) {
+        symbol *s = image_get_symbol(r, false);
+        object *o = image_get_object(r, pass);
+        if (pass == IMAGE_ALLOC) {
+            e->symbols[j] = s;
+        } else if (pass == IMAGE_LINK) {
+            e->objects[e->count++] = o;
+        }
+    }
+}
+
+static void image_get_object_node(struct image_reader *r, u8 tag, u32 i,
+                                  enum image_pass pass) {
+    object *o = r->nodes[i];
+
+    switch (tag) {
+    case IMAGE_PAIR: {
+        if (pass == IMAGE_ALLOC) {
+            o = image_new_object(T_PAIR);
+            o->pair = my_malloc(sizeof(pair));
+        }
+        object *car = image_get_object(r, pass);
+        object *cdr = image_get_object(r, pass);
+        u8 flags = image_get_u8(r);
+        if (pass == IMAGE_LINK) {
+            o->pair->car = car;
+            o->pair->cdr = cdr;
+            if (flags & IMAGE_PAIR_TAIL_CALL) {
+                pair_mark_tail_call(o);
+            }
+        }
+        break;
+    }
+    case IMAGE_NUMBER: {
+        u8 size = image_get_u8(r);
+        const char *p = image_get_bytes(r, size);
+        if (!p || size < sizeof(number)) {
+            r->corrupt = true;
+        } else if (pass == IMAGE_ALLOC) {
+            o = image_new_object(T_NUMBER);
+            o->number = my_malloc(size);
+            memcpy(o->number, p, size);
+            if (o->number->flag.size != size) {
+                r->corrupt = true;
+            }
+        }
+        break;
+    }
+    case IMAGE_STRING:
+    case IMAGE_ERROR: {
+        u32 len = image_get_u32(r);
+        const char *p = image_get_bytes(r, len);
+        if (p && pass == IMAGE_ALLOC) {
+            if (tag == IMAGE_STRING) {
+                o = image_new_object(T_STRING);
+                o->str = make_string((char *)p, len);
+            } else {
+                o = image_new_object(T_ERR);
+                o->err = make_error_text(p, len);
+            }
+        }
+        break;
+    }
+    case IMAGE_SYMBOL: {
+        symbol *s = image_get_symbol(r, false);
+        if (pass == IMAGE_ALLOC) {
+            o = image_new_object(T_SYMBOL);
+            o->symbol = s;
+        }
+        break;
+    }
+    case IMAGE_CHAR: {
+        u16 ch;
+        image_get(r, &ch, sizeof(u16));
+        if (pass == IMAGE_ALLOC) {
+            o = image_new_object(T_CHARACTER);
+            o->char_val = ch;
+        }
+        break;
+    }
+    case IMAGE_PRIMITIVE: {
+        primitive_proc_ptr *proc = primitive_at(image_get_u32(r));
+        if (!proc) {
+            r->corrupt = true;
+        } else if (pass == IMAGE_ALLOC) {
+            o = new_primitive_proc(proc);
+            o->ref_count = 0;
+        }
+        break;
+    }
+    case IMAGE_COMPOUND: {
+        if (pass == IMAGE_ALLOC) {
+            /* the proc lives in the allocation of its object */
+            o = make_compound_proc(NULL, NULL);
+            o->ref_count = 0;
+        }
+        object *template = image_get_object(r, pass);
+        env *e = image_get_env(r, pass);
+        if (pass == IMAGE_LINK) {
+            o->compound_proc->template = template;
+            o->compound_proc->env = e;
+        }
+        break;
+    }
+    case IMAGE_MACRO: {
+        if (pass == IMAGE_ALLOC) {
+            o = image_new_object(T_MACRO_PROC);
+            o->macro_proc = my_malloc(sizeof(macro_proc));
+        }
+        object *literals = image_get_object(r, pass);
+        object *syntax_rules = image_get_object(r, pass);
+        if (pass == IMAGE_LINK) {
+            o->macro_proc->literals = literals;
+            o->macro_proc->syntax_rules = syntax_rules;
+        }
+        break;
+    }
+    case IMAGE_TEMPLATE: {
+        lambda_template *t = NULL;
+        if (pass == IMAGE_ALLOC) {
+            o = image_new_object(T_TEMPLATE);
+            t = o->template = my_malloc(sizeof(lambda_template));
+        }
+
+        u32 param_count = image_get_u32(r);
+        if ((size_t)(r->end - r->cur) / 4 < param_count) {
+            r->corrupt = true;
+            break;
+        }
+        if (t) {
+            t->params = my_malloc(param_count * sizeof(symbol *));
+            t->param_count = param_count;
+        }
+        for (u32 j = 0; j < param_count; j++) {
+            symbol *s = image_get_symbol(r, false);
+            if (t) {
+                t->params[j] = s;
+            }
+        }
+
+        symbol *varg = image_get_symbol(r, true);
+        object *body = image_get_object(r, pass);
+        image_get_symbol_set(r, t ? &t->free_vars : NULL, pass);
+        image_get_symbol_set(r, t ? &t->assigned : NULL, pass);
+        image_get_symbol_set(r, t ? &t->defines : NULL, pass);
+        symbol *loop = image_get_symbol(r, true);
+        u8 flags = image_get_u8(r);
+        if (t) {
+            t->varg = varg;
+            t->loop = loop;
+            t->macro_use = flags & IMAGE_TEMPLATE_MACRO_USE;
+            t->makes_closure = flags & IMAGE_TEMPLATE_MAKES_CLOSURE;
+            t->loop_escapes = flags & IMAGE_TEMPLATE_LOOP_ESCAPES;
+        }
+        if (pass == IMAGE_LINK) {
+            o->template->body = body;
+        }
+        break;
+    }
+    default:
+        r->corrupt = true;
+        break;
+    }
+
+    if (pass == IMAGE_ALLOC) {
+        r->nodes[i] = o;
+    }
+}
+
+static void image_pass(struct image_reader *r, const char *nodes,
+                       enum image_pass pass) {
+    r->cur = nodes;
+    for (u32 i = 0; i < r->node_count && !r->corrupt; i++) {
+        u8 tag = image_get_u8(r);
+        if (tag == IMAGE_ENV) {
+            image_get_env_node(r, i, pass);
+        } else {
+            image_get_object_node(r, tag, i, pass);
+        }
+    }
+}
+
+/* nodes are not linked yet, so each is freed on its own */
+static void image_free_nodes(struct image_reader *r) {
+    for (u32 i = 0; i < r->node_count; i++) {
+        if (!r->nodes[i]) {
+            continue;
+        }
+        if (r->node_is_env[i]) {
+            env *e = r->nodes[i];
+            e->ref_count = 1;
+            env_unref(e);
+        } else {
+            object *o = r->nodes[i];
+            o->ref_count = 1;
+            unref(o);
+        }
+    }
+}
+
+object *image_read(parse_data *data, const char *buf, size_t len,
+                   env **global) {
+    struct image_reader r = {.cur = buf, .end = buf + len};
+    object *ret_val = NIL;
+    *global = NULL;
+
+    if (len < IMAGE_MAGIC_SIZE || memcmp(buf, IMAGE_MAGIC, IMAGE_MAGIC_SIZE)) {
+        return new_error("Exception: not an image");
+    }
+    r.cur += IMAGE_MAGIC_SIZE;
+    if (image_get_u32(&r) != IMAGE_VERSION) {
+        return new_error("Exception: unsupported image version");
+    }
+
+    r.symbol_count = image_get_u32(&r);
+    if ((size_t)(r.end - r.cur) / 4 < r.symbol_count) {
+        return new_error("Exception: corrupt image");
+    }
+    r.symbols = my_malloc(r.symbol_count * sizeof(symbol *));
+    for (u32 i = 0; i < r.symbol_count && !r.corrupt; i++) {
+        u32 n = image_get_u32(&r);
+        const char *name = image_get_bytes(&r, n);
+        if (name) {
+            r.symbols[i] = lookup_n(data, name, n);
+        }
+    }
+
+    r.node_count = image_get_u32(&r);
+    if (r.corrupt || !r.node_count ||
+        (size_t)(r.end - r.cur) < r.node_count) {
+        my_free(r.symbols);
+        return new_error("Exception: corrupt image");
+    }
+    r.nodes = my_malloc(r.node_count * sizeof(void *));
+    r.node_is_env = my_malloc(r.node_count * sizeof(bool));
+
+    const char *nodes = r.cur;
+    image_pass(&r, nodes, IMAGE_ALLOC);
+    if (!r.corrupt) {
+        image_pass(&r, nodes, IMAGE_CHECK);
+    }
+    if (r.corrupt || !r.node_is_env[0]) {
+        image_free_nodes(&r);
+        ret_val = new_error("Exception: corrupt image");
+    } else {
+        image_pass(&r, nodes, IMAGE_LINK);
+        *global = env_ref(r.nodes[0]);
+    }
+
+    my_free(r.symbols);
+    my_free(r.nodes);
+    my_free(r.node_is_env);
+    return ret_val;
+}
+
+#ifndef MY_OS
+object *image_write_file(env *global, const char *path) {
+    char *buf;
+    size_t len;
+    ERROR(image_write(global, &buf, &len)) { return error; }
+
+    object *ret_val = NIL;
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        ret_val = new_error("Exception: can not open image %s", path);
+    } else {
+        if (fwrite(buf, 1, len, out) != len) {
+            ret_val = new_error("Exception: can not write image %s", path);
+        }
+        fclose(out);
+    }
+    my_free(buf);
+    return ret_val;
+}
+
+object *image_read_file(parse_data *data, const char *path, env **global) {
+    *global = NULL;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return new_error("Exception: can not open image %s", path);
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return new_error("Exception: can not map image %s", path);
+    }
+    object *ret_val = image_read(data, map, st.st_size, global);
+    munmap(map, st.st_size);
+    return ret_val;
+}
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "my_lisp.h"
+
+/*
+ * heap image: everything reachable from the global env (frames, closures,
+ * templates, macros and data) as a flat table of nodes that refer to each
+ * other by index. primitives are stored as their index in the primitive
+ * table and symbols by name, so an image is only valid for the build that
+ * wrote it. evaluator caches are not saved and are rebuilt on use, except
+ * the marks of named let tail calls.
+ */
+#define IMAGE_MAGIC "\x7f" "IMG"
+#define IMAGE_MAGIC_SIZE 4
+#define IMAGE_VERSION 1
+
+/* encode the global env into a my_malloc buffer, NIL or an error */
+object *image_write(env *global, char **buf, size_t *len);
+/* rebuild a global env from an image, NIL or an error */
+object *image_read(parse_data *data, const char *buf, size_t len,
+                   env **global);
+
+#ifndef MY_OS
+object *image_write_file(env *global, const char *path);
+object *image_read_file(parse_data *data, const char *path, env **global);
+#endif
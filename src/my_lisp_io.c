@@ -1,21 +1,477 @@
 #include "my_lisp_io.h"
 
+#ifndef MY_OS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "my_lisp.lex.h"
+#include "my_lisp_fasl.h"
+#include "my_lisp_scan.h"
 
-int eval_from_io(struct lisp_ctx *ctx, FILE *fi) {
-    yyset_in(fi, ctx->scanner);
+/* print the value of a top level form, unless quiet and not an error */
+static void echo(struct lisp_ctx *ctx, object *value) {
+    if (ctx->opt.quiet && !(value && value->type == T_ERR)) {
+        unref(value);
+        return;
+    }
+    object_write(&ctx->out, value, ctx->global_env);
+    lisp_out_putc(&ctx->out, '\n');
+    if (ctx->opt.flush == LISP_FLUSH_FORM) {
+        lisp_out_flush(&ctx->out);
+    }
+}
+
+#ifndef MY_OS
+/* parsed top level datums in flight between the reader and the evaluator */
+#define PIPELINE_DEPTH 64
+
+struct pipeline_item {
+    object *ast;
+    /* booleans in ast the evaluator still has to claim */
+    u32 bool_refs[2];
+    bool is_eof;
+};
+
+/* a bounded queue with one reader thread pushing and the evaluator popping */
+struct pipeline {
+    struct lisp_ctx *ctx;
+    /* the reader's parse data, sharing the symbol table and scanner */
+    parse_data data;
+    u32 bool_refs[2];
+    pthread_mutex_t symtab_lock;
+
+    struct pipeline_item items[PIPELINE_DEPTH];
+    size_t head;
+    size_t tail;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+static void pipeline_push(struct pipeline *p, struct pipeline_item item) {
+    pthread_mutex_lock(&p->lock);
+    while (p->tail - p->head == PIPELINE_DEPTH) {
+        pthread_cond_wait(&p->not_full, &p->lock);
+    }
+    p->items[p->tail++ % PIPELINE_DEPTH] = item;
+    pthread_cond_signal(&p->not_empty);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static struct pipeline_item pipeline_pop(struct pipeline *p) {
+    pthread_mutex_lock(&p->lock);
+    while (p->tail == p->head) {
+        pthread_cond_wait(&p->not_empty, &p->lock);
+    }
+    struct pipeline_item item = p->items[p->head++ % PIPELINE_DEPTH];
+    pthread_cond_signal(&p->not_full);
+    pthread_mutex_unlock(&p->lock);
+    return item;
+}
+
+/*
+ * the reader owns each datum until it is pushed. it touches no refcount
+ * the evaluator can see: symbols are interned under symtab_lock and
+ * booleans are counted in bool_refs and handed over with the datum.
+ */
+static void *pipeline_reader(void *arg) {
+    struct pipeline *p = arg;
+    parse_data *data = &p->data;
+
+    struct pipeline_item item;
+    do {
+        yyparse(p->ctx->scanner, data);
+        item.ast = data->ast;
+        item.bool_refs[false] = p->bool_refs[false];
+        item.bool_refs[true] = p->bool_refs[true];
+        item.is_eof = data->is_eof;
+        data->ast = NULL;
+        p->bool_refs[false] = p->bool_refs[true] = 0;
+        pipeline_push(p, item);
+    } while (!item.is_eof);
+    return NULL;
+}
+
+/* the input is already set up, returns -1 if the reader cannot start */
+static int eval_pipelined(struct lisp_ctx *ctx) {
+    struct pipeline *p = my_malloc(sizeof(struct pipeline));
+    p->ctx = ctx;
+    p->data = (parse_data){
+        .symtab = ctx->parse_data->symtab,
+        .scan = ctx->parse_data->scan,
+        .symtab_lock = &p->symtab_lock,
+        .bool_refs = p->bool_refs,
+    };
+    p->bool_refs[false] = p->bool_refs[true] = 0;
+    p->head = p->tail = 0;
+    pthread_mutex_init(&p->symtab_lock, NULL);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->not_empty, NULL);
+    pthread_cond_init(&p->not_full, NULL);
+
+    ctx->parse_data->symtab_lock = &p->symtab_lock;
+    yyset_extra(&p->data, ctx->scanner);
+
+    pthread_t reader;
+    int ret = pthread_create(&reader, NULL, pipeline_reader, p);
+    if (!ret) {
+        struct pipeline_item item;
+        do {
+            item = pipeline_pop(p);
+            claim_booleans(item.bool_refs);
+            object *value =
+                eval_from_ast(item.ast, ctx->global_env, ctx->parse_data);
+            echo(ctx, value);
+        } while (!item.is_eof);
+        pthread_join(reader, NULL);
+        ctx->parse_data->is_eof = true;
+    }
+
+    yyset_extra(ctx->parse_data, ctx->scanner);
+    ctx->parse_data->symtab_lock = NULL;
+    pthread_cond_destroy(&p->not_full);
+    pthread_cond_destroy(&p->not_empty);
+    pthread_mutex_destroy(&p->lock);
+    pthread_mutex_destroy(&p->symtab_lock);
+    my_free(p);
+    return ret ? -1 : 0;
+}
+#endif
+
+/* evaluate the datums of a fasl stream in order */
+static int eval_from_fasl(struct lisp_ctx *ctx, FILE *fi) {
+    size_t size = 64 * 1024;
+    size_t len = 0;
+    char *buf = my_malloc(size);
+    size_t n;
+    while ((n = fread(buf + len, 1, size - len, fi)) > 0) {
+        len += n;
+        if (len == size) {
+            size *= 2;
+            buf = my_realloc(buf, size);
+        }
+    }
+    fclose(fi);
+
+    object *datums = fasl_read(ctx->parse_data, buf, len);
+    my_free(buf);
+    ERROR_REF(datums) {
+        unref(datums);
+        echo(ctx, error);
+        lisp_out_flush(&ctx->out);
+        return -1;
+    }
+
+    object *o = NIL;
+    for_each_object_list_entry(o, datums) {
+        object *value = eval_from_ast(ref(o), ctx->global_env, ctx->parse_data);
+        echo(ctx, value);
+    }
+    unref(datums);
+    lisp_out_flush(&ctx->out);
+    return 0;
+}
+
+static int eval_from_file(struct lisp_ctx *ctx, FILE *fi) {
+    int c = getc(fi);
+    ungetc(c, fi);
+    if (c == FASL_MAGIC[0]) {
+        return eval_from_fasl(ctx, fi);
+    }
+
+    if (ctx->parse_data->scan) {
+        if (lisp_scan_set_file(ctx->parse_data->scan, fi) < 0) {
+            fclose(fi);
+            return -1;
+        }
+    } else {
+        yyset_in(fi, ctx->scanner);
+    }
+#ifndef MY_OS
+    if (ctx->opt.pipeline && eval_pipelined(ctx) == 0) {
+        lisp_out_flush(&ctx->out);
+        fclose(fi);
+        return 0;
+    }
+#endif
     while (!my_lisp_is_eof(ctx)) {
         yyparse(ctx->scanner, ctx->parse_data);
         object *value = eval_from_ast(ctx->parse_data->ast, ctx->global_env,
                                       ctx->parse_data);
         ctx->parse_data->ast = NULL;
-        object_print(value, ctx->global_env);
-        my_printf("\n");
+        echo(ctx, value);
     }
+    lisp_out_flush(&ctx->out);
     fclose(fi);
     return 0;
 }
 
+int eval_from_io(struct lisp_ctx *ctx, FILE *fi) {
+    char *limit = eval_stack_enter(ctx->parse_data);
+    int ret = eval_from_file(ctx, fi);
+    eval_stack_leave(ctx->parse_data, limit);
+    return ret;
+}
+
+#ifndef MY_OS
+/* smaller inputs are not worth a thread */
+#define READ_ALL_MIN_CHUNK (256 * 1024)
+
+/*
+ * find up to n - 1 cut points about len / n apart, each at a blank between
+ * two top level datums. strings, comments and character literals are
+ * skipped so their brackets do not count.
+ */
+static int read_all_split(const char *buf, size_t len, size_t *cuts, int n) {
+    size_t step = len / n;
+    size_t next = step;
+    int depth = 0;
+    int count = 0;
+    /* a quote prefix still waiting for its datum */
+    bool prefix = false;
+
+    for (size_t i = 0; i < len && count < n - 1; i++) {
+        switch (buf[i]) {
+        case ';':
+            while (i + 1 < len && buf[i + 1] != '\n') {
+                i++;
+            }
+            break;
+        case '"':
+            for (i++; i < len && buf[i] != '"'; i++) {
+                i += buf[i] == '\\';
+            }
+            prefix = false;
+            break;
+        case '#':
+            if (i + 1 < len && buf[i + 1] == '\\') {
+                i += 2;
+                prefix = false;
+            } else if (i + 1 < len && strchr("'`,", buf[i + 1])) {
+                i++;
+                prefix = true;
+            } else {
+                prefix = false;
+            }
+            break;
+        case '\'':
+        case '`':
+        case ',':
+        case '@':
+            prefix = true;
+            break;
+        case '(':
+        case '[':
+            depth++;
+            prefix = false;
+            break;
+        case ')':
+        case ']':
+            depth--;
+            break;
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            if (!depth && !prefix && i >= next) {
+                cuts[count++] = i;
+                next = i + step;
+            }
+            break;
+        default:
+            prefix = false;
+            break;
+        }
+    }
+    return count;
+}
+
+struct read_chunk {
+    parse_data *shared;
+    pthread_mutex_t *symtab_lock;
+    const char *buf;
+    size_t len;
+    /* the datums read, linked through tail */
+    object *head;
+    object *tail;
+    u32 bool_refs[2];
+    /* line in the chunk of the syntax error that stopped it, 0 for none */
+    int error_line;
+};
+
+/* parse one chunk with a scanner and parse data of its own */
+static void *read_chunk(void *arg) {
+    struct read_chunk *c = arg;
+    /* read_all reports a syntax error with its line in the whole text */
+    struct lisp_out errors;
+    lisp_out_init_mem(&errors);
+    parse_data data = {
+        .symtab = c->shared->symtab,
+        .scan = make_lisp_scan(),
+        .symtab_lock = c->symtab_lock,
+        .bool_refs = c->bool_refs,
+        .out = &errors,
+    };
+    c->head = c->tail = NIL;
+    c->bool_refs[false] = c->bool_refs[true] = 0;
+    c->error_line = 0;
+
+    /* only carries data to yylex, the tokens come from data.scan */
+    yyscan_t scanner;
+    if (yylex_init_extra(&data, &scanner)) {
+        free_lisp_scan(data.scan);
+        my_free(lisp_out_take(&errors));
+        return NULL;
+    }
+    lisp_scan_set_buf(data.scan, c->buf, c->len);
+
+    for (;;) {
+        if (yyparse(scanner, &data)) {
+            c->error_line = data.scan->line;
+            break;
+        }
+        if (data.is_eof) {
+            break;
+        }
+        object *last = cons(data.ast, NIL);
+        data.ast = NULL;
+        if (c->tail) {
+            setcdr(ref(c->tail), last);
+        } else {
+            c->head = last;
+        }
+        c->tail = last;
+    }
+
+    yylex_destroy(scanner);
+    free_lisp_scan(data.scan);
+    my_free(lisp_out_take(&errors));
+    return NULL;
+}
+
+object *read_all(parse_data *data, const char *buf, size_t len, int threads) {
+    if (threads <= 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if ((size_t)threads > len / READ_ALL_MIN_CHUNK) {
+        threads = len / READ_ALL_MIN_CHUNK;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    size_t cuts[threads];
+    int n = read_all_split(buf, len, cuts, threads) + 1;
+
+    /* a pipeline reader may already share the table under its own lock */
+    pthread_mutex_t symtab_lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_t *lock = data->symtab_lock;
+    if (!lock && n > 1) {
+        lock = &symtab_lock;
+    }
+
+    struct read_chunk chunks[n];
+    pthread_t tids[n];
+    bool started[n];
+    for (int i = 0; i < n; i++) {
+        size_t start = i ? cuts[i - 1] : 0;
+        chunks[i] = (struct read_chunk){
+            .shared = data,
+            .symtab_lock = lock,
+            .buf = buf + start,
+            .len = (i < n - 1 ? cuts[i] : len) - start,
+        };
+        /* the first chunk, and any that cannot get a thread, run here */
+        started[i] =
+            i && !pthread_create(&tids[i], NULL, read_chunk, &chunks[i]);
+    }
+
+    object *head = NIL;
+    object *tail = NIL;
+    int error_line = 0;
+    for (int i = 0; i < n; i++) {
+        if (!started[i]) {
+            read_chunk(&chunks[i]);
+        } else {
+            pthread_join(tids[i], NULL);
+        }
+        claim_booleans(chunks[i].bool_refs);
+
+        if (chunks[i].error_line && !error_line) {
+            /* lines of the chunks before, the chunk counts from 1 */
+            const char *start = chunks[i].buf;
+            error_line = chunks[i].error_line;
+            for (const char *p = buf; p < start; p++) {
+                error_line += *p == '\n';
+            }
+        }
+        if (!chunks[i].head) {
+            continue;
+        }
+        if (tail) {
+            setcdr(ref(tail), chunks[i].head);
+        } else {
+            head = chunks[i].head;
+        }
+        tail = chunks[i].tail;
+    }
+
+    /* the datums after an error are not read, so there is no list */
+    if (error_line) {
+        unref(head);
+        return new_error("Exception: read-all syntax error at line %d",
+                         error_line);
+    }
+    return head;
+}
+
+object *read_all_from_file(parse_data *data, const char *path, int threads) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return new_error("Exception: read-all can not open %s", path);
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return NIL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return new_error("Exception: read-all can not map %s", path);
+    }
+    madvise(map, st.st_size, MADV_WILLNEED);
+
+    object *ret_val = read_all(data, map, st.st_size, threads);
+    munmap(map, st.st_size);
+    return ret_val;
+}
+
+object *primitive_read_all(env *e, object *args, parse_data *data) {
+    ERROR(assert_fun_args_count("read-all", ref(args), 1)) {
+        unref(args);
+        return error;
+    }
+
+    object *path = eval_from_ast(car(args), e, data);
+    ERROR(assert_fun_arg_type("read-all", ref(path), 0, T_STRING)) {
+        unref(path);
+        return error;
+    }
+
+    object *ret_val = read_all_from_file(data, path->str->str_p, 0);
+    unref(path);
+    return ret_val;
+}
+#endif
+
 bool my_lisp_is_eof(struct lisp_ctx *ctx) { return ctx->parse_data->is_eof; }
 
 void yyerror(YYLTYPE *yylloc, yyscan_t scanner, parse_data *data, const char *s,
@@ -23,10 +479,19 @@ void yyerror(YYLTYPE *yylloc, yyscan_t scanner, parse_data *data, const char *s,
     va_list ap;
     va_start(ap, s);
 
-    my_printf("%d: error: ", yyget_lineno(scanner));
-
-    my_printf(s, ap);
-    my_printf("\n");
+    int line = data->scan ? data->scan->line : yyget_lineno(scanner);
+    if (data->out) {
+        char buf[512];
+        my_sprintf(buf, "%d: error: ", line);
+        lisp_out_puts(data->out, buf);
+        my_vsprintf(buf, s, ap);
+        lisp_out_puts(data->out, buf);
+        lisp_out_putc(data->out, '\n');
+    } else {
+        my_printf("%d: error: ", line);
+        my_printf(s, ap);
+        my_printf("\n");
+    }
     va_end(ap);
 }
 
@@ -10,4 +10,16 @@
 int eval_from_io(struct lisp_ctx *ctx, FILE *);
 bool my_lisp_is_eof(struct lisp_ctx *ctx);
 
+#ifndef MY_OS
+/*
+ * read every datum in buf, unevaluated, into one list. the text is split
+ * at top level datum boundaries and parsed on up to threads threads, or
+ * one per cpu when threads is 0. a syntax error anywhere makes the result
+ * an error rather than the datums before it.
+ */
+object *read_all(parse_data *data, const char *buf, size_t len, int threads);
+object *read_all_from_file(parse_data *data, const char *path, int threads);
+object *primitive_read_all(env *e, object *args, parse_data *data);
+#endif
+
 #endif // MY_LISP_IO
@@ -0,0 +1,287 @@
+#include "my_lisp_load.h"
+
+#ifndef MY_OS
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "my_lisp_fasl.h"
+#include "my_lisp_io.h"
+#include "number.h"
+
+/* fnv-1a */
+#define LOAD_HASH_INIT 0xcbf29ce484222325ull
+
+static u64 load_hash(u64 h, const void *p, size_t len) {
+    const u8 *s = p;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ s[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+/* the hash of a macro definition, as 16 hex digits */
+static void load_macro_hash(object *macro, char hex[17]) {
+    macro_proc *proc = macro->macro_proc;
+    char *buf = NULL;
+    size_t len = 0;
+    u64 h = LOAD_HASH_INIT;
+    object *definition =
+        cons(ref(proc->literals), cons(ref(proc->syntax_rules), NIL));
+    ERROR(fasl_write(definition, &buf, &len)) {
+        unref(error);
+    }
+    h = load_hash(h, buf, len);
+    my_free(buf);
+    snprintf(hex, 17, "%016llx", (unsigned long long)h);
+}
+
+struct load {
+    env *env;
+    parse_data *data;
+    symbol *begin;
+    symbol *define;
+    symbol *define_syntax;
+    /* names defined by the top level forms evaluated so far */
+    symbol_set own;
+    /* macros from outside the file used by the expansion */
+    symbol_set used;
+    object *deps;
+    object *forms;
+    /* end of forms, NULL when there is no cache to write them to */
+    object **tail;
+};
+
+static void load_note_macro(void *ctx, symbol *name, object *macro) {
+    struct load *l = ctx;
+    if (symbol_set_has(&l->own, name) || symbol_set_has(&l->used, name)) {
+        return;
+    }
+    symbol_set_add(&l->used, name);
+
+    char hex[17];
+    load_macro_hash(macro, hex);
+    l->deps = cons(cons(new_symbol(name), new_string(make_string(hex, 16))),
+                   l->deps);
+}
+
+static bool load_deps_match(struct load *l, object *deps) {
+    for (; deps && deps->type == T_PAIR; deps = deps->pair->cdr) {
+        object *dep = deps->pair->car;
+        if (!dep || dep->type != T_PAIR || !dep->pair->car ||
+            dep->pair->car->type != T_SYMBOL || !dep->pair->cdr ||
+            dep->pair->cdr->type != T_STRING) {
+            return false;
+        }
+
+        object **slot = env_lookup(l->env, dep->pair->car->symbol);
+        bool match = slot && *slot && (*slot)->type == T_MACRO_PROC;
+        if (match) {
+            char hex[17];
+            load_macro_hash(*slot, hex);
+            match = !strcmp(hex, dep->pair->cdr->str->str_p);
+        }
+        if (!match) {
+            return false;
+        }
+    }
+    return !deps;
+}
+
+static bool load_form_is(object *form, symbol *sym) {
+    return form && form->type == T_PAIR && form->pair->car &&
+           form->pair->car->type == T_SYMBOL && form->pair->car->symbol == sym;
+}
+
+/* the name a top level define or define-syntax binds, or NULL */
+static symbol *load_define_target(struct load *l, object *form) {
+    if ((!load_form_is(form, l->define) &&
+         !load_form_is(form, l->define_syntax)) ||
+        !form->pair->cdr || form->pair->cdr->type != T_PAIR) {
+        return NULL;
+    }
+    object *target = form->pair->cdr->pair->car;
+    if (target && target->type == T_PAIR) {
+        target = target->pair->car;
+    }
+    return target && target->type == T_SYMBOL ? target->symbol : NULL;
+}
+
+static object *load_form(struct load *l, object *form) {
+    /* the forms of a top level begin are top level forms */
+    if (load_form_is(form, l->begin)) {
+        object *ret_val = NIL;
+        for (object *rest = form->pair->cdr; rest && rest->type == T_PAIR;
+             rest = rest->pair->cdr) {
+            unref(ret_val);
+            ret_val = load_form(l, ref(rest->pair->car));
+            if (ret_val && ret_val->type == T_ERR) {
+                break;
+            }
+        }
+        unref(form);
+        return ret_val;
+    }
+
+    object *expanded =
+        expand_macros(form, l->env, l->data, load_note_macro, l);
+    if (l->tail) {
+        *l->tail = cons(ref(expanded), NIL);
+        l->tail = &(*l->tail)->pair->cdr;
+    }
+
+    symbol *target = load_define_target(l, expanded);
+    object *ret_val = eval_from_ast(expanded, l->env, l->data);
+    if (target) {
+        symbol_set_add(&l->own, target);
+    }
+    return ret_val;
+}
+
+/* best effort, a cache that can not be written is not an error */
+static void load_cache_write(struct load *l, const char *path) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    mkdir(l->data->load_cache_dir, 0777);
+
+    ERROR(fasl_write_file(tmp, cons(ref(l->deps), ref(l->forms)))) {
+        unref(error);
+        unlink(tmp);
+        return;
+    }
+    if (rename(tmp, path)) {
+        unlink(tmp);
+    }
+}
+
+object *load_file(env *e, const char *path, parse_data *data) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return new_error("Exception: load can not open %s", path);
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return NIL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return new_error("Exception: load can not map %s", path);
+    }
+
+    /* a file loads into the global env wherever load is called from */
+    while (e->parent) {
+        e = e->parent;
+    }
+    struct load l = {
+        .env = e,
+        .data = data,
+        .begin = lookup(data, "begin"),
+        .define = lookup(data, "define"),
+        .define_syntax = lookup(data, "define-syntax"),
+    };
+    object *ret_val = NIL;
+    /* a host may call this directly, not only load */
+    char *limit = eval_stack_enter(data);
+
+    char cache[PATH_MAX] = {};
+    if (data->load_cache_dir) {
+        l.tail = &l.forms;
+        u32 versions[] = {LOAD_CACHE_VERSION, FASL_VERSION};
+        u64 h = load_hash(LOAD_HASH_INIT, versions, sizeof(versions));
+        h = load_hash(h, map, st.st_size);
+        snprintf(cache, sizeof(cache), "%s/%016llx-%llx.fasl",
+                 data->load_cache_dir, (unsigned long long)h,
+                 (unsigned long long)st.st_size);
+
+        object *entry = fasl_read_file(data, cache);
+        if (entry && entry->type == T_PAIR &&
+            load_deps_match(&l, entry->pair->car)) {
+            munmap(map, st.st_size);
+            data->load_cache_hits++;
+            for (object *rest = entry->pair->cdr; rest && rest->type == T_PAIR;
+                 rest = rest->pair->cdr) {
+                unref(ret_val);
+                ret_val = eval_from_ast(ref(rest->pair->car), e, data);
+                if (ret_val && ret_val->type == T_ERR) {
+                    break;
+                }
+            }
+            unref(entry);
+            eval_stack_leave(data, limit);
+            return ret_val;
+        }
+        unref(entry);
+        data->load_cache_misses++;
+    }
+
+    object *datums = read_all(data, map, st.st_size, 0);
+    munmap(map, st.st_size);
+    ERROR_REF(datums) {
+        unref(datums);
+        eval_stack_leave(data, limit);
+        return error;
+    }
+
+    bool failed = false;
+    for (object *rest = datums; rest && rest->type == T_PAIR;
+         rest = rest->pair->cdr) {
+        unref(ret_val);
+        ret_val = load_form(&l, ref(rest->pair->car));
+        if (ret_val && ret_val->type == T_ERR) {
+            failed = true;
+            break;
+        }
+    }
+    unref(datums);
+
+    if (cache[0] && !failed) {
+        load_cache_write(&l, cache);
+    }
+    free_symbol_set(&l.own);
+    free_symbol_set(&l.used);
+    unref(l.deps);
+    unref(l.forms);
+    eval_stack_leave(data, limit);
+    return ret_val;
+}
+
+/* (load path) */
+object *primitive_load(env *e, object *args, parse_data *data) {
+    ERROR(assert_fun_args_count("load", ref(args), 1)) {
+        unref(args);
+        return error;
+    }
+
+    object *path = eval_from_ast(car(args), e, data);
+    ERROR(assert_fun_arg_type("load", ref(path), 0, T_STRING)) {
+        unref(path);
+        return error;
+    }
+
+    object *ret_val = load_file(e, path->str->str_p, data);
+    unref(path);
+    return ret_val;
+}
+
+/* (load-cache-stats), (hits . misses) */
+object *primitive_load_cache_stats(env *e, object *args, parse_data *data) {
+    (void)e;
+    ERROR(assert_fun_args_count("load-cache-stats", ref(args), 0)) {
+        unref(args);
+        return error;
+    }
+    unref(args);
+
+    return cons(new_number(make_number_real(data->load_cache_hits)),
+                new_number(make_number_real(data->load_cache_misses)));
+}
+#endif
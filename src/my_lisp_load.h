@@ -0,0 +1,21 @@
+#pragma once
+
+#include "my_lisp.h"
+
+/*
+ * load evaluates a file one top level form at a time, expanding its macro
+ * uses before evaluating it. with a cache dir the expanded forms are saved
+ * as a fasl named after a hash of LOAD_CACHE_VERSION and the source, and
+ * loading the same source again evaluates them without parsing or
+ * expanding. the first datum of a cache file lists the macros defined
+ * outside the file that the expansion used, as (name . hash), and the file
+ * is only used while they are unchanged.
+ */
+#define LOAD_CACHE_VERSION 1
+
+#ifndef MY_OS
+object *load_file(env *e, const char *path, parse_data *data);
+
+object *primitive_load(env *e, object *args, parse_data *data);
+object *primitive_load_cache_stats(env *e, object *args, parse_data *data);
+#endif
@@ -1,21 +1,100 @@
 #include "my_lisp.h"
+#include "my_lisp_fasl.h"
+#include "my_lisp_image.h"
 #include "my_lisp_io.h"
 #include "my_lisp.lex.h"
 
+static int usage(void) {
+    my_printf("usage: my-lisp [--fast-scanner] [--pipeline] [--quiet]\n"
+              "               [--flush form|full] [--image in.img]\n"
+              "               [--load-cache dir] [--dump-image out.img] [file]\n"
+              "       my-lisp --compile in.scm out.fasl\n");
+    return 1;
+}
+
 int main(int argc, char *argv[]) {
 #ifdef YYDEBUG
     /* yydebug = 1; */
 #endif
 
+    struct lisp_ctx_opt opt = {};
+    bool compile = false;
+    const char *dump_image = NULL;
+    for (; argc > 1 && !strncmp(argv[1], "--", 2); argc--, argv++) {
+        if (!strcmp(argv[1], "--fast-scanner")) {
+            opt.scanner = LISP_SCANNER_FAST;
+        } else if (!strcmp(argv[1], "--pipeline")) {
+            opt.pipeline = true;
+        } else if (!strcmp(argv[1], "--compile")) {
+            compile = true;
+        } else if (!strcmp(argv[1], "--image") && argc > 2) {
+            opt.image = argv[2];
+            argc--, argv++;
+        } else if (!strcmp(argv[1], "--quiet")) {
+            opt.quiet = true;
+        } else if (!strcmp(argv[1], "--flush") && argc > 2 &&
+                   (!strcmp(argv[2], "form") || !strcmp(argv[2], "full"))) {
+            opt.flush = !strcmp(argv[2], "form") ? LISP_FLUSH_FORM
+                                                 : LISP_FLUSH_FULL;
+            argc--, argv++;
+        } else if (!strcmp(argv[1], "--load-cache") && argc > 2) {
+            opt.load_cache_dir = argv[2];
+            argc--, argv++;
+        } else if (!strcmp(argv[1], "--dump-image") && argc > 2) {
+            dump_image = argv[2];
+            argc--, argv++;
+        } else {
+            /* unknown, missing its value or with a bad one */
+            return usage();
+        }
+    }
+
+    /* --compile in.scm out.fasl */
+    if (compile) {
+        if (argc != 3) {
+            return usage();
+        }
+        struct lisp_ctx *ctx = make_lisp_ctx(opt);
+        object *datums = read_all_from_file(ctx->parse_data, argv[1], 0);
+        ERROR_REF(datums) {
+            unref(datums);
+            object_print(error, ctx->global_env);
+            my_printf("\n");
+            free_lisp_ctx(&ctx);
+            return 1;
+        }
+        object *ret_val = fasl_write_file(argv[2], datums);
+        int status = 0;
+        ERROR(ret_val) {
+            object_print(error, ctx->global_env);
+            my_printf("\n");
+            status = 1;
+        }
+        free_lisp_ctx(&ctx);
+        return status;
+    }
+
     FILE *in;
     if (argc == 2 && (in = fopen(argv[1], "r")) != NULL) {
     } else {
         in = stdin;
     }
 
-    struct lisp_ctx_opt opt = {};
     struct lisp_ctx *ctx = make_lisp_ctx(opt);
+    if (!ctx) {
+        return 1;
+    }
     eval_from_io(ctx, in);
+
+    /* --dump-image out.img saves the global env once the input is done */
+    int status = 0;
+    if (dump_image) {
+        ERROR(image_write_file(ctx->global_env, dump_image)) {
+            object_print(error, ctx->global_env);
+            my_printf("\n");
+            status = 1;
+        }
+    }
     free_lisp_ctx(&ctx);
-    return 0;
+    return status;
 }
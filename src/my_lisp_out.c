@@ -0,0 +1,122 @@
+#include "my_lisp_out.h"
+
+#ifndef MY_OS
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+void lisp_out_flush(struct lisp_out *out) {
+    if (out->write && out->len) {
+        out->write(out, out->buf, out->len);
+        out->len = 0;
+    }
+}
+
+void lisp_out_write(struct lisp_out *out, const char *p, size_t n) {
+    /* one byte is kept for the NUL of console writes and lisp_out_take */
+    if (out->len + n < out->size) {
+        memcpy(out->buf + out->len, p, n);
+        out->len += n;
+        return;
+    }
+
+    if (!out->write) {
+        while (out->len + n >= out->size) {
+            out->size = out->size ? out->size * 2 : 256;
+        }
+        out->buf = my_realloc(out->buf, out->size);
+        memcpy(out->buf + out->len, p, n);
+        out->len += n;
+        return;
+    }
+
+    lisp_out_flush(out);
+    if (n < out->size) {
+        memcpy(out->buf, p, n);
+        out->len = n;
+    } else {
+        out->write(out, p, n);
+    }
+}
+
+void lisp_out_puts(struct lisp_out *out, const char *s) {
+    lisp_out_write(out, s, strlen(s));
+}
+
+void lisp_out_init_mem(struct lisp_out *out) {
+    *out = (struct lisp_out){};
+}
+
+char *lisp_out_take(struct lisp_out *out) {
+    char *s = out->buf ? out->buf : my_malloc(1);
+    s[out->len] = '\0';
+    *out = (struct lisp_out){};
+    return s;
+}
+
+#ifdef MY_OS
+/* my_printf takes strings, so the bytes go through buf NUL terminated */
+static void lisp_out_console_write(struct lisp_out *out, const char *p,
+                                   size_t n) {
+    while (n) {
+        size_t chunk = n < out->size - 1 ? n : out->size - 1;
+        memmove(out->buf, p, chunk);
+        out->buf[chunk] = '\0';
+        my_printf("%s", out->buf);
+        p += chunk;
+        n -= chunk;
+    }
+}
+
+void lisp_out_init_stdout(struct lisp_out *out, char *buf, size_t size) {
+    *out = (struct lisp_out){
+        .buf = buf,
+        .size = size,
+        .write = lisp_out_console_write,
+    };
+}
+#else
+static void lisp_out_file_write(struct lisp_out *out, const char *p,
+                                size_t n) {
+    /* buf already batches, stdio only passes it on */
+    fwrite(p, 1, n, out->file);
+    fflush(out->file);
+}
+
+static void lisp_out_fd_write(struct lisp_out *out, const char *p, size_t n) {
+    while (n) {
+        ssize_t written = write(out->fd, p, n);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        p += written;
+        n -= written;
+    }
+}
+
+void lisp_out_init_stdout(struct lisp_out *out, char *buf, size_t size) {
+    lisp_out_init_file(out, stdout, buf, size);
+}
+
+void lisp_out_init_file(struct lisp_out *out, FILE *file, char *buf,
+                        size_t size) {
+    *out = (struct lisp_out){
+        .buf = buf,
+        .size = size,
+        .write = lisp_out_file_write,
+        .file = file,
+    };
+}
+
+void lisp_out_init_fd(struct lisp_out *out, int fd, char *buf, size_t size) {
+    *out = (struct lisp_out){
+        .buf = buf,
+        .size = size,
+        .write = lisp_out_fd_write,
+        .fd = fd,
+    };
+}
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <my-os/types.h>
+
+#include "os.h"
+
+#ifndef MY_OS
+#include <stdio.h>
+#endif
+
+/*
+ * buffered output sink. writes are appended to buf and handed to write
+ * when it fills up or on lisp_out_flush. a sink without write is a memory
+ * sink whose buf grows to hold everything written.
+ */
+struct lisp_out {
+    char *buf;
+    size_t len;
+    size_t size;
+    void (*write)(struct lisp_out *out, const char *p, size_t n);
+#ifndef MY_OS
+    union {
+        FILE *file;
+        int fd;
+    };
+#endif
+};
+
+void lisp_out_write(struct lisp_out *out, const char *p, size_t n);
+void lisp_out_puts(struct lisp_out *out, const char *s);
+void lisp_out_flush(struct lisp_out *out);
+
+static inline void lisp_out_putc(struct lisp_out *out, char c) {
+    if (out->len + 1 >= out->size) {
+        lisp_out_write(out, &c, 1);
+        return;
+    }
+    out->buf[out->len++] = c;
+}
+
+void lisp_out_init_mem(struct lisp_out *out);
+/* the NUL terminated contents of a memory sink, which is left empty */
+char *lisp_out_take(struct lisp_out *out);
+
+/* the console, through buf */
+void lisp_out_init_stdout(struct lisp_out *out, char *buf, size_t size);
+#ifndef MY_OS
+void lisp_out_init_file(struct lisp_out *out, FILE *file, char *buf,
+                        size_t size);
+void lisp_out_init_fd(struct lisp_out *out, int fd, char *buf, size_t size);
+#endif
@@ -0,0 +1,789 @@
+#include "my_lisp_scan.h"
+
+#ifndef MY_OS
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "atod.h"
+#include "my_lisp.lex.h"
+
+void yyerror(YYLTYPE *yylloc, yyscan_t scanner, parse_data *data, const char *s,
+             ...);
+int yylex_flex(YYSTYPE *yylval_param, YYLTYPE *yylloc_param,
+               yyscan_t yyscanner);
+
+/* the parser calls this, whichever scanner the context selected */
+int yylex(YYSTYPE *lval, YYLTYPE *lloc, yyscan_t scanner) {
+    parse_data *data = yyget_extra(scanner);
+    if (data->scan) {
+        return lisp_scan_lex(data->scan, lval, lloc, scanner, data);
+    }
+    return yylex_flex(lval, lloc, scanner);
+}
+
+enum {
+    C_WS = 1 << 0,
+    C_DIGIT = 1 << 1,
+    /* letters and !$%&*\/:<=>?^_~ */
+    C_INITIAL = 1 << 2,
+    /* initial, digit and +-.@ */
+    C_SUBSEQUENT = 1 << 3,
+    /* ends a number or identifier */
+    C_DELIMITER = 1 << 4,
+};
+
+#define LETTER (C_INITIAL | C_SUBSEQUENT)
+
+static const u8 char_class[256] = {
+    [' '] = C_WS | C_DELIMITER,
+    ['\t'] = C_WS | C_DELIMITER,
+    ['\n'] = C_WS | C_DELIMITER,
+    ['\r'] = C_WS | C_DELIMITER,
+    ['('] = C_DELIMITER,
+    [')'] = C_DELIMITER,
+    ['['] = C_DELIMITER,
+    [']'] = C_DELIMITER,
+    ['"'] = C_DELIMITER,
+    [';'] = C_DELIMITER,
+    ['0' ... '9'] = C_DIGIT | C_SUBSEQUENT,
+    ['a' ... 'z'] = LETTER,
+    ['A' ... 'Z'] = LETTER,
+    ['!'] = LETTER,
+    ['$'] = LETTER,
+    ['%'] = LETTER,
+    ['&'] = LETTER,
+    ['*'] = LETTER,
+    ['/'] = LETTER,
+    [':'] = LETTER,
+    ['<'] = LETTER,
+    ['='] = LETTER,
+    ['>'] = LETTER,
+    ['?'] = LETTER,
+    ['^'] = LETTER,
+    ['_'] = LETTER,
+    ['~'] = LETTER,
+    ['+'] = C_SUBSEQUENT,
+    ['-'] = C_SUBSEQUENT,
+    ['.'] = C_SUBSEQUENT,
+    ['@'] = C_SUBSEQUENT,
+};
+
+static inline bool is_class(const char *p, const char *end, u8 class) {
+    return p < end && (char_class[(u8)*p] & class);
+}
+
+static inline bool is_delimiter(const char *p, const char *end) {
+    return p == end || (char_class[(u8)*p] & C_DELIMITER);
+}
+
+struct lisp_scan *make_lisp_scan(void) {
+    struct lisp_scan *scan = my_malloc(sizeof(struct lisp_scan));
+    scan->cur = scan->end = NULL;
+    scan->buf = NULL;
+    scan->map = NULL;
+    scan->map_len = 0;
+    scan->line = 1;
+    return scan;
+}
+
+/* drop the input of the previous file */
+static void lisp_scan_release(struct lisp_scan *scan) {
+    my_free(scan->buf);
+    scan->buf = NULL;
+#ifndef MY_OS
+    if (scan->map) {
+        munmap(scan->map, scan->map_len);
+    }
+#endif
+    scan->map = NULL;
+    scan->map_len = 0;
+}
+
+void free_lisp_scan(struct lisp_scan *scan) {
+    if (scan) {
+        lisp_scan_release(scan);
+        my_free(scan);
+    }
+}
+
+void lisp_scan_set_buf(struct lisp_scan *scan, const char *buf, size_t len) {
+    scan->cur = buf;
+    scan->end = buf + len;
+    scan->line = 1;
+}
+
+#ifndef MY_OS
+/* map a regular file read-only, tokens are scanned straight off the pages */
+static int lisp_scan_map(struct lisp_scan *scan, FILE *in) {
+    int fd = fileno(in);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+        st.st_size == 0 || ftell(in) != 0) {
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    lisp_scan_release(scan);
+    scan->map = map;
+    scan->map_len = st.st_size;
+    lisp_scan_set_buf(scan, map, st.st_size);
+    return 0;
+}
+#endif
+
+int lisp_scan_set_file(struct lisp_scan *scan, FILE *in) {
+#ifndef MY_OS
+    if (lisp_scan_map(scan, in) == 0) {
+        return 0;
+    }
+#endif
+
+    size_t size = 64 * 1024;
+    size_t len = 0;
+    char *buf = my_malloc(size);
+
+    size_t n;
+    while ((n = fread(buf + len, 1, size - len, in)) > 0) {
+        len += n;
+        if (len == size) {
+            size *= 2;
+            buf = my_realloc(buf, size);
+        }
+    }
+    if (ferror(in)) {
+        my_free(buf);
+        return -1;
+    }
+
+    lisp_scan_release(scan);
+    scan->buf = buf;
+    lisp_scan_set_buf(scan, buf, len);
+    return 0;
+}
+
+/* skip blanks, counting lines */
+static const char *skip_ws(struct lisp_scan *scan, const char *p) {
+    const char *end = scan->end;
+#ifdef __SSE2__
+    while (p + 16 <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), nl),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        unsigned mask = _mm_movemask_epi8(ws);
+        unsigned lines = _mm_movemask_epi8(nl);
+        if (mask != 0xffff) {
+            unsigned n = __builtin_ctz(~mask);
+            scan->line += __builtin_popcount(lines & ((1u << n) - 1));
+            return p + n;
+        }
+        scan->line += __builtin_popcount(lines);
+        p += 16;
+    }
+#endif
+    for (; is_class(p, end, C_WS); p++) {
+        scan->line += *p == '\n';
+    }
+    return p;
+}
+
+/* skip to the end of the line, leaving the newline */
+static const char *skip_line(const char *p, const char *end) {
+#ifdef __SSE2__
+    while (p + 16 <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned mask =
+            _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+/*
+ * end of a run of identifier subsequent characters. whole blocks of letters,
+ * digits and '-' are taken 16 at a time, the table handles the rest.
+ */
+static const char *scan_subsequent(const char *p, const char *end) {
+    for (;;) {
+#ifdef __SSE2__
+        while (p + 16 <= end) {
+            __m128i v = _mm_loadu_si128((const __m128i *)p);
+            __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+            __m128i alpha =
+                _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                              _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+            __m128i digit =
+                _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                              _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+            __m128i dash = _mm_cmpeq_epi8(v, _mm_set1_epi8('-'));
+            unsigned mask = _mm_movemask_epi8(
+                _mm_or_si128(_mm_or_si128(alpha, digit), dash));
+            if (mask != 0xffff) {
+                p += __builtin_ctz(~mask);
+                break;
+            }
+            p += 16;
+        }
+#endif
+        if (!is_class(p, end, C_SUBSEQUENT)) {
+            return p;
+        }
+        p++;
+    }
+}
+
+static bool match(const char *p, const char *end, const char *s) {
+    size_t len = strlen(s);
+    return (size_t)(end - p) >= len && !memcmp(p, s, len);
+}
+
+/* the number parsing functions take terminated text */
+static char *copy_text(const char *p, const char *q, char *buf, size_t size) {
+    size_t len = q - p;
+    char *text = len < size ? buf : my_malloc(len + 1);
+    memcpy(text, p, len);
+    text[len] = '\0';
+    return text;
+}
+
+static void populate_part(number_full_t *full, enum complex_part_t part,
+                          const char *p, const char *q,
+                          enum number_part_type type) {
+    char buf[64];
+    char *text = copy_text(p, q, buf, sizeof(buf));
+    lex_number_populate_part_from_str(full, part, text, type);
+    if (text != buf) {
+        my_free(text);
+    }
+}
+
+/* the exponent digits p to q, value is the whole literal when it is known */
+static int populate_exp(number_full_t *full, enum complex_part_t part,
+                        const char *p, const char *q, const double *value) {
+    char buf[64];
+    char *text = copy_text(p, q, buf, sizeof(buf));
+    int ret = value ? lex_number_set_part_exp_value(full, part, text, *value)
+                    : lex_number_calc_part_exp_from_str(full, part, text);
+    if (text != buf) {
+        my_free(text);
+    }
+    return ret;
+}
+
+static bool is_digit_radix(char c, bool radix10) {
+    if (radix10) {
+        return c >= '0' && c <= '9';
+    }
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+static const char *scan_digits(const char *p, const char *end, bool radix10) {
+    while (p < end && is_digit_radix(*p, radix10)) {
+        p++;
+    }
+    return p;
+}
+
+/*
+ * one real part of a number, as in the x_real10 / x_real flex states.
+ * returns NULL when there is none at p; *err is set on a bad exponent.
+ */
+static const char *scan_real(const char *p, const char *end,
+                             number_full_t *full, enum complex_part_t *part,
+                             const char **err) {
+    bool radix10 = full->prefix.radix_type == RADIX_10;
+    bool sign = p < end && (*p == '+' || *p == '-');
+
+    if (sign) {
+        static const struct {
+            const char *text;
+            enum naninf_flag positive, negative;
+        } naninf[] = {
+            {"nan.0", NAN_POSITIVE, NAN_NEGATIVE},
+            {"inf.0", INF_POSITIVE, INF_NEGATIVE},
+        };
+        for (size_t i = 0; i < sizeof(naninf) / sizeof(naninf[0]); i++) {
+            if (match(p + 1, end, naninf[i].text)) {
+                lex_number_populate_part_naninf(
+                    full, *part,
+                    *p == '+' ? naninf[i].positive : naninf[i].negative);
+                return p + 6;
+            }
+        }
+        if (p + 1 < end && p[1] == 'i') {
+            /* the i itself is taken with the complex suffix */
+            *part = COMPLEX_PART_IMAG;
+            lex_number_populate_imag_part_one_i(full, *p);
+            return p + 1;
+        }
+    }
+
+    const char *digits = p + sign;
+    const char *q = scan_digits(digits, end, radix10);
+    bool has_digits = q != digits;
+
+    if (has_digits && q + 1 < end && *q == '/' &&
+        is_digit_radix(q[1], radix10)) {
+        q = scan_digits(q + 1, end, radix10);
+        populate_part(full, *part, p, q, NUMBER_PART_EXACT);
+        return q;
+    }
+
+    if (!radix10) {
+        if (!has_digits) {
+            return NULL;
+        }
+        populate_part(full, *part, p, q, NUMBER_PART_ZIP_EXACT);
+        return q;
+    }
+
+    /* the value with an e exponent included, rounded once */
+    double v = 0;
+    const char *v_end = NULL;
+    if (q < end && *q == '.' && (has_digits || (q + 1 < end && q[1] >= '0' &&
+                                                q[1] <= '9'))) {
+        const char *point = q;
+        q = scan_digits(q + 1, end, true);
+        v_end = atod(p, end, &v);
+        lex_number_populate_part_flo(full, *part, v, q - point - 1);
+    } else if (has_digits) {
+        populate_part(full, *part, p, q, NUMBER_PART_ZIP_EXACT);
+    } else {
+        return NULL;
+    }
+
+    /* exponent and mantissa width */
+    if (q < end && *q && strchr("eEsSfFdDlL", *q)) {
+        const char *e = q + 1;
+        if (e < end && (*e == '+' || *e == '-')) {
+            e++;
+        }
+        const char *e_end = scan_digits(e, end, true);
+        if (e_end != e) {
+            /* the width and exactness come out of the scaling */
+            if (!v_end) {
+                v_end = atod(p, end, &v);
+            }
+            if (populate_exp(full, *part, q + 1, e_end,
+                             v_end == e_end ? &v : NULL) < 0) {
+                *err = "parse exp failure";
+            }
+            q = e_end;
+        }
+    }
+    if (q + 1 < end && *q == '|' && q[1] >= '0' && q[1] <= '9') {
+        q = scan_digits(q + 1, end, true);
+    }
+    return q;
+}
+
+/* prefix, real part, then polar or rectangular suffixes into full */
+static const char *scan_number(const char *p, const char *end,
+                               number_full_t *full, const char **err) {
+    enum complex_part_t part = COMPLEX_PART_REAL;
+
+    if (p < end && *p == '#') {
+        size_t len = p + 3 < end && p[2] == '#' ? 4 : 2;
+        lex_number_populate_prefix_from_str((char *)p, len, &full->prefix);
+        p += len;
+    }
+
+    for (;;) {
+        const char *q = scan_real(p, end, full, &part, err);
+        if (!q) {
+            *err = "invalid number";
+            break;
+        }
+        p = q;
+
+        while (p < end && *p == 'i') {
+            p++;
+        }
+        if (p < end && *p == '@') {
+            p++;
+        } else if (p < end && (*p == '+' || *p == '-')) {
+            part = COMPLEX_PART_IMAG;
+        } else {
+            break;
+        }
+    }
+    return p;
+}
+
+static const char *lex_number(const char *p, const char *end,
+                              number **result, YYLTYPE *lloc,
+                              yyscan_t scanner, parse_data *data) {
+    number_full_t full;
+    lex_number_full_init(&full);
+    const char *err = NULL;
+    p = scan_number(p, end, &full, &err);
+    if (err) {
+        yyerror(lloc, scanner, data, err);
+    }
+    *result = make_number_from_full(&full);
+    return p;
+}
+
+number *lisp_scan_number(const char *s, size_t len, enum radix_flag radix) {
+    number_full_t full;
+    lex_number_full_init(&full);
+    full.prefix.radix_type = radix;
+    /* the prefixes the lexer lets through to scan_number */
+    if (len && *s == '#' &&
+        (len < 2 || !s[1] || !strchr("bBoOdDxXeEiI", s[1]))) {
+        return NULL;
+    }
+    const char *err = NULL;
+    if (!len || scan_number(s, s + len, &full, &err) != s + len || err) {
+        return NULL;
+    }
+    return make_number_from_full(&full);
+}
+
+/* [+-]?[0-9]+ up to a delimiter, the bulk of the numbers in data files */
+static const char *scan_fixnum(const char *p, const char *end,
+                               number **result) {
+    const char *q = p;
+    bool negative = false;
+    if (*q == '+' || *q == '-') {
+        negative = *q == '-';
+        q++;
+    }
+
+    const char *digits = q;
+    u64 value = 0;
+    for (; q < end && *q >= '0' && *q <= '9'; q++) {
+        value = value * 10 + (*q - '0');
+    }
+    /* 18 digits cannot overflow */
+    if (q == digits || q - digits > 18 || !is_delimiter(q, end)) {
+        return NULL;
+    }
+
+    number_full_t full;
+    lex_number_full_init(&full);
+    lex_number_populate_part_zip_exact(&full, COMPLEX_PART_REAL,
+                                       negative ? -(s64)value : (s64)value);
+    *result = make_number_from_full(&full);
+    return q;
+}
+
+static const struct {
+    const char *name;
+    u16 ch;
+} char_names[] = {
+    {"nul", 0},        {"alarm", 7},   {"backspace", 8}, {"tab", 9},
+    {"linefeed", 10},  {"newline", 10}, {"vtab", 11},    {"page", 12},
+    {"return", 13},    {"esc", 27},    {"space", ' '},   {"delete", 127},
+};
+
+/* after #\ */
+static const char *scan_character(const char *p, const char *end, u16 *ch) {
+    if (p == end) {
+        return NULL;
+    }
+
+    const char *q = p;
+    if (*p == 'x' && p + 1 < end && is_digit_radix(p[1], false)) {
+        u16 code = 0;
+        for (q = p + 1; q < end && is_digit_radix(*q, false); q++) {
+            code = code * 16 + (*q <= '9' ? *q - '0' : (*q | 0x20) - 'a' + 10);
+        }
+        if (!is_delimiter(q, end)) {
+            return NULL;
+        }
+        *ch = code;
+        return q;
+    }
+
+    while (q < end && (*q | 0x20) >= 'a' && (*q | 0x20) <= 'z') {
+        q++;
+    }
+    if (q - p > 1) {
+        for (size_t i = 0; i < sizeof(char_names) / sizeof(char_names[0]);
+             i++) {
+            if ((size_t)(q - p) == strlen(char_names[i].name) &&
+                !memcmp(p, char_names[i].name, q - p)) {
+                *ch = char_names[i].ch;
+                return q;
+            }
+        }
+        return NULL;
+    }
+
+    *ch = (u8)*p;
+    return p + 1;
+}
+
+/* after the opening quote */
+static const char *scan_string(struct lisp_scan *scan, const char *p,
+                               string **result) {
+    const char *end = scan->end;
+    const char *q = p;
+    bool escaped = false;
+
+    for (; q < end && *q != '"'; q++) {
+        if (*q == '\\') {
+            escaped = true;
+            if (++q == end) {
+                break;
+            }
+        }
+        scan->line += *q == '\n';
+    }
+    if (q == end) {
+        return NULL;
+    }
+
+    if (!escaped) {
+        *result = make_string((char *)p, q - p);
+        return q + 1;
+    }
+
+    char *buf = my_malloc(q - p + 1);
+    char *out = buf;
+    for (const char *c = p; c < q; c++) {
+        if (*c != '\\') {
+            *out++ = *c;
+            continue;
+        }
+        switch (*++c) {
+        case 'a':
+            *out++ = '\a';
+            break;
+        case 'b':
+            *out++ = '\b';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 'v':
+            *out++ = '\v';
+            break;
+        case 'f':
+            *out++ = '\f';
+            break;
+        case 'r':
+            *out++ = '\r';
+            break;
+        default:
+            *out++ = *c;
+            break;
+        }
+    }
+    *result = make_string_take(buf, out - buf);
+    return q + 1;
+}
+
+int lisp_scan_lex(struct lisp_scan *scan, YYSTYPE *lval, YYLTYPE *lloc,
+                  yyscan_t scanner, parse_data *data) {
+    const char *p = scan->cur;
+    const char *end = scan->end;
+    const char *q;
+    int token;
+
+again:
+    p = skip_ws(scan, p);
+    if (p == end) {
+        scan->cur = p;
+        return END_OF_FILE;
+    }
+
+    switch (*p) {
+    case ';':
+        p = skip_line(p, end);
+        goto again;
+    case '(':
+        token = LP;
+        p++;
+        break;
+    case ')':
+        token = RP;
+        p++;
+        break;
+    case '[':
+        token = LSB;
+        p++;
+        break;
+    case ']':
+        token = RSB;
+        p++;
+        break;
+    case '\'':
+        token = APOSTROPHE;
+        p++;
+        break;
+    case '`':
+        token = GRAVE;
+        p++;
+        break;
+    case ',':
+        if (p + 1 < end && p[1] == '@') {
+            token = COMMA_AT;
+            p += 2;
+        } else {
+            token = COMMA;
+            p++;
+        }
+        break;
+    case '"':
+        q = scan_string(scan, p + 1, &lval->str);
+        if (!q) {
+            yyerror(lloc, scanner, data,
+                    "the string misses \" to terminate before EOF");
+            scan->cur = end;
+            return END_OF_FILE;
+        }
+        token = STRING;
+        p = q;
+        break;
+    case '.':
+        if (match(p, end, "...") && is_delimiter(p + 3, end)) {
+            lval->symbol = lookup_n(data, p, 3);
+            token = IDENTIFIER;
+            p += 3;
+        } else if (p + 1 < end && p[1] >= '0' && p[1] <= '9') {
+            p = lex_number(p, end, &lval->num, lloc, scanner, data);
+            token = NUMBER;
+        } else {
+            token = PERIOD;
+            p++;
+        }
+        break;
+    case '#':
+        if (p + 1 == end) {
+            goto mystery;
+        }
+        switch (p[1]) {
+        case 't':
+        case 'T':
+            token = BOOLEAN_T;
+            p += 2;
+            break;
+        case 'f':
+        case 'F':
+            token = BOOLEAN_F;
+            p += 2;
+            break;
+        case '(':
+            token = VECTOR_LP;
+            p += 2;
+            break;
+        case '\'':
+            token = NS_APOSTROPHE;
+            p += 2;
+            break;
+        case '`':
+            token = NS_GRAVE;
+            p += 2;
+            break;
+        case ',':
+            if (p + 2 < end && p[2] == '@') {
+                token = NS_COMMA_AT;
+                p += 3;
+            } else {
+                token = NS_COMMA;
+                p += 2;
+            }
+            break;
+        case '\\':
+            q = scan_character(p + 2, end, &lval->ch);
+            if (!q) {
+                yyerror(lloc, scanner, data, "invalid character");
+                p += 2;
+                goto again;
+            }
+            token = CHARACTER;
+            p = q;
+            break;
+        case 'v':
+            if (match(p, end, "#vu8(")) {
+                token = VECTOR_BYTE_LP;
+                p += 5;
+                break;
+            }
+            goto mystery;
+        default:
+            if (!p[1] || !strchr("bBoOdDxXeEiI", p[1])) {
+                goto mystery;
+            }
+            p = lex_number(p, end, &lval->num, lloc, scanner, data);
+            token = NUMBER;
+            break;
+        }
+        break;
+    case '+':
+    case '-':
+        if ((q = scan_fixnum(p, end, &lval->num))) {
+            token = NUMBER;
+            p = q;
+        } else if (p + 1 < end &&
+                   ((p[1] >= '0' && p[1] <= '9') || p[1] == '.' ||
+                    p[1] == 'i' || p[1] == 'n')) {
+            if (p[1] == '.' && !(p + 2 < end && p[2] >= '0' && p[2] <= '9')) {
+                goto sign;
+            }
+            if (p[1] == 'n' && !match(p + 1, end, "nan.0")) {
+                goto sign;
+            }
+            p = lex_number(p, end, &lval->num, lloc, scanner, data);
+            token = NUMBER;
+        } else {
+        sign:
+            q = p + 1;
+            if (*p == '-' && q < end && *q == '>') {
+                q = scan_subsequent(q + 1, end);
+            }
+            lval->symbol = lookup_n(data, p, q - p);
+            token = IDENTIFIER;
+            p = q;
+        }
+        break;
+    default:
+        if (is_class(p, end, C_DIGIT)) {
+            if (!(q = scan_fixnum(p, end, &lval->num))) {
+                q = lex_number(p, end, &lval->num, lloc, scanner, data);
+            }
+            token = NUMBER;
+            p = q;
+        } else if (is_class(p, end, C_INITIAL)) {
+            q = scan_subsequent(p + 1, end);
+            lval->symbol = lookup_n(data, p, q - p);
+            token = IDENTIFIER;
+            p = q;
+        } else {
+            goto mystery;
+        }
+        break;
+    }
+
+    scan->cur = p;
+    return token;
+
+mystery:
+    yyerror(lloc, scanner, data, "Mystery character %c\n", *p);
+    p++;
+    goto again;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "my_lisp.h"
+
+/*
+ * hand-written scanner, an alternative to the flex one selected with
+ * lisp_ctx_opt.scanner. it reads tokens straight out of an in-memory buffer.
+ */
+struct lisp_scan {
+    const char *cur;
+    const char *end;
+    /* input read from a FILE, owned by the scanner */
+    char *buf;
+    /* or the FILE mapped whole when it is a regular file */
+    void *map;
+    size_t map_len;
+    int line;
+};
+
+struct lisp_scan *make_lisp_scan(void);
+void free_lisp_scan(struct lisp_scan *scan);
+
+/* scan len bytes at buf, which must outlive the parse */
+void lisp_scan_set_buf(struct lisp_scan *scan, const char *buf, size_t len);
+/* scan all of in, mapped in place when possible, otherwise read in */
+int lisp_scan_set_file(struct lisp_scan *scan, FILE *in);
+
+/* the number spelled by all of s, as string->number reads it, or NULL */
+number *lisp_scan_number(const char *s, size_t len, enum radix_flag radix);
+
+int lisp_scan_lex(struct lisp_scan *scan, YYSTYPE *lval, YYLTYPE *lloc,
+                  yyscan_t scanner, parse_data *data);
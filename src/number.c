@@ -1,4 +1,6 @@
 #include "number.h"
+#include "atod.h"
+#include "dtoa.h"
 #include "os.h"
 #include <assert.h>
 
@@ -90,10 +92,13 @@ u8 radix_value(enum radix_flag flag) {
 
 s64 number_part_get_zip_exact_value(const number_part_t *part);
 
+/* no double has more fraction digits in its shortest form than this */
+#define FLO_WIDTH_MAX 324
+
 void number_part_set_flo(number_part_t *part, double v, u64 width) {
     assert(part);
     part->v[0].flo_v = v;
-    part->v[1].u64_v = width;
+    part->v[1].u64_v = width < FLO_WIDTH_MAX ? width : FLO_WIDTH_MAX;
     part->type = NUMBER_PART_FLO;
 }
 
@@ -118,9 +123,12 @@ void str_to_number_flo(number_part_t *part, char *s,
     assert(radix_flag == RADIX_10);
     size_t len = strlen(s);
     char *point = strchr(s, '.');
-    int i = point - s;
+    /* 1e10 has no fraction digits */
+    u64 width = point ? len - (point - s) - 1 : 0;
 
-    number_part_set_flo(part, my_strtod(s), len - i - 1);
+    double v = 0;
+    atod(s, s + len, &v);
+    number_part_set_flo(part, v, width);
 }
 
 void number_part_set_exact(number_part_t *part, s64 numerator,
@@ -506,39 +514,101 @@ void number_unzip_number(number_full_t *number_full, const number *source) {
 /*
  * format number
  */
+static int format_str(char *buf, const char *s) {
+    size_t len = strlen(s);
+    memcpy(buf, s, len + 1);
+    return len;
+}
+
 int _format_number_part_naninf(char *buf, const number_part_t *part) {
     int ret = 0;
     enum naninf_flag flag = number_part_get_naninf(part);
     switch (flag) {
     case NAN_POSITIVE:
-        ret = my_sprintf(buf, "+nan.0");
+        ret = format_str(buf, "+nan.0");
         break;
     case NAN_NEGATIVE:
-        ret = my_sprintf(buf, "-nan.0");
+        ret = format_str(buf, "-nan.0");
         break;
     case INF_POSITIVE:
-        ret = my_sprintf(buf, "+inf.0");
+        ret = format_str(buf, "+inf.0");
         break;
     case INF_NEGATIVE:
-        ret = my_sprintf(buf, "-inf.0");
+        ret = format_str(buf, "-inf.0");
         break;
     }
     return ret;
 }
 
+/*
+ * fixed notation with the shortest digits that read back as the value,
+ * padded with zeros to at least width fraction digits
+ */
 int _format_number_part_flo(char *buf, const number_part_t *part) {
-    char fmt_buf[30] = {0};
-    my_sprintf(fmt_buf, "%%+.%df", number_part_get_flo_width(part));
-    return my_sprintf(buf, fmt_buf, number_part_get_flo_value(part));
+    double v = number_part_get_flo_value(part);
+    u64 width = number_part_get_flo_width(part);
+    u64 bits;
+    memcpy(&bits, &v, sizeof(bits));
+
+    char *p = buf;
+    *p++ = bits >> 63 ? '-' : '+';
+    /* arithmetic can overflow a flonum */
+    if (v != v || v - v != 0) {
+        return p - buf + format_str(p, v != v ? "nan.0" : "inf.0");
+    }
+
+    char digits[DTOA_DIGITS_MAX];
+    int exp10;
+    int len = dtoa_shortest(bits >> 63 ? -v : v, digits, &exp10);
+    /* digits before the decimal point */
+    int point = len + exp10;
+    u64 frac = 0;
+    if (point <= 0) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -point);
+        p += -point;
+        memcpy(p, digits, len);
+        p += len;
+        frac = len - point;
+    } else if (point >= len) {
+        memcpy(p, digits, len);
+        p += len;
+        memset(p, '0', point - len);
+        p += point - len;
+    } else {
+        memcpy(p, digits, point);
+        p += point;
+        *p++ = '.';
+        memcpy(p, digits + point, len - point);
+        p += len - point;
+        frac = len - point;
+    }
+
+    if (frac < width) {
+        if (!frac) {
+            *p++ = '.';
+        }
+        memset(p, '0', width - frac);
+        p += width - frac;
+    }
+    *p = '\0';
+    return p - buf;
 }
 
 int _format_number_part_exact(char *buf, const number_part_t *part) {
-    return my_sprintf(buf, "%+Li/%Li", number_part_get_exact_numerator(part),
-                      number_part_get_exact_denominator(part));
+    char *p = buf;
+    p += format_s64(p, number_part_get_exact_numerator(part));
+    *p++ = '/';
+    p += format_u64(p, number_part_get_exact_denominator(part));
+    *p = '\0';
+    return p - buf;
 }
 
 int _format_number_part_zip_exact(char *buf, const number_part_t *part) {
-    return my_sprintf(buf, "%+Li", number_part_get_zip_exact_value(part));
+    int len = format_s64(buf, number_part_get_zip_exact_value(part));
+    buf[len] = '\0';
+    return len;
 }
 
 int format_number_part(char *buf, const number_part_t *part) {
@@ -576,8 +646,9 @@ int format_number(char *buf, const number *number) {
     buf_p += format_number_part(buf_p, real);
     buf_p += format_number_part(buf_p, imag);
     if (imag->type != NUMBER_PART_NONE) {
-        buf_p += my_sprintf(buf_p, "i");
+        *buf_p++ = 'i';
     }
+    *buf_p = '\0';
     return buf_p - buf;
 }
 
@@ -1116,6 +1187,16 @@ bool number_eq(number *n1, number *n2) {
     return !memcmp(n1, n2, mem_size);
 }
 
+/* exact real integer that fits the zipped s64 form */
+bool number_get_fixnum(const number *n, s64 *value) {
+    if (n->flag.complex || n->flag.flo || n->flag.naninf ||
+        n->flag.exact_zip != _REAL_BIT) {
+        return false;
+    }
+    *value = n->value[0].s64_v;
+    return true;
+}
+
 /*
  * lex function
  */
@@ -1203,9 +1284,28 @@ void lex_number_populate_part_from_str(number_full_t *number_full,
     }
 }
 
-int lex_number_calc_part_exp_from_str(number_full_t *number_full,
-                                      enum complex_part_t part,
-                                      char *exp_text) {
+void lex_number_populate_part_flo(number_full_t *number_full,
+                                  enum complex_part_t part, double value,
+                                  u64 width) {
+    if (!number_full) {
+        return;
+    }
+    number_part_set_flo(number_full_get_number_part(number_full, part), value,
+                        width);
+}
+
+void lex_number_populate_part_zip_exact(number_full_t *number_full,
+                                        enum complex_part_t part, s64 value) {
+    if (!number_full) {
+        return;
+    }
+    number_part_set_zip_exact(number_full_get_number_part(number_full, part),
+                              value);
+}
+
+/* the part with exp_text applied, to the value when one is given */
+static int calc_part_exp(number_full_t *number_full, enum complex_part_t part,
+                         char *exp_text, const double *value) {
     assert(exp_text);
     if (!number_full) {
         return 0;
@@ -1216,23 +1316,49 @@ int lex_number_calc_part_exp_from_str(number_full_t *number_full,
            complex_part->type == NUMBER_PART_ZIP_EXACT);
 
     s64 _exp = my_strtoll(exp_text, radix_value(RADIX_10));
-    double exp = pow(10, _exp);
-    number_part_t number_part_exp = {};
-    if (_exp < 0) {
-        number_part_set_flo(&number_part_exp, exp, -_exp);
+    /* an exponent makes the part a flonum, 1e2 is 100.0 */
+    double v;
+    u64 width;
+    if (complex_part->type == NUMBER_PART_FLO) {
+        v = number_part_get_flo_value(complex_part);
+        width = number_part_get_flo_width(complex_part);
     } else {
-        number_part_set_zip_exact(&number_part_exp, exp);
+        v = number_part_get_zip_exact_value(complex_part);
+        width = 0;
     }
-
-    number_part_t result = {};
-    if (number_part_operate(&result, complex_part, &number_part_exp,
-                            NUMBER_PART_OPERATE_MUL) < 0) {
-        return -1;
+    if (!width) {
+        width = 1;
+    }
+    if (_exp < 0 && -(u64)_exp > width) {
+        width = -(u64)_exp;
+    }
+    if (value) {
+        v = *value;
+    } else if (v != 0) {
+        /* in two steps, so only a result out of range overflows */
+        v = v * pow(10, _exp / 2) * pow(10, _exp - _exp / 2);
+    }
+    if (isinf(v)) {
+        number_part_set_naninf(complex_part,
+                               v > 0 ? INF_POSITIVE : INF_NEGATIVE);
+    } else {
+        number_part_set_flo(complex_part, v, width);
     }
-    number_part_copy(complex_part, &result);
     return 0;
 }
 
+int lex_number_calc_part_exp_from_str(number_full_t *number_full,
+                                      enum complex_part_t part,
+                                      char *exp_text) {
+    return calc_part_exp(number_full, part, exp_text, NULL);
+}
+
+int lex_number_set_part_exp_value(number_full_t *number_full,
+                                  enum complex_part_t part, char *exp_text,
+                                  double value) {
+    return calc_part_exp(number_full, part, exp_text, &value);
+}
+
 int lex_number_full_normalize(number_full_t *result,
                               const number_full_t *value) {
     assert(value && result);
@@ -105,6 +105,14 @@ void lex_number_populate_part_from_str(number_full_t *number_full,
                                        enum complex_part_t part, char *text,
                                        enum number_part_type type);
 
+void lex_number_populate_part_zip_exact(number_full_t *number_full,
+                                        enum complex_part_t part, s64 value);
+
+/* a decimal flonum the caller parsed itself, width fraction digits */
+void lex_number_populate_part_flo(number_full_t *number_full,
+                                  enum complex_part_t part, double value,
+                                  u64 width);
+
 /**
  * @brief      handle {SIGN}"i"
  */
@@ -112,6 +120,13 @@ void lex_number_populate_imag_part_one_i(number_full_t *number_full, char sign);
 
 int lex_number_calc_part_exp_from_str(number_full_t *number_full,
                                       enum complex_part_t part, char *exp_text);
+/*
+ * as lex_number_calc_part_exp_from_str, with value the whole literal rounded
+ * once in place of the part scaled by the exponent
+ */
+int lex_number_set_part_exp_value(number_full_t *number_full,
+                                  enum complex_part_t part, char *exp_text,
+                                  double value);
 
 int format_number(char *buf, const number *number);
 
@@ -145,3 +160,4 @@ number *make_number_real_flo(double real, u64 width);
 number *number_cpy(number *num);
 
 bool number_eq(number *n1, number *n2);
+bool number_get_fixnum(const number *n, s64 *value);
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atod.h"
+
+/* atod rounds like strtod and reads back what %.17g prints */
+
+#define SAMPLES 200000
+
+static int failed;
+
+static u64 next_random(u64 *state) {
+    /* xorshift64 */
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void check_text(const char *text) {
+    const char *end = text + strlen(text);
+    double v = 0;
+    double expected = strtod(text, NULL);
+    if (atod(text, end, &v) != end || memcmp(&v, &expected, sizeof(v))) {
+        printf("atod(%s) = %.17g, strtod gives %.17g\n", text, v, expected);
+        failed = 1;
+    }
+}
+
+int main(void) {
+    static const char *texts[] = {
+        "0",     "-0",    "1",      "0.1",     "1e21",    "1e22",
+        "1e23",  "1e308", "1e309",  "1e400",   "-1e400",  "1e-320",
+        "1e-400", "5e-324", "2.4703282292062328e-324",
+        "9007199254740993", "1.7976931348623157e308",
+        "2.2250738585072014e-308", "123456789012345678901234567890",
+        "0.000000000000000000000000000001",
+    };
+    for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+        check_text(texts[i]);
+    }
+
+    char buf[64];
+    u64 state = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < SAMPLES; i++) {
+        /* any finite bit pattern, printed with enough digits to read back */
+        u64 bits = next_random(&state);
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        if (v != v || v - v != 0) {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "%.17g", v);
+        check_text(buf);
+
+        /* short decimals with exponents of every size */
+        u64 r = next_random(&state);
+        snprintf(buf, sizeof(buf), "%llu.%llue%d",
+                 (unsigned long long)(r % 100000),
+                 (unsigned long long)(r >> 40 & 0xfff), (int)(r >> 52) - 2400);
+        check_text(buf);
+    }
+    return failed;
+}
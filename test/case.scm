@@ -0,0 +1,22 @@
+; case dispatches through tables built once per form
+(case 3 ((1 2) 'low) ((3 4) 'mid) (else 'high))
+(case 9 ((1 2) 'low) ((3 4) 'mid) (else 'high))
+(case 'b ((a) 1) ((b) 2) (else 3))
+(case 'z ((a) 1) ((b) 2))
+(case #\a ((#\a) 'ch) (else 'no))
+(case 5 ((1 2 3 4 5 6 7 8) 'dense) (else 'no))
+(case 1000000 ((1 1000 1000000) 'sparse) (else 'no))
+(case "x" (("x") 'str) (else 'no))
+(case 2.0 ((2) 'exact) (else 'no))
+(case 2.5 ((2.5) 'flo) (else 'no))
+(case #t ((#f) 'f) ((#t) 't))
+(case '() ((()) 'nil) (else 'no))
+(define (classify x)
+  (case x ((a e i o u) 'vowel) ((w y) 'semi) (else 'consonant)))
+(classify 'e)
+(classify 'y)
+(classify 'k)
+(let loop ((i 0) (n 0))
+  (if (eqv? i 8) n (loop (+ i 1) (case i ((0 2 4 6) (+ n 1)) (else n)))))
+(case 1 ((1) 'a 'b))
+(case 7 (else => (lambda (x) (+ x 1))))
@@ -0,0 +1,25 @@
+; closures made from the same lambda keep their own environments
+(define (make-adder n) (lambda (x) (+ x n)))
+(define add1 (make-adder 1))
+(define add5 (make-adder 5))
+(add1 10)
+(add5 10)
+(add1 20)
+(define (counter)
+  (let ((n 0))
+    (lambda () (set! n (+ n 1)) n)))
+(define c1 (counter))
+(define c2 (counter))
+(c1)
+(c1)
+(c2)
+(define fs (let loop ((i 0) (acc '()))
+             (if (eqv? i 3) acc (loop (+ i 1) (cons (lambda () i) acc)))))
+((car fs))
+((car (cdr fs)))
+((car (cdr (cdr fs))))
+(define (p . args) args)
+(p 1 2 3)
+(define (q a . r) (cons a r))
+(q 1 2 3)
+((lambda (x y) (cons y x)) 1 2)
@@ -0,0 +1,4 @@
+(define (sq x) (* x x))
+(sq 12)
+'(a "b" 2.5)
+(let loop ((i 0)) (if (eqv? i 3) 'done (loop (+ i 1))))
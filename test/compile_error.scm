@@ -0,0 +1,2 @@
+; --compile fails on a syntax error and writes no file
+(read-fasl "out.fasl")
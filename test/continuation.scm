@@ -0,0 +1,19 @@
+; escapes with call/ec, there is no call/cc
+(call/ec (lambda (k) (+ 1 (k 42))))
+(guard (e (#t 'no-call/cc)) (call/cc (lambda (k) (+ 1 (k 43)))))
+(call/ec (lambda (k) 'normal))
+(define (scan pred lst return)
+  (if (null? lst)
+      #f
+      (begin (if (pred (car lst)) (return (car lst)))
+             (scan pred (cdr lst) return))))
+(define (find-first pred lst)
+  (call/ec (lambda (return) (scan pred lst return))))
+(find-first symbol? '(1 2 three 4 five))
+(find-first string? '(1 2 3))
+(call/ec (lambda (outer) (+ 1 (call/ec (lambda (inner) (outer 'from-inner))))))
+(guard (e (#t 'not-caught)) (call/ec (lambda (k) (k 'through-guard))))
+(define saved #f)
+(+ 1 (call/ec (lambda (k) (set! saved k) 1)))
+(saved 5)
+'after-stale
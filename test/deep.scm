@@ -0,0 +1,9 @@
+; recursion is not bounded by the native stack
+(define (deep n) (if (eqv? n 0) 0 (+ 1 (deep (+ n -1)))))
+(deep 1000000)
+(define (build n) (if (eqv? n 0) '() (cons n (build (+ n -1)))))
+(car (build 200000))
+(define (inner) (backtrace))
+(define (outer x) (cons x (inner)))
+(outer 1)
+(backtrace)
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dtoa.h"
+
+/* dtoa_shortest reads back exactly and no shorter digits do */
+
+#define SAMPLES 200000
+
+static int failed;
+
+static u64 next_random(u64 *state) {
+    /* xorshift64 */
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void check_shortest(double v) {
+    char digits[DTOA_DIGITS_MAX + 1];
+    int exp10;
+    int len = dtoa_shortest(v, digits, &exp10);
+    digits[len] = '\0';
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%se%d", digits, exp10);
+    if (strtod(buf, NULL) != v) {
+        printf("dtoa_shortest(%.17g) = %s, which reads back as %.17g\n", v,
+               buf, strtod(buf, NULL));
+        failed = 1;
+        return;
+    }
+
+    /* printf rounds correctly, so one digit less must not read back */
+    if (len > 1) {
+        snprintf(buf, sizeof(buf), "%.*e", len - 2, v);
+        if (strtod(buf, NULL) == v) {
+            printf("dtoa_shortest(%.17g) = %se%d, %s is shorter\n", v, digits,
+                   exp10, buf);
+            failed = 1;
+        }
+    }
+}
+
+static void check_format(s64 v) {
+    char buf[32];
+    char expected[32];
+    int len = format_s64(buf, v);
+    int expected_len = snprintf(expected, sizeof(expected), "%+lld", v);
+    if (len != expected_len || memcmp(buf, expected, len)) {
+        printf("format_s64(%lld) = %.*s\n", v, len, buf);
+        failed = 1;
+    }
+
+    u64 u = v;
+    len = format_u64(buf, u);
+    expected_len = snprintf(expected, sizeof(expected), "%llu", u);
+    if (len != expected_len || memcmp(buf, expected, len)) {
+        printf("format_u64(%llu) = %.*s\n", u, len, buf);
+        failed = 1;
+    }
+}
+
+int main(void) {
+    static const double edges[] = {
+        0.1,     0.2,     0.3,     1.0 / 3, 5e-324, 2.2250738585072014e-308,
+        1.7976931348623157e308,   1e21,    1e22,   1e23,
+        123.456, 9007199254740993.0,       0.5,    1,
+    };
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        check_shortest(edges[i]);
+    }
+
+    u64 state = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < SAMPLES; i++) {
+        /* any finite positive bit pattern */
+        u64 bits = next_random(&state) & ~(1ull << 63);
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        if (v != v || v - v != 0 || v == 0) {
+            continue;
+        }
+        check_shortest(v);
+    }
+
+    static const s64 integers[] = {
+        0, 1, -1, 9, 10, 99, 100, -12345, 1234567890123456789ll,
+        (s64)(1ull << 63), 0x7fffffffffffffffll,
+    };
+    for (size_t i = 0; i < sizeof(integers) / sizeof(integers[0]); i++) {
+        check_format(integers[i]);
+    }
+    for (int i = 0; i < SAMPLES; i++) {
+        u64 r = next_random(&state);
+        /* all magnitudes, not just 19 digit ones */
+        check_format((s64)(r >> (r & 63)));
+    }
+    return failed;
+}
@@ -0,0 +1,11 @@
+; error messages print their values, long and deep ones cut short
+('(1 2 3) 4)
+('(1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20) 1)
+('(1 (2 (3 (4 (5 (6 (7))))))) 1)
+("str" 1)
+(raise '(a b c))
+(raise 42)
+(string->number "1" -3)
+(string->number "1" 3)
+(define after 'ok)
+after
@@ -0,0 +1,61 @@
+#include "my_lisp.h"
+
+/* eval_from_buf reads len bytes and nothing past them, with both scanners */
+
+static int failed;
+
+static void expect_true(struct lisp_ctx *ctx, const char *code, size_t len) {
+    object *ret = eval_from_buf(ctx, code, len);
+    if (!ret || ret->type != T_BOOLEAN || !ret->bool_val) {
+        my_printf("eval_from_buf(\"%.*s\", %d) is not #t\n", (int)len, code,
+                  (int)len);
+        failed = 1;
+    }
+    unref(ret);
+}
+
+static void expect_error(struct lisp_ctx *ctx, const char *code) {
+    object *ret = eval_from_str(ctx, (char *)code);
+    if (!ret || ret->type != T_ERR) {
+        my_printf("eval_from_str(\"%s\") is not an error\n", code);
+        failed = 1;
+    }
+    unref(ret);
+}
+
+static void test_scanner(enum lisp_scanner scanner) {
+    struct lisp_ctx *ctx = make_lisp_ctx((struct lisp_ctx_opt){
+        .scanner = scanner,
+    });
+
+    /* the last form is the value */
+    const char *two = "(define x 40) (eqv? (+ x 2) 42)";
+    expect_true(ctx, two, strlen(two));
+
+    /* the digits past len are not part of the input */
+    const char *cut = "(define n 12)345 (eqv? n 12)";
+    object *ret = eval_from_buf(ctx, cut, 13);
+    unref(ret);
+    expect_true(ctx, cut + 17, 11);
+
+    /* not NUL-terminated, the bytes after len are never read */
+    char buf[] = {'(', 'e', 'q', 'v', '?', ' ', '1', ' ', '1', ')', '(', '('};
+    expect_true(ctx, buf, 10);
+
+    /* evaluation stops at the first error */
+    expect_error(ctx, "(car 1) (define after 1)");
+    expect_error(ctx, "after");
+
+    /* a syntax error is an error too, and the next call reads on */
+    expect_error(ctx, "(define y 1) )");
+    expect_error(ctx, "(define z (+ 1 2)");
+    expect_true(ctx, two, strlen(two));
+
+    free_lisp_ctx(&ctx);
+}
+
+int main(void) {
+    test_scanner(LISP_SCANNER_FLEX);
+    test_scanner(LISP_SCANNER_FAST);
+    return failed;
+}
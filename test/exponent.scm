@@ -0,0 +1,19 @@
+; an exponent makes a flonum, and one out of range is an infinity
+1e2
+1.5e3
+2.e2
+1e-2
+1e21
+1e400
+-1e400
+(string->number "1e2")
+(string->number "1e21")
+(string->number "1e400")
+(string->number "-1e400")
+(+ 1e2 1)
+(* 1e200 1e200)
+; the whole literal is rounded once, not the mantissa and then the scaling
+1.1e22
+7.2e-10
+1.23456789e-300
+1.7976931348623157e308
@@ -0,0 +1,9 @@
+; datums written with write-fasl read back the same
+(write-fasl "d.fasl" '((1.5 -3/4 1+2i #\a "s" sym #t #f (a . b) -7 123456789012) () (x (y (z)))))
+(read-fasl "d.fasl")
+(write-fasl "long.fasl" (let loop ((i 0) (acc '())) (if (eqv? i 100000) (cons acc '()) (loop (+ i 1) (cons i acc)))))
+(car (car (read-fasl "long.fasl")))
+(write-fasl "proc.fasl" (cons car '()))
+(write-fasl "error.fasl" (car '()))
+(read-fasl "error.fasl")
+(read-fasl "fasl.scm")
@@ -0,0 +1,17 @@
+; the hand-written scanner reads every token kind the flex one does
+"a\"b\\c\nd"
+#\a
+#\space
+'(1 (2 . 3) "s" #\x . 4)
+'(quoted [vec 1] #t #f)
+; comment ( with paren
+2.5
+-5
++7
+1e2
+-0.5e-3
+1/2
+#xff
+'sym-with.dots?
+'(nested (deep (deeper 4 #\) "))")))
+'(a-0 ... ->x <=?)
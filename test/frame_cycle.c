@@ -0,0 +1,41 @@
+#include <malloc.h>
+
+#include "my_lisp.h"
+
+/*
+ * a frame kept alive only by the closures defined in it is freed with them,
+ * so making and dropping such closures does not grow the heap
+ */
+
+#define WARMUP 1000
+#define ROUNDS 20000
+#define SLACK (64 * 1024)
+
+static size_t heap_in_use(void) { return mallinfo2().uordblks; }
+
+static size_t run(struct lisp_ctx *ctx, int rounds) {
+    for (int i = 0; i < rounds; i++) {
+        /* the previous f, its frame and its helper become garbage */
+        unref(eval_from_str(ctx, "(define f (make)) (f)"));
+    }
+    return heap_in_use();
+}
+
+int main(void) {
+    struct lisp_ctx *ctx = make_lisp_ctx((struct lisp_ctx_opt){});
+    unref(eval_from_str(
+        ctx, "(define (make)"
+             "  (define (helper n) (if (eqv? n 0) 'done (helper (+ n -1))))"
+             "  (lambda () (helper 3)))"));
+
+    size_t before = run(ctx, WARMUP);
+    size_t after = run(ctx, ROUNDS);
+    free_lisp_ctx(&ctx);
+
+    if (after > before + SLACK) {
+        my_printf("heap grew by %d bytes over %d rounds\n",
+                  (int)(after - before), ROUNDS);
+        return 1;
+    }
+    return 0;
+}
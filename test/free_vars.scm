@@ -0,0 +1,28 @@
+; closures capture only their free variables, through any depth
+(define (f) (let ((x 1)) (let ((g (lambda () x))) (set! x 2) (g))))
+(f)
+(define (outer a b)
+  (lambda (c) (lambda (d) (cons a (cons c d)))))
+(((outer 1 2) 3) 4)
+(define (shadow x) (lambda (x) x))
+((shadow 1) 2)
+(define (w) (define x 1) (define g (lambda () x)) (set! x 9) (g))
+(w)
+(define (h) (let ((x 1)) (define (inc) (set! x (+ x 1))) (define (get) x) (inc) (get)))
+(h)
+(define y 10)
+(define gy (lambda () y))
+(set! y 11)
+(gy)
+(define (self n) (lambda () (if (eqv? n 0) 'done ((self (+ n -1))))))
+((self 3))
+; a define inside a begin of the body binds in the body too
+(define x 'global)
+(define (f) (define (get) x) (begin (define x 'local)) (get))
+(f)
+; a macro defined after a closure was first made can be used by it
+(define (make v) (lambda () (m)))
+(make 1)
+(define-syntax m (syntax-rules () ((_) v)))
+(define h (make 2))
+(h)
@@ -0,0 +1,57 @@
+; generators suspend at yield and resume at next
+(define g (make-generator (lambda () (yield 1) (yield 2) 3)))
+(next g)
+(next g)
+(next g 'done)
+(next g 'done)
+(next g)
+(define (count-from i) (yield i) (count-from (+ i 1)))
+(define (sum-next gen k s)
+  (if (eqv? k 0) s (sum-next gen (+ k -1) (+ s (next gen)))))
+(sum-next (make-generator (lambda () (count-from 0))) 100000 0)
+(define suspended (make-generator (lambda () (count-from 0))))
+(next suspended)
+(set! suspended #f)
+'closed-while-suspended
+(define gl (make-generator (lambda () (let ((x 5)) (yield x) (yield (+ x 1))))))
+(next gl)
+(next gl)
+(define (deep n) (if (eqv? n 0) 0 (+ 1 (deep (+ n -1)))))
+(next (make-generator (lambda () (yield (deep 100000)))))
+(define ge (make-generator (lambda () (car '()))))
+(next ge)
+(next ge 'after-error)
+(guard (e (#t (cons 'caught e)))
+  (next (make-generator (lambda () (raise 'inner)))))
+(define outer
+  (make-generator
+    (lambda ()
+      (let ((inner (make-generator (lambda () (yield 'a) (yield 'b)))))
+        (yield (next inner))
+        (yield (next inner))))))
+(next outer)
+(next outer)
+(call/ec (lambda (k) (next (make-generator (lambda () (k 'escaped))))))
+(define gr (make-generator (lambda () (next gr))))
+(next gr)
+(yield 1)
+'end
+; a raise the generator does not handle goes to the handlers around next
+(with-exception-handler (lambda (c) 10)
+  (lambda () (next (make-generator (lambda () (yield (+ 1 (raise-continuable 'c))))))))
+(define gh
+  (make-generator
+    (lambda ()
+      (with-exception-handler (lambda (c) (if (eqv? c 'mine) 'inner (raise-continuable c)))
+        (lambda () (yield (raise-continuable 'a)) (yield (raise-continuable 'mine)) (yield (raise-continuable 'b)))))))
+(with-exception-handler (lambda (c) (cons 'first c)) (lambda () (next gh)))
+(with-exception-handler (lambda (c) (cons 'second c)) (lambda () (next gh)))
+(with-exception-handler (lambda (c) (cons 'third c)) (lambda () (next gh)))
+; one freed while suspended deep in frames and handlers of its own unwinds them
+(define (down n) (if (eqv? n 0) (yield 'bottom) (let ((m n)) (+ m (down (+ n -1))))))
+(define gd
+  (make-generator
+    (lambda () (with-exception-handler (lambda (c) c) (lambda () (down 10000))))))
+(next gd)
+(set! gd #f)
+'closed-deep
@@ -0,0 +1,23 @@
+; raise, guard and exception handlers
+(guard (e (#t (cons 'caught e))) (raise 'boom))
+(guard (e ((symbol? e) 'sym) ((string? e) 'str)) (raise "x"))
+(guard (e ((symbol? e) 'sym) (else 'other)) (raise 42))
+(guard (e ((symbol? e) 'sym)) (raise 42))
+'after-reraise
+(guard (e ((string? e) e)) (+ 1 (guard (e2 ((symbol? e2) 'inner)) (raise "outer"))))
+(guard (e (#t (error-object-message e))) (error "bad thing" 1 2))
+(guard (e (#t (error-object-irritants e))) (error "bad thing" 1 2))
+(guard (e (#t 'caught-car)) (car '()))
+(guard (e (#t 'unused)) (+ 1 2))
+(with-exception-handler
+  (lambda (c) 10)
+  (lambda () (+ 1 (raise-continuable 'c))))
+(with-exception-handler
+  (lambda (c) 10)
+  (lambda () (+ 1 (raise 'c))))
+(guard (e (#t (cons 'outer e)))
+  (with-exception-handler
+    (lambda (c) (raise (cons 'wrapped c)))
+    (lambda () (raise 'inner))))
+(raise 'uncaught)
+'after
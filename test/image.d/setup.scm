@@ -0,0 +1,6 @@
+(define (sq x) (* x x))
+(define data '(1 "two" 3.5 #t (nested . pair)))
+(define counter (let ((n 0)) (lambda () (set! n (+ n 1)) n)))
+(counter)
+(define-syntax swap!
+  (syntax-rules () ((_ a b) (let ((tmp a)) (set! a b) (set! b tmp)))))
@@ -0,0 +1,9 @@
+; a global env booted from a heap image has the definitions it was saved with
+(sq 9)
+data
+(counter)
+(define p 1)
+(define q 2)
+(swap! p q)
+(cons p q)
+(car '(still works))
@@ -0,0 +1,28 @@
+; let frames live on the frame stack unless a closure captures them
+(let ((a 1) (b 2)) (+ a b))
+(let ((x 1) (y 2)) (let ((x y) (y x)) (cons x y)))
+(define (escape) (let ((x 7)) (lambda () x)))
+((escape))
+(define (keep) (let ((x 1)) (let ((g (lambda () x))) (set! x 3) g)))
+((keep))
+(let ((a 1)) (let ((b (+ a 1))) (let ((c (+ b 1))) (cons a (cons b c)))))
+(let loop ((i 0) (s 0))
+  (if (eqv? i 10000) s (loop (+ i 1) (let ((t i)) (+ s t)))))
+(define saved (let ((v 'captured)) (let ((w 'stack)) (lambda () v))))
+(let ((junk 1) (more 2)) (+ junk more))
+(saved)
+(let ((x 1)) (set! x (+ x 1)) x)
+; a macro defined after the let was first run may close over its frame
+(define (run) (let ((x 5)) (m2)))
+(run)
+(define-syntax m2 (syntax-rules () ((_) (lambda () (set! x (+ x 1)) x))))
+(define k (run))
+(k)
+(k)
+; so may one the body defines itself
+(define (local-syntax)
+  (let ((z 7))
+    (define-syntax get-z
+      (syntax-rules () ((_) (lambda () (set! z (+ z 1)) z))))
+    (get-z)))
+((local-syntax))
@@ -0,0 +1,2 @@
+(define shared 10)
+(define (bump!) (set! x (+ x 1)) x)
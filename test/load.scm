@@ -0,0 +1,9 @@
+; load evaluates a file in the global env, even from inside a let
+(define x 100)
+(let ((x 1)) (load "lib.scm") x)
+(bump!)
+shared
+x
+(load "bad.scm")
+before
+(load "missing.scm")
@@ -0,0 +1,2 @@
+(define before 1)
+) (define after 2)
@@ -0,0 +1,3 @@
+(define counter 0)
+(twice (set! counter (+ counter 1)))
+counter
@@ -0,0 +1,2 @@
+(define-syntax twice (syntax-rules () ((_ e) (begin e e))))
+(load "lib.scm")
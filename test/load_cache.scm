@@ -0,0 +1,10 @@
+; a file loaded before runs from the cache unless a macro it used changed
+(define-syntax twice (syntax-rules () ((_ e) (begin e e))))
+(load "lib.scm")
+(load-cache-stats)
+(define-syntax twice (syntax-rules () ((_ e) e)))
+(load "lib.scm")
+(load-cache-stats)
+(load "bad.scm")
+(load "bad.scm")
+(load-cache-stats)
@@ -0,0 +1,26 @@
+; named let, do and internal defines run in one pre-sized frame
+(let loop ((i 0) (acc 0)) (if (eqv? i 10) acc (loop (+ i 1) (+ acc i))))
+(let loop ((i 0)) (cond ((eqv? i 100000) i) (else (loop (+ i 1)))))
+(do ((i 0 (+ i 1)) (s 0 (+ s i))) ((eqv? i 5) s))
+(do ((vec '() (cons i vec)) (i 0 (+ i 1))) ((eqv? i 5) vec))
+(define fs '())
+(do ((i 0 (+ i 1))) ((eqv? i 3) 'ok) (set! fs (cons (lambda () i) fs)))
+((car fs))
+((car (cdr fs)))
+(let loop ((i 0)) (if (eqv? i 3) 'done (begin (let loop ((j 0)) (if (eqv? j 2) j (loop (+ j 1)))) (loop (+ i 1)))))
+(let loop ((i 0)) (if (eqv? i 5) 0 (+ 1 (loop (+ i 1)))))
+(define (f) (define a 1) (define b (+ a 1)) (+ a b))
+(f)
+(letrec* ((a 1) (b (+ a 1))) b)
+(letrec ((ev (lambda (n) (if (eqv? n 0) #t (od (+ n -1)))))
+         (od (lambda (n) (if (eqv? n 0) #f (ev (+ n -1))))))
+  (ev 100))
+; a loop name the body assigns is called like any procedure
+(define (other n) 'other-called)
+(let loop ((i 0))
+  (if (eqv? i 0) (begin (set! loop other) (loop 1)) 'loop-called))
+; each iteration starts with its internal defines unbound
+(let loop ((i 0))
+  (define seen (guard (e (#t 'unbound)) y))
+  (define y i)
+  (if (eqv? i 2) seen (loop (+ i 1))))
@@ -0,0 +1,15 @@
+; floats print with the shortest digits that read back, integers exactly
+1.5
+-2.5
+0.25
+1.50
+100.0
+-0.0
+0.001
+123456.789
+(+ 0.1 0.2)
+(* 1.1 1.1)
+(+ 1 2)
+9223372036854775807
+-9223372036854775807
+(* 100000000000.0 1000000000000.0)
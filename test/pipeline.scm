@@ -0,0 +1,208 @@
+; forms parsed on the reader thread are evaluated in order
+(define acc 0)
+(set! acc (+ acc 1))
+(set! acc (+ acc 2))
+(set! acc (+ acc 3))
+(set! acc (+ acc 4))
+(set! acc (+ acc 5))
+(set! acc (+ acc 6))
+(set! acc (+ acc 7))
+(set! acc (+ acc 8))
+(set! acc (+ acc 9))
+(set! acc (+ acc 10))
+(set! acc (+ acc 11))
+(set! acc (+ acc 12))
+(set! acc (+ acc 13))
+(set! acc (+ acc 14))
+(set! acc (+ acc 15))
+(set! acc (+ acc 16))
+(set! acc (+ acc 17))
+(set! acc (+ acc 18))
+(set! acc (+ acc 19))
+(set! acc (+ acc 20))
+(set! acc (+ acc 21))
+(set! acc (+ acc 22))
+(set! acc (+ acc 23))
+(set! acc (+ acc 24))
+(set! acc (+ acc 25))
+(set! acc (+ acc 26))
+(set! acc (+ acc 27))
+(set! acc (+ acc 28))
+(set! acc (+ acc 29))
+(set! acc (+ acc 30))
+(set! acc (+ acc 31))
+(set! acc (+ acc 32))
+(set! acc (+ acc 33))
+(set! acc (+ acc 34))
+(set! acc (+ acc 35))
+(set! acc (+ acc 36))
+(set! acc (+ acc 37))
+(set! acc (+ acc 38))
+(set! acc (+ acc 39))
+(set! acc (+ acc 40))
+(set! acc (+ acc 41))
+(set! acc (+ acc 42))
+(set! acc (+ acc 43))
+(set! acc (+ acc 44))
+(set! acc (+ acc 45))
+(set! acc (+ acc 46))
+(set! acc (+ acc 47))
+(set! acc (+ acc 48))
+(set! acc (+ acc 49))
+(set! acc (+ acc 50))
+(set! acc (+ acc 51))
+(set! acc (+ acc 52))
+(set! acc (+ acc 53))
+(set! acc (+ acc 54))
+(set! acc (+ acc 55))
+(set! acc (+ acc 56))
+(set! acc (+ acc 57))
+(set! acc (+ acc 58))
+(set! acc (+ acc 59))
+(set! acc (+ acc 60))
+(set! acc (+ acc 61))
+(set! acc (+ acc 62))
+(set! acc (+ acc 63))
+(set! acc (+ acc 64))
+(set! acc (+ acc 65))
+(set! acc (+ acc 66))
+(set! acc (+ acc 67))
+(set! acc (+ acc 68))
+(set! acc (+ acc 69))
+(set! acc (+ acc 70))
+(set! acc (+ acc 71))
+(set! acc (+ acc 72))
+(set! acc (+ acc 73))
+(set! acc (+ acc 74))
+(set! acc (+ acc 75))
+(set! acc (+ acc 76))
+(set! acc (+ acc 77))
+(set! acc (+ acc 78))
+(set! acc (+ acc 79))
+(set! acc (+ acc 80))
+(set! acc (+ acc 81))
+(set! acc (+ acc 82))
+(set! acc (+ acc 83))
+(set! acc (+ acc 84))
+(set! acc (+ acc 85))
+(set! acc (+ acc 86))
+(set! acc (+ acc 87))
+(set! acc (+ acc 88))
+(set! acc (+ acc 89))
+(set! acc (+ acc 90))
+(set! acc (+ acc 91))
+(set! acc (+ acc 92))
+(set! acc (+ acc 93))
+(set! acc (+ acc 94))
+(set! acc (+ acc 95))
+(set! acc (+ acc 96))
+(set! acc (+ acc 97))
+(set! acc (+ acc 98))
+(set! acc (+ acc 99))
+(set! acc (+ acc 100))
+(set! acc (+ acc 101))
+(set! acc (+ acc 102))
+(set! acc (+ acc 103))
+(set! acc (+ acc 104))
+(set! acc (+ acc 105))
+(set! acc (+ acc 106))
+(set! acc (+ acc 107))
+(set! acc (+ acc 108))
+(set! acc (+ acc 109))
+(set! acc (+ acc 110))
+(set! acc (+ acc 111))
+(set! acc (+ acc 112))
+(set! acc (+ acc 113))
+(set! acc (+ acc 114))
+(set! acc (+ acc 115))
+(set! acc (+ acc 116))
+(set! acc (+ acc 117))
+(set! acc (+ acc 118))
+(set! acc (+ acc 119))
+(set! acc (+ acc 120))
+(set! acc (+ acc 121))
+(set! acc (+ acc 122))
+(set! acc (+ acc 123))
+(set! acc (+ acc 124))
+(set! acc (+ acc 125))
+(set! acc (+ acc 126))
+(set! acc (+ acc 127))
+(set! acc (+ acc 128))
+(set! acc (+ acc 129))
+(set! acc (+ acc 130))
+(set! acc (+ acc 131))
+(set! acc (+ acc 132))
+(set! acc (+ acc 133))
+(set! acc (+ acc 134))
+(set! acc (+ acc 135))
+(set! acc (+ acc 136))
+(set! acc (+ acc 137))
+(set! acc (+ acc 138))
+(set! acc (+ acc 139))
+(set! acc (+ acc 140))
+(set! acc (+ acc 141))
+(set! acc (+ acc 142))
+(set! acc (+ acc 143))
+(set! acc (+ acc 144))
+(set! acc (+ acc 145))
+(set! acc (+ acc 146))
+(set! acc (+ acc 147))
+(set! acc (+ acc 148))
+(set! acc (+ acc 149))
+(set! acc (+ acc 150))
+(set! acc (+ acc 151))
+(set! acc (+ acc 152))
+(set! acc (+ acc 153))
+(set! acc (+ acc 154))
+(set! acc (+ acc 155))
+(set! acc (+ acc 156))
+(set! acc (+ acc 157))
+(set! acc (+ acc 158))
+(set! acc (+ acc 159))
+(set! acc (+ acc 160))
+(set! acc (+ acc 161))
+(set! acc (+ acc 162))
+(set! acc (+ acc 163))
+(set! acc (+ acc 164))
+(set! acc (+ acc 165))
+(set! acc (+ acc 166))
+(set! acc (+ acc 167))
+(set! acc (+ acc 168))
+(set! acc (+ acc 169))
+(set! acc (+ acc 170))
+(set! acc (+ acc 171))
+(set! acc (+ acc 172))
+(set! acc (+ acc 173))
+(set! acc (+ acc 174))
+(set! acc (+ acc 175))
+(set! acc (+ acc 176))
+(set! acc (+ acc 177))
+(set! acc (+ acc 178))
+(set! acc (+ acc 179))
+(set! acc (+ acc 180))
+(set! acc (+ acc 181))
+(set! acc (+ acc 182))
+(set! acc (+ acc 183))
+(set! acc (+ acc 184))
+(set! acc (+ acc 185))
+(set! acc (+ acc 186))
+(set! acc (+ acc 187))
+(set! acc (+ acc 188))
+(set! acc (+ acc 189))
+(set! acc (+ acc 190))
+(set! acc (+ acc 191))
+(set! acc (+ acc 192))
+(set! acc (+ acc 193))
+(set! acc (+ acc 194))
+(set! acc (+ acc 195))
+(set! acc (+ acc 196))
+(set! acc (+ acc 197))
+(set! acc (+ acc 198))
+(set! acc (+ acc 199))
+(set! acc (+ acc 200))
+acc
+(define (f x) (cons x x))
+(f 'a)
+(car '())
+'after-error
+(let loop ((i 0)) (if (eqv? i 1000) 'looped (loop (+ i 1))))
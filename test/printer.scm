@@ -0,0 +1,14 @@
+; values print through the buffered sink, long output included
+'(1 (2 . 3) "s" . 4)
+'(quoted (vec 1) #t #f)
+(quote ())
+(lambda (x) x)
+(define (named) 1)
+named
+car
+'#t
+-5
+2.5
+(cons 1 (cons 2 '()))
+(let loop ((i 0) (acc '())) (if (eqv? i 300) acc (loop (+ i 1) (cons i acc))))
+(let loop ((i 0) (acc '())) (if (eqv? i 100000) (car acc) (loop (+ i 1) (cons i acc))))
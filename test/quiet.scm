@@ -0,0 +1,7 @@
+; --quiet prints errors only, not the value of every form
+(define x 1)
+x
+'(a b)
+(car '())
+(+ x 1)
+(undefined-var)
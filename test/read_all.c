@@ -0,0 +1,118 @@
+#include "my_lisp_io.h"
+
+/* read_all gives the same datums on any number of threads */
+
+#define LINES 40000
+
+static int failed;
+
+/* o1 and o2 are borrowed */
+static bool datum_equal(object *o1, object *o2) {
+    for (;;) {
+        if (!o1 || !o2) {
+            return o1 == o2;
+        }
+        if (o1->type != o2->type) {
+            return false;
+        }
+        switch (o1->type) {
+        case T_PAIR:
+            if (!datum_equal(o1->pair->car, o2->pair->car)) {
+                return false;
+            }
+            o1 = o1->pair->cdr;
+            o2 = o2->pair->cdr;
+            continue;
+        case T_SYMBOL:
+            return o1->symbol == o2->symbol;
+        case T_STRING:
+            return o1->str->len == o2->str->len &&
+                   !memcmp(o1->str->str_p, o2->str->str_p, o1->str->len);
+        case T_NUMBER:
+            return o1->number->flag.size == o2->number->flag.size &&
+                   !memcmp(o1->number, o2->number, o1->number->flag.size);
+        case T_CHARACTER:
+            return o1->char_val == o2->char_val;
+        case T_BOOLEAN:
+            return o1->bool_val == o2->bool_val;
+        default:
+            return false;
+        }
+    }
+}
+
+/* lines of every kind of datum, with a stray ) on line stray if not 0 */
+static char *make_text(size_t *len, int stray) {
+    char *buf = my_malloc(LINES * 64);
+    char *p = buf;
+    for (int i = 1; i <= LINES; i++) {
+        if (i == stray) {
+            p += my_sprintf(p, ")\n");
+            continue;
+        }
+        switch (i % 4) {
+        case 0:
+            p += my_sprintf(p, "(%d \"s ( %d\" #\\( sym%d)\n", i, i, i);
+            break;
+        case 1:
+            p += my_sprintf(p, "'(nested (x . %d) [v #t #f])\n", i);
+            break;
+        case 2:
+            p += my_sprintf(p, "%d.5 ; comment ( %d\n", i, i);
+            break;
+        default:
+            p += my_sprintf(p, "sym-%d\n", i);
+            break;
+        }
+    }
+    *len = p - buf;
+    return buf;
+}
+
+static void test_threads(struct lisp_ctx *ctx) {
+    size_t len;
+    char *text = make_text(&len, 0);
+
+    object *one = read_all(ctx->parse_data, text, len, 1);
+    for (int threads = 2; threads <= 4; threads++) {
+        object *many = read_all(ctx->parse_data, text, len, threads);
+        if (!datum_equal(one, many)) {
+            my_printf("read_all on %d threads differs from one\n", threads);
+            failed = 1;
+        }
+        unref(many);
+    }
+    unref(one);
+    my_free(text);
+}
+
+static void test_stray(struct lisp_ctx *ctx, int stray) {
+    size_t len;
+    char *text = make_text(&len, stray);
+    char expected[64];
+    my_sprintf(expected, "line %d", stray);
+
+    for (int threads = 1; threads <= 4; threads++) {
+        object *ret = read_all(ctx->parse_data, text, len, threads);
+        if (!ret || ret->type != T_ERR ||
+            !strstr(error_message(ret->err), expected)) {
+            my_printf("read_all with ) on line %d and %d threads is not an "
+                      "error at it\n",
+                      stray, threads);
+            failed = 1;
+        }
+        unref(ret);
+    }
+    my_free(text);
+}
+
+int main(void) {
+    struct lisp_ctx *ctx = make_lisp_ctx((struct lisp_ctx_opt){});
+
+    test_threads(ctx);
+    test_stray(ctx, 7);
+    test_stray(ctx, LINES * 3 / 4);
+
+    free_lisp_ctx(&ctx);
+    return failed;
+}
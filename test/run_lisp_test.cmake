@@ -0,0 +1,52 @@
+# run by ctest as cmake -P with
+#   LISP      the interpreter
+#   SOURCE    the test directory
+#   NAME      the test, NAME.scm is run and its output compared with NAME.out
+#   WORK      a scratch directory the test runs in
+#   ARGS      options put before NAME.scm
+#   SETUP     a command line run before, e.g. to dump an image
+#   SETUP_RESULT  fail or ok (the default), how SETUP has to exit
+#   RESULT    fail or ok (the default), how the test has to exit
+#   MAIN      the file run in place of NAME.scm
+# files under SOURCE/NAME.d are copied into WORK first.
+
+file(REMOVE_RECURSE "${WORK}")
+file(MAKE_DIRECTORY "${WORK}")
+if(EXISTS "${SOURCE}/${NAME}.scm")
+  file(COPY "${SOURCE}/${NAME}.scm" DESTINATION "${WORK}")
+endif()
+if(EXISTS "${SOURCE}/${NAME}.d")
+  file(COPY "${SOURCE}/${NAME}.d/" DESTINATION "${WORK}")
+endif()
+
+function(check_result what rc expected)
+  if(expected STREQUAL "fail")
+    if(rc EQUAL 0)
+      message(FATAL_ERROR "${what} exited with 0, expected a failure")
+    endif()
+  elseif(NOT rc EQUAL 0)
+    message(FATAL_ERROR "${what} exited with ${rc}")
+  endif()
+endfunction()
+
+if(SETUP)
+  separate_arguments(setup UNIX_COMMAND "${SETUP}")
+  execute_process(COMMAND "${LISP}" ${setup}
+    WORKING_DIRECTORY "${WORK}"
+    RESULT_VARIABLE rc OUTPUT_VARIABLE out)
+  check_result("my-lisp ${SETUP}" "${rc}" "${SETUP_RESULT}")
+endif()
+
+if(NOT MAIN)
+  set(MAIN "${NAME}.scm")
+endif()
+separate_arguments(args UNIX_COMMAND "${ARGS}")
+execute_process(COMMAND "${LISP}" ${args} ${MAIN}
+  WORKING_DIRECTORY "${WORK}"
+  RESULT_VARIABLE rc OUTPUT_VARIABLE out)
+
+file(READ "${SOURCE}/${NAME}.out" expected)
+if(NOT out STREQUAL expected)
+  message(FATAL_ERROR "${NAME} printed\n${out}\nexpected\n${expected}")
+endif()
+check_result("my-lisp ${ARGS} ${MAIN}" "${rc}" "${RESULT}")
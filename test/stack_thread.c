@@ -0,0 +1,56 @@
+#include <pthread.h>
+
+#include "my_lisp.h"
+
+/*
+ * the stack limit is the one of the thread evaluating, not of the thread
+ * that made the context: deep recursion moves off the stack in time both
+ * on the main thread and on a thread with a small stack
+ */
+
+#define THREAD_STACK (256 * 1024)
+
+static const char deep[] =
+    "(define (deep n) (if (eqv? n 0) 0 (+ 1 (deep (+ n -1)))))"
+    "(eqv? (deep 200000) 200000)";
+
+static void *make(void *arg) {
+    (void)arg;
+    return make_lisp_ctx((struct lisp_ctx_opt){});
+}
+
+static void *run(void *arg) { return eval_from_str(arg, (char *)deep); }
+
+static void *on_thread(void *(*fn)(void *), void *arg) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, THREAD_STACK);
+    pthread_t thread;
+    void *ret = NULL;
+    if (pthread_create(&thread, &attr, fn, arg) ||
+        pthread_join(thread, &ret)) {
+        my_printf("can not run the thread\n");
+    }
+    pthread_attr_destroy(&attr);
+    return ret;
+}
+
+static int check(object *ret, const char *where) {
+    int failed = !ret || ret->type != T_BOOLEAN || !ret->bool_val;
+    if (failed) {
+        my_printf("deep recursion on %s is not #t\n", where);
+    }
+    unref(ret);
+    return failed;
+}
+
+int main(void) {
+    struct lisp_ctx *ctx = on_thread(make, NULL);
+    if (!ctx) {
+        return 1;
+    }
+    int failed = check(run(ctx), "the main thread");
+    failed |= check(on_thread(run, ctx), "a small thread");
+    free_lisp_ctx(&ctx);
+    return failed;
+}
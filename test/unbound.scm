@@ -0,0 +1,16 @@
+; a miss is an error only where it reaches the program
+missing
+(set! missing 1)
+(define (later-user) later)
+(later-user)
+(define later 'defined-after)
+(later-user)
+(set! later 'set)
+(later-user)
+(let ((x 1) (y 2)) (+ x y))
+(let ((missing 3)) missing)
+(define-syntax twice
+  (syntax-rules ()
+    ((_ e) (begin e e))))
+(twice 'macro)
+(let ((twice (lambda (x) 'shadowed))) (twice 1))